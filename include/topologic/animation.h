@@ -0,0 +1,248 @@
+/**\file
+ * \brief Animation rendering
+ *
+ * Contains the animation mode of the CLI frontend, which renders a sequence
+ * of frames of a single model while rotating it, e.g. for turntable
+ * animations. The model's geometry is generated once and then re-projected
+ * for every frame, and frames are rendered in parallel.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_ANIMATION_H)
+#define TOPOLOGIC_ANIMATION_H
+
+#include <topologic/batch.h>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace topologic {
+/**\brief Animation rendering
+ *
+ * Contains the classes and functions used to render animations.
+ */
+namespace animation {
+/**\brief Rotation
+ *
+ * A rotation that is applied over the course of an animation, in the same
+ * way that dragging the mouse in the interactive frontends rotates a model
+ * with the given dimension set as active.
+ */
+class rotation {
+public:
+  /**\brief Dimension
+   *
+   * The dimension whose transformation is rotated, e.g. 4 to rotate the
+   * model through the fourth dimension.
+   */
+  std::size_t dimension;
+
+  /**\brief Horizontal turns
+   *
+   * Number of full turns in the direction of a horizontal drag, over the
+   * whole animation.
+   */
+  double x;
+
+  /**\brief Vertical turns
+   *
+   * Number of full turns in the direction of a vertical drag, over the whole
+   * animation.
+   */
+  double y;
+};
+
+/**\brief Advance by one frame
+ *
+ * Applies one frame's worth of each rotation in the schedule, in order.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[out] s        The state object to rotate.
+ * \param[in]  schedule The rotations to apply.
+ * \param[in]  frames   The number of frames in the animation.
+ */
+template <typename Q, std::size_t d>
+static void step(state<Q, d> &s, const std::vector<rotation> &schedule,
+                 const std::size_t &frames) {
+  // interpretDrag() rotates by 1/(50 pi) radians per unit.
+  const double scale = 2. * M_PI * M_PI * 50. / double(frames);
+
+  for (const rotation &r : schedule) {
+    s.setActive(r.dimension);
+    s.interpretDrag(Q(r.x * scale), Q(r.y * scale), Q(0));
+  }
+}
+
+/**\brief Frame file name
+ *
+ * \param[in] prefix      The file name prefix, e.g. "frame".
+ * \param[in] i           The index of the frame.
+ * \param[in] frames      The number of frames in the animation.
+ * \param[in] out         The output mode.
+ * \param[in] compression The compression method used for the frame.
+ *
+ * \returns The prefix, the frame index padded with zeroes to at least four
+ *          digits and an extension for the output mode, e.g.
+ *          'frame.0042.svg', or 'frame.0042.svgz' with gzip.
+ */
+static inline std::string name(const std::string &prefix, const std::size_t &i,
+                               const std::size_t &frames,
+                               const enum outputMode &out,
+                               const compress::method &compression =
+                                   compress::mNone) {
+  int width = 1;
+  for (std::size_t n = frames - 1; n >= 10; n /= 10) {
+    width++;
+  }
+
+  std::ostringstream s("");
+  s << prefix << "." << std::setw(width < 4 ? 4 : width) << std::setfill('0')
+    << i << batch::extension(out, compression);
+  return s.str();
+}
+
+/**\brief Render animation
+ *
+ * Renders all frames of an animation of the prototype state's model to
+ * their own files, named as per name(). Frame 0 uses the prototype's
+ * transformations as they are, and each following frame adds one step of
+ * the rotation schedule, so that an animation with whole numbers of turns
+ * loops seamlessly.
+ *
+ * The model's geometry is generated once, with the prototype state object.
+ * Each worker thread then sets up its own state object from the prototype's
+ * JSON representation, shares the generated geometry through its geometry
+ * cache and renders every frame it picks up by re-projecting it.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[in,out] prototype The state object to animate. Its geometry cache
+ *                          is filled, but it is otherwise left untouched.
+ * \param[in]     schedule  The rotations to apply per frame.
+ * \param[in]     frames    The number of frames to render.
+ * \param[in]     prefix    The prefix of the frames' file names.
+ * \param[in]     out       The output mode to use for all frames.
+ * \param[in]     threads   Number of worker threads to use; 0 for one per
+ *                          core.
+ *
+ * \returns The number of frames that failed.
+ */
+template <typename Q, std::size_t d>
+static std::size_t run(state<Q, d> &prototype,
+                       const std::vector<rotation> &schedule,
+                       const std::size_t &frames, const std::string &prefix,
+                       const enum outputMode &out, std::size_t threads) {
+  if (!prototype.model) {
+    std::cerr << "error: no model to animate\n";
+    return frames;
+  }
+
+  for (const rotation &r : schedule) {
+    if ((r.dimension < 3) || (r.dimension > d)) {
+      std::cerr << "error: can't rotate in " << r.dimension
+                << " dimensions\n";
+      return frames;
+    }
+  }
+
+  {
+    const std::atomic<bool> never(false);
+    prototype.model->prepare(never, false);
+  }
+
+  std::ostringstream meta("");
+  meta << efgy::json::tag() << prototype;
+  const std::string json = meta.str();
+  const std::string format = prototype.model->formatID;
+  const std::string model = prototype.model->id;
+  const std::size_t depth = prototype.model->depth;
+  const std::size_t rdepth = prototype.model->renderDepth;
+
+  std::vector<char> ok(frames, 0);
+  std::atomic<std::size_t> next(0);
+
+  auto worker = [&]() {
+    state<Q, d> s;
+    efgy::json::value<> v;
+    std::string data = json;
+    data >> v;
+    parse(s, v);
+
+    s.parameter = prototype.parameter;
+    s.fractalFlameColouring = prototype.fractalFlameColouring;
+    s.digits = prototype.digits;
+    s.compact = prototype.compact;
+    s.compression = prototype.compression;
+    s.imageWidth = prototype.imageWidth;
+    s.imageHeight = prototype.imageHeight;
+    s.detail = prototype.detail;
+    s.threads = 1;
+    s.cache.adopt(prototype.cache);
+
+    if (!setModel(s, format, model, depth, rdepth)) {
+      return;
+    }
+
+    std::size_t at = 0;
+    for (std::size_t i = next++; i < frames; i = next++) {
+      for (; at < i; at++) {
+        step(s, schedule, frames);
+      }
+
+      const std::string file = name(prefix, i, frames, out, s.compression);
+      std::ofstream f(file, std::ios::out | std::ios::binary);
+      ok[i] = write(f, s, out);
+      f.close();
+      if (!ok[i] || !f) {
+        std::cerr << "error: could not write " << file << "\n";
+        ok[i] = 0;
+      }
+    }
+  };
+
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (threads > frames) {
+    threads = frames;
+  }
+
+  if (threads <= 1) {
+    worker();
+  } else {
+    std::vector<std::thread> workers;
+
+    for (std::size_t t = 0; t < threads; t++) {
+      workers.push_back(std::thread(worker));
+    }
+
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+
+  std::size_t failed = 0;
+  for (const char &o : ok) {
+    if (!o) {
+      failed++;
+    }
+  }
+
+  return failed;
+}
+}
+}
+
+#endif
@@ -0,0 +1,376 @@
+/**\file
+ * \brief Geometry memory
+ *
+ * Contains the memory pool and arena that model geometry is stored in.
+ * Generating a model keeps a handful of very large arrays, which used to be
+ * grown with the system allocator and returned to it again whenever a model
+ * was replaced; with the arena, all of a model's arrays live in one block,
+ * and blocks are recycled between models of about the same size.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_ARENA_H)
+#define TOPOLOGIC_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace topologic {
+/**\brief Geometry memory
+ *
+ * Contains the classes used to allocate the storage of model geometry.
+ */
+namespace arena {
+/**\brief Block pool
+ *
+ * Keeps memory blocks that are no longer in use around, sorted into size
+ * classes, so that the next block of the same class doesn't have to come from
+ * the system allocator. There are four size classes per power of two, so a
+ * block is at most 25% larger than requested.
+ *
+ * Blocks are kept until the pool holds 'limit' bytes of them; any blocks
+ * released after that go straight back to the system allocator.
+ *
+ * \note All of the methods of this class are thread safe, since models are
+ *       often generated on one thread and released on another.
+ */
+class pool {
+public:
+  /**\brief Construct with limit
+   *
+   * \param[in] pLimit The number of bytes of unused blocks to keep at most;
+   *                   64 MiB by default.
+   */
+  pool(std::size_t pLimit = std::size_t(1) << 26)
+      : limit(pLimit), allocations(0), kept(0) {}
+
+  pool(const pool &) = delete;
+
+  /**\brief Destructor
+   *
+   * Returns all unused blocks to the system allocator.
+   */
+  ~pool(void) { trim(); }
+
+  /**\brief Common pool
+   *
+   * The pool that all geometry is allocated from.
+   *
+   * \returns The common pool.
+   */
+  static pool &common(void) {
+    static pool p;
+    return p;
+  }
+
+  /**\brief Get block
+   *
+   * Returns an unused block of the right size class, or allocates a new one.
+   *
+   * \param[in,out] bytes The number of bytes needed; set to the size of the
+   *                      returned block.
+   *
+   * \returns The block. The programme is aborted if no memory is left.
+   */
+  void *acquire(std::size_t &bytes) {
+    const std::size_t c = index(bytes);
+    bytes = size(c);
+
+    {
+      std::lock_guard<std::mutex> l(lock);
+      if ((c < free.size()) && !free[c].empty()) {
+        void *p = free[c].back();
+        free[c].pop_back();
+        kept -= bytes;
+        return p;
+      }
+    }
+
+    allocations++;
+    void *p = std::malloc(bytes);
+    if (p == 0) {
+      std::abort();
+    }
+    return p;
+  }
+
+  /**\brief Return block
+   *
+   * \param[in] p     A block returned by acquire().
+   * \param[in] bytes The size of the block, as set by acquire().
+   */
+  void release(void *p, const std::size_t &bytes) {
+    {
+      std::lock_guard<std::mutex> l(lock);
+      if (kept + bytes <= limit) {
+        const std::size_t c = index(bytes);
+        if (c >= free.size()) {
+          free.resize(c + 1);
+        }
+        free[c].push_back(p);
+        kept += bytes;
+        return;
+      }
+    }
+
+    std::free(p);
+  }
+
+  /**\brief Drop unused blocks
+   *
+   * Returns all of the blocks that aren't in use to the system allocator.
+   */
+  void trim(void) {
+    std::lock_guard<std::mutex> l(lock);
+    for (auto &c : free) {
+      for (void *p : c) {
+        std::free(p);
+      }
+      c.clear();
+    }
+    kept = 0;
+  }
+
+  /**\brief Block size
+   *
+   * \param[in] bytes A number of bytes.
+   *
+   * \returns The size of the block that acquire() returns for that many
+   *          bytes.
+   */
+  static std::size_t round(const std::size_t &bytes) {
+    return size(index(bytes));
+  }
+
+  /**\brief Maximum number of unused bytes
+   *
+   * The total size of the unused blocks to keep around at most. Set to 0 to
+   * disable the pool.
+   */
+  std::size_t limit;
+
+  /**\brief System allocations
+   *
+   * The number of blocks that acquire() had to get from the system
+   * allocator, because there was no unused one of the right size class.
+   */
+  std::atomic<unsigned long long> allocations;
+
+protected:
+  /**\brief Size class
+   *
+   * \param[in] bytes A number of bytes.
+   *
+   * \returns The index of the smallest size class that holds that many
+   *          bytes. Class 4k+i holds (4+i)*2^k bytes, and the smallest
+   *          class holds 64 bytes.
+   */
+  static std::size_t index(const std::size_t &bytes) {
+    std::size_t k = 4;
+    while ((std::size_t(8) << k) < bytes) {
+      k++;
+    }
+    std::size_t i = 0;
+    while (((std::size_t(4) + i) << k) < bytes) {
+      i++;
+    }
+    return 4 * k + i;
+  }
+
+  /**\brief Size of size class
+   *
+   * \param[in] c The index of a size class.
+   *
+   * \returns The size of the blocks in that class, in bytes.
+   */
+  static std::size_t size(const std::size_t &c) {
+    return (std::size_t(4) + c % 4) << (c / 4);
+  }
+
+  /**\brief Unused blocks
+   *
+   * The blocks that aren't in use, by size class.
+   */
+  std::vector<std::vector<void *>> free;
+
+  /**\brief Bytes kept
+   *
+   * The total size of the blocks in 'free'.
+   */
+  std::size_t kept;
+
+  /**\brief Lock
+   *
+   * Protects 'free' and 'kept'.
+   */
+  std::mutex lock;
+};
+
+/**\brief Memory arena
+ *
+ * Hands out memory from a single block of the common pool, one allocation
+ * after the other. Memory is not freed when it is deallocated, but all at
+ * once when the arena is destroyed; so the arena is meant to be filled once,
+ * with containers that are reserved up front, and then kept as is.
+ *
+ * If an allocation doesn't fit in the block, it is served from the pool
+ * directly; that works just as well, it's just not contiguous.
+ */
+class region {
+public:
+  /**\brief Default constructor
+   *
+   * Creates an arena without a block; see reserve().
+   */
+  region(void) : block(0), capacity(0), used(0) {}
+
+  region(const region &) = delete;
+
+  /**\brief Destructor
+   *
+   * Returns all of the arena's memory to the common pool.
+   */
+  ~region(void) {
+    for (const auto &e : extra) {
+      pool::common().release(e.first, e.second);
+    }
+    if (block) {
+      pool::common().release(block, capacity);
+    }
+  }
+
+  /**\brief Get block
+   *
+   * Takes a block with room for at least the given number of bytes from the
+   * common pool. Only the first call has an effect.
+   *
+   * \param[in] bytes The number of bytes to make room for.
+   */
+  void reserve(std::size_t bytes) {
+    if (!block && (bytes > 0)) {
+      block = static_cast<char *>(pool::common().acquire(bytes));
+      capacity = bytes;
+    }
+  }
+
+  /**\brief Allocate memory
+   *
+   * \param[in] bytes     The number of bytes to allocate.
+   * \param[in] alignment The alignment of the memory, no more than that of
+   *                      std::max_align_t.
+   *
+   * \returns The memory.
+   */
+  void *allocate(std::size_t bytes, const std::size_t &alignment) {
+    const std::size_t start = (used + alignment - 1) / alignment * alignment;
+    if (block && (start + bytes <= capacity)) {
+      used = start + bytes;
+      return block + start;
+    }
+
+    void *p = pool::common().acquire(bytes);
+    extra.push_back(std::make_pair(p, bytes));
+    return p;
+  }
+
+protected:
+  /**\brief Block
+   *
+   * The block taken by reserve(), or 0 if there is none.
+   */
+  char *block;
+
+  /**\brief Block size
+   *
+   * The size of 'block', in bytes.
+   */
+  std::size_t capacity;
+
+  /**\brief Bytes used
+   *
+   * The number of bytes at the start of 'block' that have been handed out.
+   */
+  std::size_t used;
+
+  /**\brief Overflow blocks
+   *
+   * Blocks for allocations that didn't fit in 'block', with their sizes.
+   */
+  std::vector<std::pair<void *, std::size_t>> extra;
+};
+
+/**\brief Arena allocator
+ *
+ * A standard allocator that allocates from a region, or from the common pool
+ * if it isn't bound to one. In the latter case, memory is returned to the
+ * pool as soon as it is deallocated, so containers that grow get their old
+ * blocks recycled.
+ *
+ * \tparam T The type of the objects to allocate.
+ */
+template <typename T> class allocator {
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  /**\brief Construct with region
+   *
+   * \param[in] pRegion The region to allocate from, or 0 for the pool.
+   */
+  allocator(region *pRegion = 0) : arena(pRegion) {}
+
+  template <typename U>
+  allocator(const allocator<U> &other)
+      : arena(other.arena) {}
+
+  T *allocate(std::size_t n) {
+    std::size_t bytes = n * sizeof(T);
+    if (arena) {
+      return static_cast<T *>(arena->allocate(bytes, alignof(T)));
+    }
+    return static_cast<T *>(pool::common().acquire(bytes));
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    if (!arena) {
+      pool::common().release(p, pool::round(n * sizeof(T)));
+    }
+  }
+
+  template <typename U> bool operator==(const allocator<U> &b) const {
+    return arena == b.arena;
+  }
+
+  template <typename U> bool operator!=(const allocator<U> &b) const {
+    return arena != b.arena;
+  }
+
+  /**\brief Region
+   *
+   * The region to allocate from, or 0 to use the common pool.
+   */
+  region *arena;
+};
+
+/**\brief Arena vector
+ *
+ * A vector that allocates from a region or the common pool.
+ */
+template <typename T> using vector = std::vector<T, allocator<T>>;
+}
+}
+
+#endif
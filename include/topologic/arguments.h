@@ -19,220 +19,446 @@
 
 #include <iostream>
 #include <fstream>
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <mutex>
 
 #include <ef.gy/cli.h>
 #include <ef.gy/version.h>
 #include <ef.gy/parametric.h>
 
+#include <topologic/input.h>
 #include <topologic/parse.h>
+#include <topologic/registry.h>
 #include <topologic/version.h>
 
 namespace topologic {
-/**\brief Parse command line arguments
+/**\brief Argument parser lock
  *
- * A function template to parse C-style command line arguments, apply the
- * settings in those arguments to a topologic::state instance. This
- * function will also parse XML files that have been passed in as command
- * line arguments and set the model in the state object to match that
- * specified as command line arguments or in XML files.
+ * libefgy's command line options register themselves with a global list of
+ * options, so only one thread may parse arguments at any one time. parse()
+ * holds this lock while it runs; the batch mode's worker threads rely on it.
  *
- * As usual, later options override earlier ones - that also applies to
- * settings in XML files. If the NOLIBRARIES macro is set then XML files
- * will not be processed.
+ * \returns The mutex that guards the global option list.
+ */
+static inline std::mutex &parserLock(void) {
+  static std::mutex lock;
+  return lock;
+}
+
+/**\brief Parse integer argument
+ *
+ * Parses a decimal integer in a command line argument, without throwing on
+ * overflow like std::stoul() does: arguments come from batch manifests and
+ * server requests as well, and an exception would take down the whole
+ * process.
+ *
+ * \tparam T Integer type to parse into.
+ *
+ * \param[in]  s     The digits to parse.
+ * \param[in]  min   The lowest value to accept.
+ * \param[in]  max   The highest value to accept.
+ * \param[out] value Set to the parsed value if it is valid.
+ *
+ * \returns 'true' if 's' is a number between 'min' and 'max'; otherwise an
+ *          error is printed and 'value' is left untouched.
+ */
+template <typename T>
+static bool number(const std::string &s, const T &min, const T &max,
+                   T &value) {
+  char *end = 0;
+  errno = 0;
+  const unsigned long long v = std::strtoull(s.c_str(), &end, 10);
+  if (s.empty() || (s[0] == '-') || (*end != 0) || (errno == ERANGE) ||
+      (v < (unsigned long long)(min)) || (v > (unsigned long long)(max))) {
+    std::cerr << "error: '" << s << "' is not a number between " << min
+              << " and " << max << "\n";
+    return false;
+  }
+  value = T(v);
+  return true;
+}
+
+/**\brief Parse real argument
+ *
+ * Like number(), but for real numbers, which must be finite.
+ *
+ * \tparam Q Base data type to parse into.
+ *
+ * \param[in]  s     The number to parse.
+ * \param[out] value Set to the parsed value if it is valid.
+ *
+ * \returns 'true' if 's' is a finite number.
+ */
+template <typename Q> static bool real(const std::string &s, Q &value) {
+  char *end = 0;
+  errno = 0;
+  const long double v = std::strtold(s.c_str(), &end);
+  if (s.empty() || (*end != 0) || (errno == ERANGE) || !std::isfinite(v) ||
+      !std::isfinite(double(Q(v)))) {
+    std::cerr << "error: '" << s << "' is not a valid number\n";
+    return false;
+  }
+  value = Q(v);
+  return true;
+}
+
+/**\brief Select model
+ *
+ * Makes sure that the given state object uses a model with the given
+ * parameters. A new model is only created if the current one doesn't match,
+ * or if a rebuild is forced - e.g. because the model parameters changed.
  *
  * \tparam Q   Base data type as used in the topologic::state instance
  * \tparam dim Maximum render depth of the topologic::state instance
  *
- * \param[out] topologicState The topologic::state instance to populate
- * \param[in]  args           Command line argument vector.
- * \param[in]  readFiles      Try to treat unrecognised options as files.
+ * \param[out] topologicState The topologic::state instance to update.
+ * \param[in]  format         The vector coordinate format to use.
+ * \param[in]  model          The model type, e.g. "cube".
+ * \param[in]  depth          The model depth.
+ * \param[in]  rdepth         The render depth.
+ * \param[in]  force          Create a new model even if the current one
+ *                            has matching parameters.
  *
- * \returns The output mode set in the argument vector. Defaults to outNone.
+ * \returns 'true' if the state object has a model when the function returns.
  */
 template <typename Q, std::size_t dim>
-enum outputMode parse(state<Q, dim> &topologicState,
-                      const std::vector<std::string> &args,
-                      bool readFiles = true) {
-  enum outputMode out = outNone;
+static bool setModel(state<Q, dim> &topologicState, const std::string &format,
+                     const std::string &model, const std::size_t &depth,
+                     const std::size_t &rdepth, bool force = false) {
+  if (force || !topologicState.model ||
+      !((format == topologicState.model->formatID) &&
+        (model == topologicState.model->id) &&
+        (depth == topologicState.model->depth) &&
+        (rdepth == topologicState.model->renderDepth))) {
+    return registry<Q, dim>::common().create(topologicState, format, model,
+                                             depth, rdepth);
+  }
 
-#if !defined(NOLIBRARIES)
-  topologic::xml XML;
-#endif
-  std::size_t depth = 4, rdepth = 4;
-  std::string model = "cube";
-  std::string format = "cartesian";
+  return true;
+}
 
-  efgy::cli::option oversion("-{0,2}version", [](std::smatch &)->bool {
-    std::cout << "Topologic/V" << version << "\n"
-                                             "libefgy/V" << efgy::version
-              << "\n"
-                 "Maximum render depth of this binary is " << dim
+/**\brief Command line options
+ *
+ * Holds the options that topologic::parse() recognises. libefgy compiles an
+ * option's regular expression when the option is created, so instead of
+ * creating the options anew for every argument vector, there is a single
+ * instance of this class per state type. Its handlers act on whichever
+ * settings apply() is currently running with.
+ *
+ * \tparam Q   Base data type as used in the topologic::state instance
+ * \tparam dim Maximum render depth of the topologic::state instance
+ */
+template <typename Q, std::size_t dim> class commandLine {
+public:
+  /**\brief Option targets
+   *
+   * The values that the options update while parsing a single argument
+   * vector.
+   */
+  class settings {
+  public:
+    state<Q, dim> &topologicState;
+    enum outputMode &out;
+    std::string &format;
+    std::string &model;
+    std::size_t &depth;
+    std::size_t &rdepth;
+
+    /**\brief Were all values valid?
+     *
+     * Cleared by options whose values couldn't be parsed or are out of
+     * range; the option is still consumed, so that it isn't mistaken for a
+     * file name.
+     */
+    bool valid;
+  };
+
+  /**\brief Apply options
+   *
+   * Runs libefgy's option parser over the given arguments, with the options
+   * in this class acting on the given settings. The options are created the
+   * first time this is called. Callers must hold parserLock().
+   *
+   * \param[out] s    The values to update.
+   * \param[in]  args Command line argument vector.
+   */
+  static void apply(settings &s, const std::vector<std::string> &args) {
+    static const commandLine options;
+    current() = &s;
+    efgy::cli::options<>::common().apply(args);
+    current() = 0;
+  }
+
+protected:
+  /**\brief Option handler
+   *
+   * The function type of the handlers in this class.
+   */
+  typedef bool (*handler)(settings &, std::smatch &);
+
+  /**\brief Current settings
+   *
+   * \returns A reference to the settings that the handlers update, or 0 when
+   *          no apply() call is running.
+   */
+  static settings *&current(void) {
+    static settings *s = 0;
+    return s;
+  }
+
+  /**\brief Bind handler to current settings
+   *
+   * Matches outside of apply() are ignored, as there is nothing to update.
+   *
+   * \param[in] h The handler to bind.
+   *
+   * \returns A libefgy option handler that passes the current settings to h.
+   */
+  static std::function<bool(std::smatch &)> bind(handler h) {
+    return [h](std::smatch & m)->bool {
+      settings *s = current();
+      return (s != 0) && h(*s, m);
+    };
+  }
+
+  /**\brief Create options
+   *
+   * Registers all of the options with libefgy's common option list.
+   */
+  commandLine(void)
+      : oversion("-{0,2}version", bind(version), "Print version information."),
+        omodel("-{0,2}m(odel)?:([0-9]+)-([a-z-]+)(@([0-9]+))?(:([a-z]+))?",
+               bind(model),
+               "Sets all the model type parameters. The form is: "
+               "D-MODEL[@R][:FORMAT], e.g. 3-cube@4:polar. The default is "
+               "4-cube@4:cartesian."),
+        oformat("-{0,2}(none|json|svg|arguments|binary(:raw)?|png)",
+                bind(format), "Select an output format."),
+        oifs("-{0,2}r(andom)?:([0-9]+)(:([0-9]+))?(:([0-9]+))?(:pre)?(:post)?",
+             bind(ifs),
+             "Set parameters for randomised models. The order of the "
+             "arguments is: seed[:functions][:variants][:pre][:post]. Only "
+             "the seed is required to be set."),
+        ocolour("-{0,2}colour(:fractal-flame|"
+                "(:b:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
+                "(:w:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
+                "(:s:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?)",
+                bind(colour), "Set the colour scheme to use."),
+        oradius("-{0,2}(R|radius):([0-9.]+)(:([0-9.]+))?", bind(radius),
+                "Set the radii used in some formulas."),
+        oparam("-{0,2}(p|precision|c|constant):([0-9.]+)", bind(parameter),
+               "Set the precision, or the constant factor for some formulae."),
+        oiterations("-{0,2}(i|iterations):([0-9]+)", bind(iterations),
+                    "Set the number of iterations for iterative formulae."),
+        ofrom("-{0,2}f(rom)?((:[0-9.]+){2,})(:polar)?", bind(from),
+              "Set a from point of the transformation. Which of the from "
+              "points is set depends on the number of coordinates given. The "
+              "polar suffix treats the input as polar coordinates."),
+        otransform("-{0,2}t(ransform)?((:[0-9.]+){2,})", bind(transform),
+                   "Set a tranformation matrix. Which of the matrices is set "
+                   "depends on the number of coordinates given."),
+        odigits("-{0,2}digits:([0-9]+|shortest)", bind(digits),
+                "Write SVGs with the buffered writer, using the given number "
+                "of digits after the decimal point, or the shortest "
+                "round-trip representation."),
+        ocompact("-{0,2}compact", bind(compact),
+                 "Write compact SVGs: drop faces outside of the picture and "
+                 "duplicate faces, and merge the others into one path."),
+        ocompress("-{0,2}compress[:=](none|gzip|zstd)", bind(compression),
+                  "Compress output with gzip or zstd while it is being "
+                  "written."),
+        ocache("-{0,2}cache:(.+)", bind(outputCache),
+               "Keep rendered output in the given directory, and reuse it "
+               "when the same output is requested again."),
+        osize("-{0,2}size:([0-9]+)x([0-9]+)", bind(size),
+              "Set the size of PNG images, in pixels; e.g. 1024x768."),
+        olod("-{0,2}lod:([0-9.]+)", bind(lod),
+             "Pick the precision of parametric models from their size on "
+             "screen, so that each step is about this many pixels long; 0 "
+             "turns this off.") {}
+
+  commandLine(const commandLine &) = delete;
+
+  static bool version(settings &, std::smatch &) {
+    std::cout << "Topologic/V" << topologic::version << "\n"
+              << "libefgy/V" << efgy::version << "\n"
+              << "Maximum render depth of this binary is " << dim
               << " dimensions.\n"
-                 "Supported models:";
-    std::set<const char *> models;
-    for (const char *m :
-         efgy::geometry::with<Q, efgy::geometry::functor::models, dim>(
-             models, "*", 0, 0)) {
+              << "Supported models:";
+    for (const std::string &m : registry<Q, dim>::common().models()) {
       std::cout << " " << m;
     }
     std::cout << "\n"
                  "Supported vector coordinate formats:";
-    std::set<const char *> formats;
-    for (const char *f :
-         efgy::geometry::with<Q, efgy::geometry::functor::formats, dim>(
-             formats, "*", "*", 0, 0)) {
+    for (const std::string &f : registry<Q, dim>::common().formats()) {
       std::cout << " " << f;
     }
     std::cout << "\n";
     return true;
-  },
-                             "Print version information.");
-
-  efgy::cli::option omodel(
-      "-{0,2}m(odel)?:([0-9]+)-([a-z-]+)(@([0-9]+))?(:([a-z]+))?",
-      [&depth, &rdepth, &model, &format](std::smatch & m)->bool {
-    depth = std::stoi(m[2]);
-    model = m[3];
-    if (m[5] != "") {
-      rdepth = std::stoi(m[5]);
+  }
+
+  /**\brief Flag invalid value
+   *
+   * \param[out] s The settings to mark as invalid.
+   *
+   * \returns 'true', so that the option counts as consumed.
+   */
+  static bool invalid(settings &s) {
+    s.valid = false;
+    return true;
+  }
+
+  /**\brief Parse colour
+   *
+   * \param[in]  m The match with the colour's components.
+   * \param[in]  i The index of the red component in 'm'.
+   * \param[out] c The colour to set.
+   *
+   * \returns 'true' if all of the components are valid numbers.
+   */
+  static bool rgba(const std::smatch &m, const std::size_t &i,
+                   efgy::math::vector<Q, 4, efgy::math::format::RGB> &c) {
+    return real(m[i].str(), c.red) && real(m[i + 1].str(), c.green) &&
+           real(m[i + 2].str(), c.blue) && real(m[i + 3].str(), c.alpha);
+  }
+
+  /**\brief Parse coordinates
+   *
+   * \param[in]  list Colon-separated numbers, with a leading colon.
+   * \param[out] v    Receives the numbers.
+   *
+   * \returns 'true' if all of the numbers are valid.
+   */
+  static bool coordinates(const std::string &list, std::vector<Q> &v) {
+    std::istringstream is(list);
+    std::string coord;
+
+    while (std::getline(is, coord, ':')) {
+      if (coord != "") {
+        Q c;
+        if (!real(coord, c)) {
+          return false;
+        }
+        v.push_back(c);
+      }
     }
+
+    return true;
+  }
+
+  static bool model(settings &s, std::smatch &m) {
+    if (!number(m[2].str(), std::size_t(1), dim, s.depth) ||
+        ((m[5] != "") && !number(m[5].str(), std::size_t(1), dim, s.rdepth))) {
+      return invalid(s);
+    }
+    s.model = m[3];
     if (m[7] != "") {
-      format = m[7];
+      s.format = m[7];
     }
     return true;
-  },
-      "Sets all the model type parameters. The form is: D-MODEL[@R][:FORMAT], "
-      "e.g. 3-cube@4:polar. The default is 4-cube@4:cartesian.");
+  }
 
-  efgy::cli::option oformat("-{0,2}(none|json|svg|arguments)",
-                            [&out](std::smatch & m)->bool {
+  static bool format(settings &s, std::smatch &m) {
     if (m[1] == "json") {
-      out = topologic::outJSON;
+      s.out = topologic::outJSON;
     } else if (m[1] == "svg") {
-      out = topologic::outSVG;
+      s.out = topologic::outSVG;
     } else if (m[1] == "arguments") {
-      out = topologic::outArguments;
+      s.out = topologic::outArguments;
+    } else if (m[1] == "binary") {
+      s.out = topologic::outBinary;
+    } else if (m[1] == "binary:raw") {
+      s.out = topologic::outBinaryRaw;
+    } else if (m[1] == "png") {
+      s.out = topologic::outPNG;
     } else {
-      out = topologic::outNone;
+      s.out = topologic::outNone;
     }
     return true;
-  },
-                            "Select an output format.");
-
-  efgy::cli::option oifs(
-      "-{0,2}r(andom)?:([0-9]+)(:([0-9]+))?(:([0-9]+))?(:pre)?(:post)?",
-      [&topologicState](std::smatch & m)->bool {
-    topologicState.state<Q, 2>::parameter.seed = Q(std::stold(m[2]));
-    if (m[4] != "") {
-      topologicState.state<Q, 2>::parameter.functions = Q(std::stold(m[4]));
-    }
-    if (m[6] != "") {
-      topologicState.state<Q, 2>::parameter.flameCoefficients =
-          Q(std::stold(m[6]));
+  }
+
+  static bool ifs(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    const unsigned int most = std::numeric_limits<unsigned int>::max();
+    if (!number(m[2].str(), 0u, most, st.parameter.seed) ||
+        ((m[4] != "") &&
+         !number(m[4].str(), 0u, most, st.parameter.functions)) ||
+        ((m[6] != "") &&
+         !number(m[6].str(), 0u, most, st.parameter.flameCoefficients))) {
+      return invalid(s);
     }
-    topologicState.state<Q, 2>::parameter.preRotate = (m[7] == ":pre");
-    topologicState.state<Q, 2>::parameter.postRotate = (m[8] == ":post");
+    st.parameter.preRotate = (m[7] == ":pre");
+    st.parameter.postRotate = (m[8] == ":post");
     return true;
-  },
-      "Set parameters for randomised models. The order of the arguments is: "
-      "seed[:functions][:variants][:pre][:post]. Only the seed is required to "
-      "be set.");
-
-  efgy::cli::option ocolour("-{0,2}colour(:fractal-flame|"
-                            "(:b:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
-                            "(:w:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
-                            "(:s:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?)",
-                            [&topologicState](std::smatch & m)->bool {
-    topologicState.state<Q, 2>::fractalFlameColouring =
-        (m[1] == ":fractal-flame");
-    if (m[2] != "") {
-      topologicState.state<Q, 2>::background.red = Q(std::stold(m[3]));
-      topologicState.state<Q, 2>::background.green = Q(std::stold(m[4]));
-      topologicState.state<Q, 2>::background.blue = Q(std::stold(m[5]));
-      topologicState.state<Q, 2>::background.alpha = Q(std::stold(m[6]));
-    }
-    if (m[7] != "") {
-      topologicState.state<Q, 2>::wireframe.red = Q(std::stold(m[8]));
-      topologicState.state<Q, 2>::wireframe.green = Q(std::stold(m[9]));
-      topologicState.state<Q, 2>::wireframe.blue = Q(std::stold(m[10]));
-      topologicState.state<Q, 2>::wireframe.alpha = Q(std::stold(m[11]));
-    }
-    if (m[12] != "") {
-      topologicState.state<Q, 2>::surface.red = Q(std::stold(m[13]));
-      topologicState.state<Q, 2>::surface.green = Q(std::stold(m[14]));
-      topologicState.state<Q, 2>::surface.blue = Q(std::stold(m[15]));
-      topologicState.state<Q, 2>::surface.alpha = Q(std::stold(m[16]));
+  }
+
+  static bool colour(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    st.fractalFlameColouring = (m[1] == ":fractal-flame");
+    if (((m[2] != "") && !rgba(m, 3, st.background)) ||
+        ((m[7] != "") && !rgba(m, 8, st.wireframe)) ||
+        ((m[12] != "") && !rgba(m, 13, st.surface))) {
+      return invalid(s);
     }
     return true;
-  },
-                            "Set the colour scheme to use.");
-
-  efgy::cli::option oradius("-{0,2}(R|radius):([0-9.]+)(:([0-9.]+))?",
-                            [&topologicState](std::smatch & m)->bool {
-    topologicState.state<Q, 2>::parameter.radius = Q(std::stold(m[2]));
-    if (m[4] != "") {
-      topologicState.state<Q, 2>::parameter.radius2 = Q(std::stold(m[4]));
+  }
+
+  static bool radius(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    if (!real(m[2].str(), st.parameter.radius) ||
+        ((m[4] != "") && !real(m[4].str(), st.parameter.radius2))) {
+      return invalid(s);
     }
     return true;
-  },
-                            "Set the radii used in some formulas.");
-
-  efgy::cli::option oparam(
-      "-{0,2}(p|precision|c|constant):([0-9.]+)",
-      [&topologicState](std::smatch & m)->bool {
-    if ((m[1] == "precision") || (m[1] == "p")) {
-      topologicState.state<Q, 2>::parameter.precision = Q(std::stold(m[2]));
-    } else if ((m[1] == "constant") || (m[1] == "c")) {
-      topologicState.state<Q, 2>::parameter.constant = Q(std::stold(m[2]));
+  }
+
+  static bool parameter(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    Q &target = ((m[1] == "precision") || (m[1] == "p"))
+                    ? st.parameter.precision
+                    : st.parameter.constant;
+    if (!real(m[2].str(), target)) {
+      return invalid(s);
     }
     return true;
-  },
-      "Set the precision, or the constant factor for some formulae.");
+  }
 
-  efgy::cli::option oiterations(
-      "-{0,2}(i|iterations):([0-9]+)",
-      [&topologicState](std::smatch & m)->bool {
-    topologicState.state<Q, 2>::parameter.iterations = Q(std::stoll(m[2]));
+  static bool iterations(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    if (!number(m[2].str(), 0u, std::numeric_limits<unsigned int>::max(),
+                st.parameter.iterations)) {
+      return invalid(s);
+    }
     return true;
-  },
-      "Set the number of iterations for iterative formulae.");
-
-  efgy::cli::option ofrom(
-      "-{0,2}f(rom)?((:[0-9.]+){2,})(:polar)?",
-      [&topologicState](std::smatch & m)->bool {
-    topologicState.state<Q, 2>::polarCoordinates = (m[4] == ":polar");
-    std::istringstream s(m[2]);
-    std::string coord;
+  }
+
+  static bool from(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
     std::vector<Q> v;
+    if (!coordinates(m[2], v)) {
+      return invalid(s);
+    }
 
-    while (std::getline(s, coord, ':')) {
-      if (coord != "") {
-        v.push_back(Q(std::stold(coord)));
-      }
+    if (st.polarCoordinates != (m[4] == ":polar")) {
+      st.polarCoordinates = (m[4] == ":polar");
+      s.topologicState.invalidateMatrix();
     }
 
     for (std::size_t i = 0; i < v.size(); i++) {
-      topologicState.setFromCoordinate(i, v[i], v.size());
+      s.topologicState.setFromCoordinate(i, v[i], v.size());
     }
 
     return true;
-  },
-      "Set a from point of the transformation. Which of the from points is set "
-      "depends on the number of coordinates given. The polar suffix treats the "
-      "input as polar coordinates.");
-
-  efgy::cli::option otransform(
-      "-{0,2}t(ransform)?((:[0-9.]+){2,})",
-      [&topologicState](std::smatch & m)->bool {
-    std::istringstream s(m[2]);
-    std::string coord;
-    std::vector<Q> v;
+  }
 
-    while (std::getline(s, coord, ':')) {
-      if (coord != "") {
-        v.push_back(Q(std::stold(coord)));
-      }
+  static bool transform(settings &s, std::smatch &m) {
+    std::vector<Q> v;
+    if (!coordinates(m[2], v)) {
+      return invalid(s);
     }
 
     const std::size_t d = std::sqrt(v.size());
@@ -242,37 +468,198 @@ enum outputMode parse(state<Q, dim> &topologicState,
 
     for (std::size_t i = 0, x = 0; x < d; x++) {
       for (std::size_t y = 0; y < d; y++) {
-        setMatrixCell(topologicState, d - 1, x, y, v[i]);
+        setMatrixCell(s.topologicState, d - 1, x, y, v[i]);
         i++;
       }
     }
 
     return true;
-  },
-      "Set a tranformation matrix. Which of the matrices is set depends on the "
-      "number of coordinates given.");
-
-  efgy::cli::options<>::common().apply(args);
-
-  if (readFiles) {
-    for (const auto &f : efgy::cli::options<>::common().remainder) {
-      std::ifstream in(f);
-      std::istreambuf_iterator<char> eos;
-      std::string s(std::istreambuf_iterator<char>(in), eos);
-
-#if !defined(NOLIBRARIES)
-      xml::parser p(s, f);
-      if (p.valid) {
-        parse(topologicState, p);
-        parseModel<Q, dim, updateModel>(topologicState, p);
-      } else
-#endif
-          {
-        efgy::json::value<> v;
-        s >> v;
-        parse(topologicState, v);
-        parseModel<Q, dim, updateModel>(topologicState, v);
+  }
+
+  static bool digits(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    // doubles only have 17 significant digits, so more would only be noise.
+    if (m[1] == "shortest") {
+      st.digits = 0;
+    } else if (!number(m[1].str(), 0, 17, st.digits)) {
+      return invalid(s);
+    }
+    return true;
+  }
+
+  static bool compact(settings &s, std::smatch &) {
+    state<Q, 2> &st = s.topologicState;
+    st.compact = true;
+    return true;
+  }
+
+  static bool compression(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    st.compression = compress::byName(m[1]);
+    return true;
+  }
+
+  static bool outputCache(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    st.outputCache = m[1];
+    return true;
+  }
+
+  static bool size(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    // the rasteriser keeps 16 bytes per pixel, so this caps images at 256MiB.
+    const std::size_t side = 8192, pixels = std::size_t(1) << 24;
+    std::size_t w, h;
+    if (!number(m[1].str(), std::size_t(1), side, w) ||
+        !number(m[2].str(), std::size_t(1), side, h)) {
+      return invalid(s);
+    }
+    if (w * h > pixels) {
+      std::cerr << "error: images may have at most " << pixels << " pixels\n";
+      return invalid(s);
+    }
+    st.imageWidth = w;
+    st.imageHeight = h;
+    return true;
+  }
+
+  static bool lod(settings &s, std::smatch &m) {
+    state<Q, 2> &st = s.topologicState;
+    if (!real(m[1].str(), st.detail)) {
+      return invalid(s);
+    }
+    return true;
+  }
+
+  efgy::cli::option oversion;
+  efgy::cli::option omodel;
+  efgy::cli::option oformat;
+  efgy::cli::option oifs;
+  efgy::cli::option ocolour;
+  efgy::cli::option oradius;
+  efgy::cli::option oparam;
+  efgy::cli::option oiterations;
+  efgy::cli::option ofrom;
+  efgy::cli::option otransform;
+  efgy::cli::option odigits;
+  efgy::cli::option ocompact;
+  efgy::cli::option ocompress;
+  efgy::cli::option ocache;
+  efgy::cli::option osize;
+  efgy::cli::option olod;
+};
+
+/**\brief Parse command line options
+ *
+ * Applies the settings in a command line argument vector to a
+ * topologic::state instance, without reading any of the files named in it;
+ * topologic::parse() takes care of those.
+ *
+ * libefgy's options are registered globally, so this holds parserLock()
+ * while it runs; the arguments that none of the options matched are copied
+ * to 'files' before the lock is released.
+ *
+ * \tparam Q   Base data type as used in the topologic::state instance
+ * \tparam dim Maximum render depth of the topologic::state instance
+ *
+ * \param[out] topologicState The topologic::state instance to populate
+ * \param[in]  args           Command line argument vector.
+ * \param[out] files          Receives the arguments that weren't options.
+ * \param[out] format         Set to the model's vector coordinate format.
+ * \param[out] model          Set to the model type.
+ * \param[out] depth          Set to the model depth.
+ * \param[out] rdepth         Set to the render depth.
+ * \param[out] valid          Set to 'false' if any of the options had an
+ *                            invalid value, if not 0.
+ *
+ * \returns The output mode set in the argument vector. Defaults to outNone.
+ */
+template <typename Q, std::size_t dim>
+static enum outputMode
+parseOptions(state<Q, dim> &topologicState,
+             const std::vector<std::string> &args,
+             std::vector<std::string> &files, std::string &format,
+             std::string &model, std::size_t &depth, std::size_t &rdepth,
+             bool *valid = 0) {
+  std::lock_guard<std::mutex> lock(parserLock());
+  enum outputMode out = outNone;
+
+  typename commandLine<Q, dim>::settings s = {
+      topologicState, out, format, model, depth, rdepth, true};
+
+  {
+    stats::scope timer(stats::tOptions);
+    commandLine<Q, dim>::apply(s, args);
+  }
+
+  files = efgy::cli::options<>::common().remainder;
+
+  if (valid && !s.valid) {
+    *valid = false;
+  }
+
+  return out;
+}
+
+/**\brief Parse command line arguments
+ *
+ * A function template to parse C-style command line arguments, apply the
+ * settings in those arguments to a topologic::state instance. This
+ * function will also parse XML files that have been passed in as command
+ * line arguments and set the model in the state object to match that
+ * specified as command line arguments or in XML files.
+ *
+ * As usual, later options override earlier ones - that also applies to
+ * settings in XML files. If the NOLIBRARIES macro is set then XML files
+ * will not be processed.
+ *
+ * Files are memory-mapped and only parsed once, as whatever format their
+ * first byte suggests. When there are several of them, they are loaded and
+ * parsed in parallel - using the state's 'threads' setting - and then
+ * applied in order.
+ *
+ * This function may be called from several threads, as long as each of them
+ * uses its own state object; only the option parsing is serialised with
+ * parserLock(), so files are still loaded concurrently.
+ *
+ * \tparam Q   Base data type as used in the topologic::state instance
+ * \tparam dim Maximum render depth of the topologic::state instance
+ *
+ * \param[out] topologicState The topologic::state instance to populate
+ * \param[in]  args           Command line argument vector.
+ * \param[in]  readFiles      Try to treat unrecognised options as files;
+ *                            if 'false', they count as invalid instead.
+ * \param[out] valid          Set to 'false' if any of the options had an
+ *                            invalid value, if not 0. Invalid options are
+ *                            reported and otherwise ignored.
+ *
+ * \returns The output mode set in the argument vector. Defaults to outNone.
+ */
+template <typename Q, std::size_t dim>
+enum outputMode parse(state<Q, dim> &topologicState,
+                      const std::vector<std::string> &args,
+                      bool readFiles = true, bool *valid = 0) {
+  std::size_t depth = 4, rdepth = 4;
+  std::string model = "cube";
+  std::string format = "cartesian";
+  std::vector<std::string> files;
+
+  enum outputMode out = parseOptions(topologicState, args, files, format,
+                                     model, depth, rdepth, valid);
+
+  if (!readFiles) {
+    for (const std::string &f : files) {
+      std::cerr << "error: unknown option '" << f << "'\n";
+      if (valid) {
+        *valid = false;
       }
+    }
+  } else if (!files.empty()) {
+    std::vector<std::unique_ptr<input::document>> documents;
+    input::load(documents, files, topologicState.threads);
+
+    for (auto &doc : documents) {
+      input::apply(topologicState, *doc);
 
       if (topologicState.model) {
         format = topologicState.model->formatID;
@@ -283,14 +670,7 @@ enum outputMode parse(state<Q, dim> &topologicState,
     }
   }
 
-  if (!topologicState.model ||
-      !((format == topologicState.model->formatID) &&
-        (model == topologicState.model->id) &&
-        (depth == topologicState.model->depth) &&
-        (rdepth == topologicState.model->renderDepth))) {
-    efgy::geometry::with<Q, updateModel, dim>(topologicState, format, model,
-                                              depth, rdepth);
-  }
+  setModel(topologicState, format, model, depth, rdepth);
 
   return out;
 }
@@ -0,0 +1,526 @@
+/**\file
+ * \brief Batch rendering
+ *
+ * Contains the batch mode of the CLI frontend, which renders a whole manifest
+ * of jobs in a single process. Process startup, option setup and - where the
+ * model doesn't change between jobs - model creation are only paid once for
+ * the whole manifest instead of once per render.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_BATCH_H)
+#define TOPOLOGIC_BATCH_H
+
+#include <topologic/arguments.h>
+#include <topologic/store.h>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace topologic {
+/**\brief Batch rendering
+ *
+ * Contains the classes and functions used to process batch manifests, i.e.
+ * lists of render jobs that are processed with a single state object.
+ */
+namespace batch {
+/**\brief File name extension for output mode
+ *
+ * Used to name output files of jobs that do not specify a file name
+ * explicitly.
+ *
+ * \param[in] out The output mode of the job.
+ *
+ * \returns A file name extension, including the leading dot.
+ */
+static inline const char *extension(const enum outputMode &out) {
+  switch (out) {
+  case outJSON:
+    return ".json";
+  case outArguments:
+    return ".txt";
+  case outBinary:
+  case outBinaryRaw:
+    return ".mesh";
+  case outPNG:
+    return ".png";
+  default:
+    return ".svg";
+  }
+}
+
+/**\brief File name extension for compressed output
+ *
+ * Appends the compression method's extension to that of the output mode,
+ * except for gzip-compressed SVGs, which are named '.svgz'.
+ *
+ * \param[in] out         The output mode of the job.
+ * \param[in] compression The compression method used for the job.
+ *
+ * \returns A file name extension, including the leading dot.
+ */
+static inline std::string extension(const enum outputMode &out,
+                                    const compress::method &compression) {
+  const std::string e = extension(out);
+
+  switch (compression) {
+  case compress::mGzip:
+    return e == ".svg" ? ".svgz" : e + ".gz";
+  case compress::mZstd:
+    return e + ".zst";
+  default:
+    return e;
+  }
+}
+
+/**\brief Batch job
+ *
+ * A single job in a batch manifest: either a list of command line arguments
+ * or a JSON state object, and the file that the output should be written to.
+ */
+class job {
+public:
+  /**\brief Command line arguments
+   *
+   * The arguments for this job, not including the programme name. Empty for
+   * jobs that have been specified as a JSON state object.
+   */
+  std::vector<std::string> args;
+
+  /**\brief JSON state object
+   *
+   * Points to the JSON object in the manifest that describes this job, or 0
+   * if the job was specified as a list of arguments.
+   */
+  efgy::json::value<> *json;
+
+  /**\brief Output file
+   *
+   * Name of the file that the job's output is written to.
+   */
+  std::string output;
+};
+
+/**\brief Batch manifest
+ *
+ * Parses a batch manifest. Manifests are either a JSON array of state
+ * objects, as produced by the JSON output mode, or a text file with one set of
+ * command line arguments per line. Empty lines and lines starting with a '#'
+ * are ignored.
+ *
+ * A line's output file is set with an 'output:FILE' argument, and a JSON
+ * object's output file is set with an "output" string. Jobs without an
+ * explicit output file write to the manifest's name with the job index and a
+ * suitable extension appended, e.g. 'manifest.txt.3.svg'.
+ */
+class manifest {
+public:
+  /**\brief Construct with manifest data
+   *
+   * Parses the given manifest and populates the job list.
+   *
+   * \param[in] data     The contents of the manifest.
+   * \param[in] filename The name of the manifest; used to name output files.
+   */
+  manifest(const std::string &data, const std::string &filename)
+      : name(filename), valid(false) {
+    std::size_t start = data.find_first_not_of(" \t\r\n");
+
+    if (start == std::string::npos) {
+      std::cerr << "empty batch manifest " << filename << "\n";
+      return;
+    }
+
+    if (data[start] == '[') {
+      std::string s = data;
+      s >> value;
+      if (!value.isArray()) {
+        std::cerr << "failed to parse batch manifest " << filename << "\n";
+        return;
+      }
+
+      for (efgy::json::value<> &v : value.toArray()) {
+        if (v.type != efgy::json::value<>::object) {
+          continue;
+        }
+        job j;
+        j.json = &v;
+        if (v("output").isString()) {
+          j.output = v("output").asString();
+        }
+        jobs.push_back(j);
+      }
+    } else {
+      std::istringstream in(data);
+      std::string line;
+
+      while (std::getline(in, line)) {
+        std::istringstream l(line);
+        std::string arg;
+        job j;
+        j.json = 0;
+
+        while (l >> arg) {
+          if (j.args.empty() && arg[0] == '#') {
+            break;
+          } else if (arg.compare(0, 7, "output:") == 0) {
+            j.output = arg.substr(7);
+          } else {
+            j.args.push_back(arg);
+          }
+        }
+
+        if (!j.args.empty()) {
+          jobs.push_back(j);
+        }
+      }
+    }
+
+    valid = true;
+  }
+
+  /**\brief Copy constructor
+   *
+   * Jobs point into the parsed JSON manifest, so copying is not allowed.
+   */
+  manifest(const manifest &) = delete;
+
+  /**\brief Output file for job
+   *
+   * Returns the output file of the given job, or a file name derived from
+   * the manifest's name if the job doesn't specify one.
+   *
+   * \param[in] i           Index of the job.
+   * \param[in] out         The output mode used for the job.
+   * \param[in] compression The compression method used for the job.
+   *
+   * \returns The file to write the job's output to.
+   */
+  std::string output(const std::size_t &i, const enum outputMode &out,
+                     const compress::method &compression =
+                         compress::mNone) const {
+    if (jobs[i].output != "") {
+      return jobs[i].output;
+    }
+    std::ostringstream s("");
+    s << name << "." << i << extension(out, compression);
+    return s.str();
+  }
+
+  /**\brief Manifest name
+   *
+   * The file name that the manifest was read from.
+   */
+  const std::string name;
+
+  /**\brief Job list
+   *
+   * All of the jobs in the manifest, in the order they were specified in.
+   */
+  std::vector<job> jobs;
+
+  /**\brief Was the manifest parsed successfully?
+   *
+   * Set by the constructor.
+   */
+  bool valid;
+
+protected:
+  /**\brief Parsed JSON manifest
+   *
+   * Holds the JSON array for JSON manifests; the job list points into this
+   * value.
+   */
+  efgy::json::value<> value;
+};
+
+/**\brief Read model depth
+ *
+ * Reads a model or render depth from a JSON job, if it has one; depths have
+ * to be between 1 and the state object's maximum render depth.
+ *
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[in]  v     The JSON value to read; ignored unless it is a number.
+ * \param[out] value Set to the depth if 'v' is a valid one.
+ *
+ * \returns 'false' if 'v' is a number but not a valid depth.
+ */
+template <std::size_t d>
+static bool depth(efgy::json::value<> &v, std::size_t &value) {
+  if (!v.isNumber()) {
+    return true;
+  }
+  const long double n = v.asNumber();
+  if (!(n >= 1) || !(n <= d)) {
+    std::cerr << "error: " << n << " is not a depth between 1 and " << d
+              << "\n";
+    return false;
+  }
+  value = std::size_t(n);
+  return true;
+}
+
+/**\brief Apply single batch job
+ *
+ * Sets the state object up with the prototype's settings, and then applies
+ * the job's settings on top of those, so every job starts from the command
+ * line's settings, no matter which jobs the state object rendered before.
+ * Only the state's own 'threads' setting is kept, since it depends on how
+ * the jobs are spread over workers. The state's
+ * model is only recreated if the job uses a different model type or
+ * different geometry parameters than the previous one.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[out]    topologicState The state object to render with.
+ * \param[in]     prototype      The state object set up from the command
+ *                               line.
+ * \param[in]     m              The manifest containing the job.
+ * \param[in]     i              Index of the job to apply.
+ * \param[in]     programme      The programme name; passed along as the
+ *                               first argument, like for regular command
+ *                               lines.
+ * \param[in,out] out            Output mode for jobs that don't select one;
+ *                               set to the job's output mode if it selects
+ *                               one.
+ * \param[in]     readFiles      Whether arguments that aren't options name
+ *                               input files; if 'false', they make the job
+ *                               invalid.
+ *
+ * \returns 'true' if all of the job's settings were valid and the state
+ *          object has a model to render.
+ */
+template <typename Q, std::size_t d>
+static bool apply(state<Q, d> &topologicState, const state<Q, d> &prototype,
+                  const manifest &m, const std::size_t &i,
+                  const std::string &programme, enum outputMode &out,
+                  bool readFiles = true) {
+  const job &j = m.jobs[i];
+  const render::parameters<Q> before(topologicState.parameter);
+  std::string format = "cartesian", model = "cube";
+  std::size_t depth = 4, rdepth = 4;
+
+  if (topologicState.model) {
+    format = topologicState.model->formatID;
+    model = topologicState.model->id;
+    depth = topologicState.model->depth;
+    rdepth = topologicState.model->renderDepth;
+  }
+
+  const std::size_t threads = topologicState.threads;
+  topologicState.assign(prototype);
+  topologicState.threads = threads;
+
+  if (j.json) {
+    efgy::json::value<> &v = *j.json;
+    parse(topologicState, v);
+
+    // same defaults as for command lines, so that a job renders the same
+    // model no matter which job the state object rendered before.
+    format = "cartesian";
+    model = "cube";
+    depth = 4;
+    rdepth = 4;
+
+    if (v("coordinateFormat").isString()) {
+      format = v("coordinateFormat").asString();
+    }
+    if (v("model").isString()) {
+      model = v("model").asString();
+    }
+    if (!batch::depth<d>(v("depth"), depth) ||
+        !batch::depth<d>(v("renderDepth"), rdepth)) {
+      std::cerr << "error: invalid settings for job " << i << "\n";
+      return false;
+    }
+
+    setModel(topologicState, format, model, depth, rdepth,
+             render::parameters<Q>(topologicState.parameter) != before);
+  } else {
+    std::vector<std::string> args;
+    args.push_back(programme);
+    args.insert(args.end(), j.args.begin(), j.args.end());
+
+    bool valid = true;
+    enum outputMode o = parse(topologicState, args, readFiles, &valid);
+    if (!valid) {
+      std::cerr << "error: invalid settings for job " << i << "\n";
+      return false;
+    }
+    if (o != outNone) {
+      out = o;
+    }
+
+    if (topologicState.model &&
+        (render::parameters<Q>(topologicState.parameter) != before) &&
+        (format == topologicState.model->formatID) &&
+        (model == topologicState.model->id) &&
+        (depth == topologicState.model->depth) &&
+        (rdepth == topologicState.model->renderDepth)) {
+      setModel(topologicState, format, model, depth, rdepth, true);
+    }
+  }
+
+  if (!topologicState.model) {
+    std::cerr << "error: no model to render for job " << i << "\n";
+    return false;
+  }
+
+  return true;
+}
+
+/**\brief Run single batch job
+ *
+ * Applies the job's settings with apply() and writes the result to the
+ * job's output file, through the render cache if one is set; see
+ * store::write(). Output is compressed with the state's 'compression'
+ * setting, or - if that is compress::mNone - with whatever the output file's
+ * name suggests; see compress::byFile().
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[out] topologicState The state object to render with.
+ * \param[in]  prototype      The state object set up from the command line.
+ * \param[in]  m              The manifest containing the job.
+ * \param[in]  i              Index of the job to run.
+ * \param[in]  programme      The programme name; passed along as the first
+ *                            argument, like for regular command lines.
+ * \param[in]  out            Output mode for jobs that don't select one.
+ *
+ * \returns 'true' if the job's output was written successfully.
+ */
+template <typename Q, std::size_t d>
+static bool run(state<Q, d> &topologicState, const state<Q, d> &prototype,
+                const manifest &m, const std::size_t &i,
+                const std::string &programme, enum outputMode out) {
+  if (!apply(topologicState, prototype, m, i, programme, out)) {
+    return false;
+  }
+
+  const std::string file = m.output(i, out, topologicState.compression);
+  const compress::method compression =
+      topologicState.compression != compress::mNone ? topologicState.compression
+                                                    : compress::byFile(file);
+  std::ofstream output(file, std::ios::out | std::ios::binary);
+  if (!output) {
+    std::cerr << "error: could not open " << file << "\n";
+    return false;
+  }
+
+  return store::write(output, topologicState, out, compression);
+}
+
+/**\brief Run batch manifest
+ *
+ * Runs all of the jobs in a manifest, in order, with a single state object
+ * of its own, which keeps the model between jobs where possible. Each job
+ * starts from the prototype's settings; see apply().
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[in] prototype The state object set up from the command line.
+ * \param[in] m         The manifest to process.
+ * \param[in] programme The programme name, as in argv[0].
+ * \param[in] out       Output mode for jobs that don't select one.
+ *
+ * \returns The number of jobs that failed.
+ */
+template <typename Q, std::size_t d>
+static std::size_t run(const state<Q, d> &prototype, const manifest &m,
+                       const std::string &programme,
+                       const enum outputMode &out) {
+  state<Q, d> topologicState;
+  topologicState.threads = prototype.threads;
+  std::size_t failed = 0;
+
+  for (std::size_t i = 0; i < m.jobs.size(); i++) {
+    if (!run(topologicState, prototype, m, i, programme, out)) {
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+/**\brief Run batch manifest in parallel
+ *
+ * Runs all of the jobs in a manifest with a pool of worker threads. State
+ * objects are mutable and own their renderers and model, so each worker
+ * creates its own state object. Jobs are handed out one at a time from a
+ * shared counter, so workers that drew cheap jobs simply pick up more of them
+ * while others are busy with slow IFS or flame renders.
+ *
+ * Every job writes to its own output file, so the results don't depend on
+ * which worker ran what; failures are reported in manifest order once all of
+ * the workers are done.
+ *
+ * \tparam Q Base data type for the workers' topologic::state instances
+ * \tparam d Maximum render depth of the workers' topologic::state instances
+ *
+ * \param[in] prototype The state object set up from the command line; each
+ *                      job starts from its settings, see apply(). Jobs are
+ *                      already spread over the workers, so each worker
+ *                      rasterises PNG images with a single thread.
+ * \param[in] m         The manifest to process.
+ * \param[in] programme The programme name, as in argv[0].
+ * \param[in] out       Output mode for jobs that don't select one.
+ * \param[in] threads   Number of worker threads to use.
+ *
+ * \returns The number of jobs that failed.
+ */
+template <typename Q, std::size_t d>
+static std::size_t run(const state<Q, d> &prototype, const manifest &m,
+                       const std::string &programme,
+                       const enum outputMode &out, std::size_t threads) {
+  std::vector<char> ok(m.jobs.size(), 0);
+  std::atomic<std::size_t> next(0);
+  std::vector<std::thread> workers;
+
+  if (threads > m.jobs.size()) {
+    threads = m.jobs.size();
+  }
+
+  for (std::size_t t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&prototype, &m, &programme, &out, &ok,
+                                   &next]() {
+      state<Q, d> topologicState;
+      topologicState.threads = 1;
+
+      for (std::size_t i = next++; i < m.jobs.size(); i = next++) {
+        ok[i] = run(topologicState, prototype, m, i, programme, out);
+      }
+    }));
+  }
+
+  for (auto &w : workers) {
+    w.join();
+  }
+
+  std::size_t failed = 0;
+
+  for (std::size_t i = 0; i < ok.size(); i++) {
+    if (!ok[i]) {
+      std::cerr << "error: job " << i << " failed\n";
+      failed++;
+    }
+  }
+
+  return failed;
+}
+}
+}
+
+#endif
@@ -0,0 +1,291 @@
+/**\file
+ * \brief Buffered output
+ *
+ * Contains a small output buffer with locale-independent number formatting,
+ * which is used to write large SVG files without going through iostream's
+ * formatting for every single coordinate.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_BUFFER_H)
+#define TOPOLOGIC_BUFFER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace topologic {
+/**\brief Output helpers
+ *
+ * Contains the buffered writer and the number formatting used by the
+ * buffered SVG output.
+ */
+namespace output {
+/**\brief Maximum number of fixed-point digits
+ *
+ * Requests for more fractional digits than this are formatted with the
+ * shortest round-trip representation instead.
+ */
+static const unsigned int maxDigits = 17;
+
+/**\brief Format number
+ *
+ * Formats a number without any regard for the current locale. With 'digits'
+ * between 1 and 17, the number is rounded to that many fractional digits and
+ * trailing zeroes are dropped; 0.002 is written as "0.002" and 1 as "1". With
+ * 'digits' set to 0, the shortest representation that reads back as the same
+ * double is used.
+ *
+ * \param[out] out    Where to write the number to; needs room for at least
+ *                    32 characters. The output is not 0-terminated.
+ * \param[in]  value  The number to format.
+ * \param[in]  digits Number of fractional digits, or 0 for round-trip output.
+ *
+ * \returns The number of characters written to 'out'.
+ */
+static inline std::size_t format(char *out, double value,
+                                 const unsigned int &digits) {
+  static const std::uint64_t powers[] = {1ull,
+                                         10ull,
+                                         100ull,
+                                         1000ull,
+                                         10000ull,
+                                         100000ull,
+                                         1000000ull,
+                                         10000000ull,
+                                         100000000ull,
+                                         1000000000ull,
+                                         10000000000ull,
+                                         100000000000ull,
+                                         1000000000000ull,
+                                         10000000000000ull,
+                                         100000000000000ull,
+                                         1000000000000000ull,
+                                         10000000000000000ull,
+                                         100000000000000000ull};
+
+  if (!std::isfinite(value)) {
+    out[0] = '0';
+    return 1;
+  }
+
+  const bool negative = value < 0;
+  const double magnitude = negative ? -value : value;
+  const unsigned int d =
+      (digits == 0 && magnitude < 1e15 && std::floor(magnitude) == magnitude)
+          ? 1
+          : digits;
+  const double scaled =
+      (d > 0 && d <= maxDigits) ? magnitude * double(powers[d]) : 0;
+
+  if (d == 0 || d > maxDigits || scaled >= 9.0e18) {
+    char buffer[32];
+    int n = 0;
+    for (int p = 1; p <= 17; p++) {
+      n = std::snprintf(buffer, sizeof(buffer), "%.*g", p, value);
+      if (std::strtod(buffer, 0) == value) {
+        break;
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      out[i] = buffer[i] == ',' ? '.' : buffer[i];
+    }
+    return std::size_t(n);
+  }
+
+  const std::uint64_t n = std::uint64_t(scaled + 0.5);
+  std::uint64_t integral = n / powers[d];
+  std::uint64_t fraction = n % powers[d];
+  std::size_t len = 0;
+  char digitsBuffer[24];
+  std::size_t i = 0;
+
+  if (negative && n != 0) {
+    out[len++] = '-';
+  }
+
+  do {
+    digitsBuffer[i++] = char('0' + (integral % 10));
+    integral /= 10;
+  } while (integral > 0);
+
+  while (i > 0) {
+    out[len++] = digitsBuffer[--i];
+  }
+
+  if (fraction != 0) {
+    unsigned int width = d;
+    while (fraction % 10 == 0) {
+      fraction /= 10;
+      width--;
+    }
+
+    out[len++] = '.';
+    for (unsigned int j = width; j > 0; j--) {
+      out[len + j - 1] = char('0' + (fraction % 10));
+      fraction /= 10;
+    }
+    len += width;
+  }
+
+  return len;
+}
+
+/**\brief Buffered writer
+ *
+ * Collects output in a caller-provided buffer and passes it on to an output
+ * stream with a single write() per chunk. The buffer is meant to be kept
+ * around and reused for subsequent renders, so that it is only allocated
+ * once.
+ */
+class writer {
+public:
+  /**\brief Construct with stream and buffer
+   *
+   * \param[out] pStream  The stream to write to.
+   * \param[in]  pBuffer  Storage to collect output in; resized to 'pChunk'
+   *                      bytes if it is smaller than that.
+   * \param[in]  pDigits  Number of fractional digits for numbers; see
+   *                      format().
+   * \param[in]  pChunk   Number of bytes to collect before writing to the
+   *                      stream.
+   */
+  writer(std::ostream &pStream, std::vector<char> &pBuffer,
+         unsigned int pDigits = 6, std::size_t pChunk = 1 << 16)
+      : digits(pDigits), bytes(0), stream(pStream), buffer(pBuffer), used(0) {
+    if (buffer.size() < pChunk) {
+      buffer.resize(pChunk);
+    }
+  }
+
+  /**\brief Destructor
+   *
+   * Flushes any remaining output to the stream.
+   */
+  ~writer(void) { flush(); }
+
+  writer(const writer &) = delete;
+
+  /**\brief Append raw data
+   *
+   * \param[in] data   The data to append.
+   * \param[in] length Number of bytes in 'data'.
+   *
+   * \returns A reference to this writer.
+   */
+  writer &write(const char *data, std::size_t length) {
+    if (used + length > buffer.size()) {
+      flush();
+      if (length > buffer.size()) {
+        stream.write(data, length);
+        bytes += length;
+        return *this;
+      }
+    }
+    std::memcpy(&buffer[used], data, length);
+    used += length;
+    return *this;
+  }
+
+  writer &operator<<(const char *s) { return write(s, std::strlen(s)); }
+
+  writer &operator<<(const std::string &s) {
+    return write(s.data(), s.size());
+  }
+
+  writer &operator<<(const char &c) { return write(&c, 1); }
+
+  /**\brief Append number
+   *
+   * Formats the given number with the writer's number of digits.
+   *
+   * \param[in] value The number to append.
+   *
+   * \returns A reference to this writer.
+   */
+  writer &operator<<(const double &value) {
+    if (used + 32 > buffer.size()) {
+      flush();
+    }
+    used += format(&buffer[used], value, digits);
+    return *this;
+  }
+
+  /**\brief Append little-endian integer
+   *
+   * Writes the lowest 'length' bytes of an integer, least significant byte
+   * first, regardless of the host's byte order.
+   *
+   * \param[in] value  The integer to append.
+   * \param[in] length Number of bytes to write; at most 8.
+   *
+   * \returns A reference to this writer.
+   */
+  writer &little(std::uint64_t value, const std::size_t &length) {
+    char b[8];
+    for (std::size_t i = 0; i < length; i++) {
+      b[i] = char(value & 0xff);
+      value >>= 8;
+    }
+    return write(b, length);
+  }
+
+  /**\brief Append little-endian double
+   *
+   * Writes an IEEE 754 double in little-endian byte order.
+   *
+   * \param[in] value The number to append.
+   *
+   * \returns A reference to this writer.
+   */
+  writer &little(const double &value) {
+    std::uint64_t v;
+    std::memcpy(&v, &value, sizeof(v));
+    return little(v, sizeof(v));
+  }
+
+  /**\brief Flush buffer
+   *
+   * Writes all of the collected output to the stream.
+   */
+  void flush(void) {
+    if (used > 0) {
+      stream.write(buffer.data(), used);
+      bytes += used;
+      used = 0;
+    }
+  }
+
+  /**\brief Number of fractional digits
+   *
+   * Used when formatting numbers; see format().
+   */
+  unsigned int digits;
+
+  /**\brief Bytes written
+   *
+   * The number of bytes that have been passed on to the stream so far.
+   */
+  std::size_t bytes;
+
+protected:
+  std::ostream &stream;
+  std::vector<char> &buffer;
+  std::size_t used;
+};
+}
+}
+
+#endif
@@ -0,0 +1,293 @@
+/**\file
+ * \brief Background model builder
+ *
+ * Contains a helper for the interactive frontends that generates new models
+ * on a worker thread, so that the render thread can keep drawing the current
+ * model until the new one is ready, instead of blocking until its geometry
+ * has been generated.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_BUILDER_H)
+#define TOPOLOGIC_BUILDER_H
+
+#include <topologic/registry.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace topologic {
+/**\brief Background model builder
+ *
+ * Builds models for a state object on a worker thread. The worker uses its
+ * own state object, with a copy of the settings and cameras taken when the
+ * model was requested, to create the model and generate its geometry; see
+ * state::assign(). The finished
+ * geometry is then handed over to the real state object's geometry cache by
+ * swap(), which also replaces the state's model; since the geometry is
+ * already in the cache by then, that doesn't take long.
+ *
+ * Only the most recent request is ever built: requesting a model while
+ * another one is still being generated cancels the older one, and requests
+ * that haven't been started yet are simply replaced.
+ *
+ * request(), ready() and swap() must all be called from the thread that
+ * renders the state object, e.g. the main thread of the OSX frontend.
+ *
+ * \tparam Q   Base data type as used in the topologic::state instance
+ * \tparam dim Maximum render depth of the topologic::state instance
+ */
+template <typename Q, std::size_t dim> class builder {
+public:
+  /**\brief Construct with state object
+   *
+   * Starts the worker thread.
+   *
+   * \param[in,out] pState The state object to build models for.
+   */
+  builder(state<Q, dim> &pState)
+      : gState(pState), generation(0), pending(false), finished(false),
+        stop(false), cancel(false), worker([this]() { run(); }) {}
+
+  builder(const builder &) = delete;
+
+  /**\brief Destructor
+   *
+   * Cancels the current build, if there is one, and waits for the worker
+   * thread to exit.
+   */
+  ~builder(void) {
+    {
+      std::lock_guard<std::mutex> l(lock);
+      stop = true;
+      cancel = true;
+    }
+    wake.notify_one();
+    worker.join();
+  }
+
+  /**\brief Request new model
+   *
+   * Asks the worker thread to build the given model with the state's current
+   * settings. Does nothing if that exact model is already being built.
+   *
+   * \param[in] format The vector coordinate format to use.
+   * \param[in] model  The model type, e.g. "cube".
+   * \param[in] depth  The model depth.
+   * \param[in] rdepth The render depth.
+   */
+  void request(const std::string &format, const std::string &model,
+               const std::size_t &depth, const std::size_t &rdepth) {
+    {
+      std::lock_guard<std::mutex> l(lock);
+      const task t = {format, model, depth, rdepth, gState.parameter, 0};
+
+      if (gState.building && (t == next)) {
+        return;
+      }
+
+      snapshot.assign(gState);
+      next = t;
+      next.generation = ++generation;
+      pending = true;
+      finished = false;
+      cancel = true;
+      gState.building = true;
+    }
+    wake.notify_one();
+  }
+
+  /**\brief Is the new model ready?
+   *
+   * \returns 'true' if the most recently requested model has been built and
+   *          can be swapped in.
+   */
+  bool ready(void) {
+    std::lock_guard<std::mutex> l(lock);
+    return finished;
+  }
+
+  /**\brief Swap in new model
+   *
+   * Replaces the state's model with the most recently requested one, if it
+   * has been built, and makes the OpenGL renderer upload its geometry.
+   *
+   * \returns 'true' if the model has been replaced.
+   */
+  bool swap(void) {
+    std::lock_guard<std::mutex> l(lock);
+
+    if (!finished) {
+      return false;
+    }
+
+    finished = false;
+    gState.building = false;
+    gState.cache.adopt(result);
+    result.clear();
+
+    const bool ok = registry<Q, dim>::common().create(
+        gState, next.format, next.model, next.depth, next.renderDepth);
+#if !defined(NO_OPENGL)
+    gState.opengl().context.prepared = false;
+#endif
+    return ok;
+  }
+
+protected:
+  /**\brief Build task
+   *
+   * A model to build, along with the parameters to build it with.
+   */
+  class task {
+  public:
+    std::string format;
+    std::string model;
+    std::size_t depth;
+    std::size_t renderDepth;
+    efgy::geometry::parameters<Q> parameter;
+    std::size_t generation;
+
+    /**\brief Compare tasks
+     *
+     * \param[in] b The task to compare to.
+     *
+     * \returns 'true' if both tasks would build the same geometry.
+     */
+    bool operator==(const task &b) const {
+      return (format == b.format) && (model == b.model) &&
+             (depth == b.depth) && (renderDepth == b.renderDepth) &&
+             (render::parameters<Q>(parameter) ==
+              render::parameters<Q>(b.parameter));
+    }
+  };
+
+  /**\brief Worker thread
+   *
+   * Waits for requests and builds them, one at a time. Results of requests
+   * that have been superseded in the mean time are thrown away. Requests
+   * that fail are still marked as finished, so that swap() falls back to
+   * creating the model on the render thread.
+   */
+  void run(void) {
+    std::unique_lock<std::mutex> l(lock);
+
+    while (true) {
+      wake.wait(l, [this]() { return stop || pending; });
+      if (stop) {
+        return;
+      }
+
+      const task t = next;
+      shadow.assign(snapshot);
+      pending = false;
+      cancel = false;
+      l.unlock();
+
+      const bool ok = registry<Q, dim>::common().create(
+                          shadow, t.format, t.model, t.depth, t.renderDepth) &&
+                      shadow.model->prepare(cancel);
+
+      l.lock();
+      if (!cancel && (t.generation == generation)) {
+        if (ok) {
+          result = shadow.cache;
+        }
+        finished = true;
+      }
+    }
+  }
+
+  /**\brief Global state object
+   *
+   * The state object that models are built for; never touched by the
+   * worker thread.
+   */
+  state<Q, dim> &gState;
+
+  /**\brief Worker state object
+   *
+   * Used by the worker thread to create models and generate their geometry.
+   */
+  state<Q, dim> shadow;
+
+  /**\brief Requested settings
+   *
+   * A copy of the state object's settings and cameras, taken by request()
+   * and copied to 'shadow' by the worker when it starts on the request.
+   */
+  state<Q, dim> snapshot;
+
+  /**\brief Most recent request
+   *
+   * The task that the worker is building or about to build.
+   */
+  task next;
+
+  /**\brief Generated geometry
+   *
+   * A copy of the worker state's geometry cache, taken when the most recent
+   * request was finished.
+   */
+  render::cache result;
+
+  /**\brief Request counter
+   *
+   * Incremented with every request; used to tell stale results apart.
+   */
+  std::size_t generation;
+
+  /**\brief Request waiting?
+   *
+   * Set when 'next' hasn't been picked up by the worker yet.
+   */
+  bool pending;
+
+  /**\brief Request finished?
+   *
+   * Set when the most recent request has been built and not swapped in yet.
+   */
+  bool finished;
+
+  /**\brief Stop worker
+   *
+   * Set by the destructor to make the worker thread exit.
+   */
+  bool stop;
+
+  /**\brief Cancel current build
+   *
+   * Checked by the worker while generating geometry.
+   */
+  std::atomic<bool> cancel;
+
+  /**\brief Lock
+   *
+   * Protects all of the members shared between the threads.
+   */
+  std::mutex lock;
+
+  /**\brief Wake-up signal
+   *
+   * Notified when there is a new request, or when the worker should exit.
+   */
+  std::condition_variable wake;
+
+  /**\brief Worker thread
+   *
+   * Runs run() until the builder is destroyed; declared last, so that all of
+   * the other members are initialised before it starts.
+   */
+  std::thread worker;
+};
+}
+
+#endif
@@ -25,7 +25,10 @@
  */
 #define NO_OPENGL
 
-#include <topologic/arguments.h>
+#include <topologic/animation.h>
+#include <topologic/batch.h>
+#include <topologic/server.h>
+#include <regex>
 
 #if !defined(MAXDEPTH)
 /**\brief Maximum render depth
@@ -45,6 +48,44 @@ namespace topologic {
  * Main function for a typical CLI-/SVG-only frontend. This is part of the
  * library code so that it's easy to reuse where applicable.
  *
+ * If a batch manifest is passed with the 'batch:FILE' option, all of the
+ * jobs in the manifest are rendered with the same state object and written to
+ * their own output files; the output mode selected on the command line is
+ * used for jobs that don't select one themselves, and defaults to SVG. Jobs
+ * are spread over one worker thread per core, or as many as are set with the
+ * 'threads:N' option; each worker uses its own state object. Outside of
+ * batch mode, the same number of threads is used to rasterise PNG images.
+ *
+ * With the 'animate:FRAMES[:PREFIX]' option, the model is rendered to the
+ * given number of frames instead, rotated by the schedule set with any
+ * number of 'rotate:DIM:X[:Y]' options; see animation::run(). Frames are
+ * rendered with the same number of threads as batch jobs.
+ *
+ * With the 'serve:ADDRESS' option, the function runs a render server on the
+ * given TCP port or Unix domain socket instead, with as many workers as
+ * batch mode would use; see server::run(). It only returns if the server
+ * could not be started.
+ *
+ * With the 'compress:METHOD' option, all output - on stdout, in batch
+ * output files, frames and server replies - is compressed with gzip or zstd
+ * on a separate thread while it is being rendered. Batch jobs whose output
+ * file ends in '.svgz', '.gz' or '.zst' are compressed accordingly even
+ * without the option. Compressed input files and manifests are decompressed
+ * transparently.
+ *
+ * With the 'cache:DIR' option, rendered output is kept in the given
+ * directory on the command line, in batch mode and in server mode, and
+ * output that is already there is written as is instead of being rendered
+ * again; see store::write().
+ *
+ * With the 'stats' option, the timers and counters in stats::global() are
+ * written to stderr as JSON before the function returns.
+ *
+ * The options above only apply to the command line itself. Batch jobs and
+ * server requests are parsed with the same option list, so these options
+ * are rejected in them instead of changing this function's settings while
+ * other jobs are running.
+ *
  * \tparam FP Floating point data type to use; something like double
  *
  * \param[in] argc The number of arguments that are being passed in argv.
@@ -62,25 +103,203 @@ template <typename FP> int cli(int argc, char *argv[]) {
     args.push_back(argv[i]);
   }
 
+  // batch jobs and server requests are parsed with the same option list as
+  // the command line, so the options below refuse to touch this function's
+  // variables once the command line has been parsed; jobs may run on any
+  // number of threads by then.
+  bool commandLine = true;
+  auto only = [&commandLine](std::smatch & m)->bool {
+    if (!commandLine) {
+      std::cerr << "error: " << m[0] << " only works on the command line\n";
+    }
+    return commandLine;
+  };
+
+  std::string manifest;
+  std::size_t threads = std::thread::hardware_concurrency();
+
+  efgy::cli::option obatch("-{0,2}batch:(.+)",
+                           [&manifest, &only](std::smatch & m)->bool {
+    if (!only(m)) {
+      return false;
+    }
+    manifest = m[1];
+    return true;
+  },
+                           "Render all jobs in the given batch manifest.");
+
+  efgy::cli::option othreads("-{0,2}(j|threads):([0-9]+)",
+                             [&threads, &only](std::smatch & m)->bool {
+    if (!only(m)) {
+      return false;
+    }
+    threads = std::stoi(m[2]);
+    return true;
+  },
+                             "Number of worker threads for batch manifests "
+                             "and the PNG rasteriser.");
+
+  std::string address;
+
+  efgy::cli::option oserve("-{0,2}serve:(.+)",
+                           [&address, &only](std::smatch & m)->bool {
+    if (!only(m)) {
+      return false;
+    }
+    address = m[1];
+    return true;
+  },
+                           "Run a render server on the given TCP port or "
+                           "Unix domain socket.");
+
+  std::size_t frames = 0;
+  std::string prefix = "frame";
+
+  efgy::cli::option oanimate("-{0,2}animate:([0-9]+)(:(.+))?",
+                             [&frames, &prefix, &only](std::smatch & m)->bool {
+    if (!only(m)) {
+      return false;
+    }
+    frames = std::stoul(m[1]);
+    if (m[3] != "") {
+      prefix = m[3];
+    }
+    return frames > 0;
+  },
+                             "Render an animation with the given number of "
+                             "frames, to files starting with the given "
+                             "prefix.");
+
+  std::vector<animation::rotation> schedule;
+
+  efgy::cli::option orotate(
+      "-{0,2}rotate:([0-9]+):(-?[0-9.]+)(:(-?[0-9.]+))?",
+      [&schedule, &only](std::smatch & m)->bool {
+        if (!only(m)) {
+          return false;
+        }
+        const animation::rotation r = {std::stoul(m[1]), std::stod(m[2]),
+                                       m[4] != "" ? std::stod(m[4]) : 0.};
+        schedule.push_back(r);
+        return true;
+      },
+      "Rotate an animation through the given dimension, by the given number "
+      "of horizontal and vertical turns over all of its frames.");
+
+  efgy::cli::option oprecision(
+      "-{0,2}precision[:=](float|double)",
+      [](std::smatch &)->bool { return true; },
+      "Calculate with single or double precision; see the manual for where "
+      "single precision isn't enough.");
+
+  bool statistics = false;
+
+  efgy::cli::option ostats("-{0,2}stats",
+                           [&statistics, &only](std::smatch & m)->bool {
+    if (!only(m)) {
+      return false;
+    }
+    statistics = true;
+    return true;
+  },
+                           "Print timings and counters as JSON on stderr.");
+
   enum outputMode out = parse(topologicState, args);
+  commandLine = false;
+
+  if (manifest != "") {
+    const input::file f(manifest);
+    batch::manifest m(f.valid ? std::string(f.data, f.size) : std::string(),
+                      manifest);
+    if (!m.valid) {
+      return 1;
+    }
+
+    if (out == outNone) {
+      out = outSVG;
+    }
+
+    std::size_t failed =
+        threads > 1
+            ? batch::run(topologicState, m, args[0], out, threads)
+            : batch::run(topologicState, m, args[0], out);
+
+    if (statistics) {
+      stats::report(std::cerr);
+    }
+
+    return failed == 0 ? 0 : 1;
+  }
+
+  if (address != "") {
+    if (out == outNone) {
+      out = outSVG;
+    }
+
+    return server::run(topologicState, address, args[0], out, threads) ? 0
+                                                                       : 1;
+  }
+
+  if (frames > 0) {
+    if (out == outNone) {
+      out = outSVG;
+    }
+
+    std::size_t failed = animation::run(topologicState, schedule, frames,
+                                        prefix, out, threads);
+
+    if (statistics) {
+      stats::report(std::cerr);
+    }
+
+    return failed == 0 ? 0 : 1;
+  }
+
+  topologicState.threads = threads;
 
   if (!topologicState.model) {
     std::cerr << "error: no model to render\n";
-  } else if (out == outSVG) {
-    std::cout << efgy::svg::tag() << topologicState;
-  } else if (out == outJSON) {
-    std::cout << efgy::json::tag() << topologicState;
-  } else if (out == outArguments) {
-    std::vector<std::string> v;
-    std::cout << "topologic";
-    for (const auto &arg : topologicState.args(v)) {
-      std::cout << " " << arg;
-    }
-    std::cout << "\n";
+  } else {
+    store::write(std::cout, topologicState, out);
+  }
+
+  if (statistics) {
+    stats::report(std::cerr);
   }
 
   return 0;
 }
+
+/**\brief CLI frontend main function with selectable precision
+ *
+ * Runs cli<float> if the arguments contain 'precision:float' - or
+ * 'precision=float' - and cli<double> otherwise. If there are several of
+ * these options, the last one wins, as with all other options. The option
+ * only applies to the command line itself; in batch manifests and server
+ * requests, it is accepted but has no effect.
+ *
+ * Single precision halves the memory needed for model geometry and doubles
+ * the number of vertices that the projection kernel processes at once, but
+ * only has about seven significant digits.
+ *
+ * \param[in] argc The number of arguments that are being passed in argv.
+ * \param[in] argv The actual argument vector, as for cli<FP>().
+ *
+ * \returns 0 if the function ran correctly, nonzero otherwise.
+ */
+static inline int cli(int argc, char *argv[]) {
+  const std::regex precision("-{0,2}precision[:=](float|double)");
+  bool single = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::cmatch m;
+    if (std::regex_match(argv[i], m, precision)) {
+      single = (m[1] == "float");
+    }
+  }
+
+  return single ? cli<float>(argc, argv) : cli<double>(argc, argv);
+}
 }
 
 #endif
@@ -0,0 +1,592 @@
+/**\file
+ * \brief Compressed output and input
+ *
+ * Contains the output stream that compresses everything written to it on a
+ * separate thread, so that rendering and compression overlap, and the
+ * functions that recognise and decompress compressed input files.
+ *
+ * gzip is always available, since zlib is needed for PNG output anyway. zstd
+ * needs libzstd; define the USE_ZSTD macro and link with -lzstd to enable
+ * it, e.g. by building with 'make ZSTD=1'.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_COMPRESS_H)
+#define TOPOLOGIC_COMPRESS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace topologic {
+/**\brief Compressed output and input
+ *
+ * Contains the classes and functions used to compress output and to
+ * decompress input files.
+ */
+namespace compress {
+/**\brief Compression methods
+ *
+ * The formats that output may be compressed with.
+ */
+enum method {
+  mNone, /**< Write output as is. */
+  mGzip, /**< Compress with gzip, e.g. for .svgz files. */
+  mZstd  /**< Compress with zstd; only available with USE_ZSTD. */
+};
+
+/**\brief Method by name
+ *
+ * \param[in] name The name of a method, as used by the 'compress' option:
+ *                 "none", "gzip" or "zstd".
+ *
+ * \returns The named method, or mNone for unknown names.
+ */
+static inline enum method byName(const std::string &name) {
+  return name == "gzip" ? mGzip : name == "zstd" ? mZstd : mNone;
+}
+
+/**\brief Method for file name
+ *
+ * Picks the method that a file's name suggests: gzip for '.svgz' and '.gz'
+ * files, zstd for '.zst' files.
+ *
+ * \param[in] name A file name.
+ *
+ * \returns The method to compress the file with; mNone for all other names.
+ */
+static inline enum method byFile(const std::string &name) {
+  const auto ends = [&name](const char *suffix) -> bool {
+    const std::size_t n = std::strlen(suffix);
+    return (name.size() >= n) && (name.compare(name.size() - n, n, suffix) == 0);
+  };
+
+  return (ends(".svgz") || ends(".gz")) ? mGzip : ends(".zst") ? mZstd : mNone;
+}
+
+/**\brief Compressed stream buffer
+ *
+ * Collects everything written to it in chunks and hands each full chunk to a
+ * worker thread, which compresses it and writes the result to the target
+ * stream. Up to 'depth' chunks may be waiting at any one time, after which
+ * writers block until the worker catches up; so memory use stays bounded
+ * even if compression is slower than rendering.
+ *
+ * The buffered SVG writer writes in chunks of the same size, so its chunks
+ * are usually passed on without being split.
+ */
+class buffer : public std::streambuf {
+public:
+  /**\brief Construct with target and method
+   *
+   * Starts the worker thread, unless the method is not available.
+   *
+   * \param[out] pTarget The stream to write compressed data to.
+   * \param[in]  pMethod The compression method to use.
+   * \param[in]  pChunk  The number of bytes to collect per chunk.
+   */
+  buffer(std::ostream &pTarget, const enum method &pMethod,
+         const std::size_t &pChunk = 1 << 16)
+      : target(pTarget), type(pMethod), chunk(pChunk), failed(false),
+        closed(false),
+#if defined(USE_ZSTD)
+        zstd(0),
+#endif
+        ready(false) {
+    if (!start()) {
+      failed = true;
+      return;
+    }
+
+    current.reserve(chunk);
+    ready = true;
+    worker = std::thread([this]() { run(); });
+  }
+
+  buffer(const buffer &) = delete;
+
+  /**\brief Destructor
+   *
+   * Finishes the compressed stream, if that hasn't been done yet.
+   */
+  ~buffer(void) { finish(); }
+
+  /**\brief Finish stream
+   *
+   * Compresses whatever is left, writes the compressed stream's trailer and
+   * waits for the worker thread to exit. Nothing may be written afterwards.
+   *
+   * \returns 'true' if all of the data was compressed and written.
+   */
+  bool finish(void) {
+    if (ready) {
+      ready = false;
+      push();
+      {
+        std::lock_guard<std::mutex> l(lock);
+        closed = true;
+      }
+      wake.notify_all();
+      worker.join();
+      target.flush();
+    }
+
+    return !failed && target.good();
+  }
+
+protected:
+  /**\brief Write characters
+   *
+   * \param[in] s The characters to write.
+   * \param[in] n The number of characters in 's'.
+   *
+   * \returns The number of characters written; 0 once the stream has
+   *          failed.
+   */
+  std::streamsize xsputn(const char *s, std::streamsize n) {
+    if (!ready || failed) {
+      return 0;
+    }
+
+    for (std::streamsize i = 0; i < n;) {
+      const std::size_t room = chunk - current.size();
+      const std::size_t c =
+          std::size_t(n - i) < room ? std::size_t(n - i) : room;
+      current.insert(current.end(), s + i, s + i + c);
+      i += std::streamsize(c);
+      if (current.size() >= chunk) {
+        push();
+      }
+    }
+
+    return n;
+  }
+
+  /**\brief Write character
+   *
+   * \param[in] c The character to write.
+   *
+   * \returns The character, or EOF once the stream has failed.
+   */
+  int_type overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+    const char ch = traits_type::to_char_type(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+  }
+
+  /**\brief Queue current chunk
+   *
+   * Hands the current chunk to the worker thread, waiting for room in the
+   * queue if needed, and takes a new chunk from the spares.
+   */
+  void push(void) {
+    if (current.empty()) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> l(lock);
+    room.wait(l, [this]() { return queue.size() < depth; });
+    queue.push_back(std::vector<char>());
+    queue.back().swap(current);
+    if (!spare.empty()) {
+      current.swap(spare.back());
+      spare.pop_back();
+    }
+    l.unlock();
+    wake.notify_one();
+
+    current.reserve(chunk);
+  }
+
+  /**\brief Worker thread
+   *
+   * Compresses queued chunks until the stream is finished, then writes the
+   * compressed stream's trailer.
+   */
+  void run(void) {
+    std::unique_lock<std::mutex> l(lock);
+
+    while (true) {
+      wake.wait(l, [this]() { return closed || !queue.empty(); });
+      if (queue.empty()) {
+        break;
+      }
+
+      std::vector<char> c;
+      c.swap(queue.front());
+      queue.pop_front();
+      l.unlock();
+      room.notify_one();
+
+      if (!failed) {
+        failed = !compress(c.data(), c.size(), false);
+      }
+      c.clear();
+
+      l.lock();
+      spare.push_back(std::vector<char>());
+      spare.back().swap(c);
+    }
+
+    l.unlock();
+
+    if (!failed) {
+      failed = !compress(0, 0, true);
+    }
+    stop();
+  }
+
+  /**\brief Set up compressor
+   *
+   * \returns 'true' if the compressor is ready; 'false' if the method isn't
+   *          available.
+   */
+  bool start(void) {
+    switch (type) {
+    case mGzip:
+      std::memset(&gzip, 0, sizeof(gzip));
+      // 15 window bits, plus 16 to get a gzip header and trailer.
+      if (deflateInit2(&gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                       Z_DEFAULT_STRATEGY) != Z_OK) {
+        std::cerr << "error: could not initialise gzip compression\n";
+        return false;
+      }
+      return true;
+    case mZstd:
+#if defined(USE_ZSTD)
+      zstd = ZSTD_createCStream();
+      if (!zstd || ZSTD_isError(ZSTD_initCStream(zstd, 3))) {
+        std::cerr << "error: could not initialise zstd compression\n";
+        return false;
+      }
+      return true;
+#else
+      std::cerr << "error: zstd compression is not available in this build\n";
+      return false;
+#endif
+    default:
+      std::cerr << "error: no compression method selected\n";
+      return false;
+    }
+  }
+
+  /**\brief Compress data
+   *
+   * Compresses the given data and writes the result to the target stream.
+   *
+   * \param[in] data The data to compress.
+   * \param[in] size The number of bytes in 'data'.
+   * \param[in] last Whether to end the compressed stream.
+   *
+   * \returns 'true' if the data was compressed and written.
+   */
+  bool compress(const char *data, const std::size_t &size, const bool &last) {
+    char out[1 << 16];
+
+    if (type == mGzip) {
+      gzip.next_in = (Bytef *)(data);
+      gzip.avail_in = uInt(size);
+      int r = Z_OK;
+      do {
+        gzip.next_out = (Bytef *)(out);
+        gzip.avail_out = sizeof(out);
+        r = deflate(&gzip, last ? Z_FINISH : Z_NO_FLUSH);
+        if (r == Z_STREAM_ERROR) {
+          return false;
+        }
+        target.write(out, sizeof(out) - gzip.avail_out);
+      } while ((gzip.avail_out == 0) || (last && (r != Z_STREAM_END)));
+      return target.good();
+    }
+
+#if defined(USE_ZSTD)
+    if (type == mZstd) {
+      ZSTD_inBuffer in = {data, size, 0};
+      std::size_t r = 0;
+      do {
+        ZSTD_outBuffer o = {out, sizeof(out), 0};
+        r = last ? ZSTD_endStream(zstd, &o) : ZSTD_compressStream(zstd, &o, &in);
+        if (ZSTD_isError(r)) {
+          return false;
+        }
+        target.write(out, o.pos);
+      } while (last ? (r != 0) : (in.pos < in.size));
+      return target.good();
+    }
+#endif
+
+    return false;
+  }
+
+  /**\brief Release compressor
+   *
+   * Frees the compressor's state once the stream is finished.
+   */
+  void stop(void) {
+    if (type == mGzip) {
+      deflateEnd(&gzip);
+    }
+#if defined(USE_ZSTD)
+    if (zstd) {
+      ZSTD_freeCStream(zstd);
+      zstd = 0;
+    }
+#endif
+  }
+
+  /**\brief Queue depth
+   *
+   * The number of chunks that may wait for the worker thread at most.
+   */
+  static const std::size_t depth = 4;
+
+  /**\brief Target stream
+   *
+   * The stream that compressed data is written to; only used by the worker
+   * thread while it runs.
+   */
+  std::ostream &target;
+
+  /**\brief Method
+   *
+   * The compression method used by the stream.
+   */
+  const enum method type;
+
+  /**\brief Chunk size
+   *
+   * The number of bytes to collect before queueing a chunk.
+   */
+  const std::size_t chunk;
+
+  /**\brief Failed?
+   *
+   * Set if the compressor could not be set up, or if compressing or writing
+   * data failed.
+   */
+  std::atomic<bool> failed;
+
+  /**\brief Stream closed?
+   *
+   * Set by finish() to make the worker thread exit once the queue is empty.
+   */
+  bool closed;
+
+  /**\brief gzip compressor
+   *
+   * The zlib stream used with mGzip.
+   */
+  z_stream gzip;
+
+#if defined(USE_ZSTD)
+  /**\brief zstd compressor
+   *
+   * The zstd stream used with mZstd.
+   */
+  ZSTD_CStream *zstd;
+#endif
+
+  /**\brief Current chunk
+   *
+   * The chunk being filled by the writing thread.
+   */
+  std::vector<char> current;
+
+  /**\brief Queued chunks
+   *
+   * Full chunks waiting to be compressed.
+   */
+  std::deque<std::vector<char>> queue;
+
+  /**\brief Spare chunks
+   *
+   * Chunks that have been compressed, kept so that their memory is reused.
+   */
+  std::vector<std::vector<char>> spare;
+
+  /**\brief Lock
+   *
+   * Protects 'closed', 'queue' and 'spare'.
+   */
+  std::mutex lock;
+
+  /**\brief Wake-up signal
+   *
+   * Notified when a chunk has been queued or the stream has been closed.
+   */
+  std::condition_variable wake;
+
+  /**\brief Room signal
+   *
+   * Notified when the worker has taken a chunk off the queue.
+   */
+  std::condition_variable room;
+
+  /**\brief Running?
+   *
+   * Set while the worker thread runs and data may be written.
+   */
+  bool ready;
+
+  /**\brief Worker thread
+   *
+   * Runs run() until finish() is called.
+   */
+  std::thread worker;
+};
+
+/**\brief Compressed output stream
+ *
+ * An output stream that compresses everything written to it with a buffer,
+ * and writes the result to another stream.
+ */
+class ostream : public std::ostream {
+public:
+  /**\brief Construct with target and method
+   *
+   * \param[out] target The stream to write compressed data to.
+   * \param[in]  type   The compression method to use.
+   */
+  ostream(std::ostream &target, const enum method &type)
+      : std::ostream(0), data(target, type) {
+    rdbuf(&data);
+  }
+
+  /**\brief Finish stream
+   *
+   * Flushes the stream; see buffer::finish().
+   *
+   * \returns 'true' if everything written to the stream was compressed and
+   *          written to the target stream.
+   */
+  bool finish(void) { return data.finish() && good(); }
+
+protected:
+  /**\brief Stream buffer
+   *
+   * Compresses the stream's data.
+   */
+  buffer data;
+};
+
+/**\brief Detect compressed data
+ *
+ * Recognises gzip and zstd data by their magic numbers.
+ *
+ * \param[in] data The data to look at.
+ * \param[in] size The number of bytes in 'data'.
+ *
+ * \returns The method that the data was compressed with, or mNone.
+ */
+static inline enum method detect(const char *data, const std::size_t &size) {
+  if ((size >= 2) && (std::memcmp(data, "\x1f\x8b", 2) == 0)) {
+    return mGzip;
+  }
+  if ((size >= 4) && (std::memcmp(data, "\x28\xb5\x2f\xfd", 4) == 0)) {
+    return mZstd;
+  }
+  return mNone;
+}
+
+/**\brief Decompress data
+ *
+ * Decompresses gzip data, or zstd data if that's available. Concatenated
+ * gzip members are decompressed one after the other, as gzip itself would.
+ *
+ * \param[in]  data The compressed data.
+ * \param[in]  size The number of bytes in 'data'.
+ * \param[out] out  Receives the decompressed data.
+ *
+ * \returns 'true' if the data could be decompressed.
+ */
+static inline bool decompress(const char *data, const std::size_t &size,
+                              std::string &out) {
+  char buffer[1 << 16];
+  out.clear();
+
+  switch (detect(data, size)) {
+  case mGzip: {
+    z_stream z;
+    std::memset(&z, 0, sizeof(z));
+    // 15 window bits, plus 32 to detect the gzip header.
+    if (inflateInit2(&z, 15 + 32) != Z_OK) {
+      return false;
+    }
+    z.next_in = (Bytef *)(data);
+    z.avail_in = uInt(size);
+    int r = Z_OK;
+    while (r == Z_OK) {
+      z.next_out = (Bytef *)(buffer);
+      z.avail_out = sizeof(buffer);
+      r = inflate(&z, Z_NO_FLUSH);
+      out.append(buffer, sizeof(buffer) - z.avail_out);
+      if ((r == Z_STREAM_END) && (z.avail_in > 0) &&
+          (detect((const char *)(z.next_in), z.avail_in) == mGzip)) {
+        r = inflateReset(&z);
+      }
+    }
+    inflateEnd(&z);
+    if (r != Z_STREAM_END) {
+      std::cerr << "error: invalid gzip data\n";
+      return false;
+    }
+    return true;
+  }
+  case mZstd: {
+#if defined(USE_ZSTD)
+    ZSTD_DStream *z = ZSTD_createDStream();
+    if (!z || ZSTD_isError(ZSTD_initDStream(z))) {
+      ZSTD_freeDStream(z);
+      return false;
+    }
+    ZSTD_inBuffer in = {data, size, 0};
+    std::size_t r = 1;
+    bool more = size > 0;
+    while (more) {
+      ZSTD_outBuffer o = {buffer, sizeof(buffer), 0};
+      r = ZSTD_decompressStream(z, &o, &in);
+      if (ZSTD_isError(r)) {
+        break;
+      }
+      out.append(buffer, o.pos);
+      more = (in.pos < in.size) || (o.pos == o.size);
+    }
+    ZSTD_freeDStream(z);
+    if (ZSTD_isError(r) || (r != 0)) {
+      std::cerr << "error: invalid zstd data\n";
+      return false;
+    }
+    return true;
+#else
+    std::cerr << "error: zstd input is not supported in this build\n";
+    return false;
+#endif
+  }
+  default:
+    return false;
+  }
+}
+}
+}
+
+#endif
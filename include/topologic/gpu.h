@@ -0,0 +1,349 @@
+/**\file
+ * \brief Vertex shader projection
+ *
+ * Contains the OpenGL mesh that renders models with more than three
+ * dimensions by uploading their unprojected vertices once and projecting
+ * them in a vertex shader. Rotating such a model then only updates a couple
+ * of uniforms per frame, instead of projecting all of its vertices on the
+ * CPU and uploading them again.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_GPU_H)
+#define TOPOLOGIC_GPU_H
+
+#include <ef.gy/render-opengl.h>
+#include <array>
+#include <iostream>
+#include <vector>
+
+namespace topologic {
+/**\brief Vertex shader projection
+ *
+ * Contains the classes used to project models on the GPU.
+ */
+namespace gpu {
+/**\brief Maximum depth
+ *
+ * The highest render depth that the shader supports: each vertex is passed
+ * in as two vec4 attributes, which hold up to seven coordinates and the
+ * homogeneous coordinate.
+ */
+static const std::size_t maxDepth = 7;
+
+/**\brief Projected mesh
+ *
+ * Holds a model's unprojected vertices and its faces in OpenGL buffers, and
+ * draws them with a shader that applies a view chain - compiled all the way
+ * to clip space - to each vertex. Faces are drawn as triangle fans with the
+ * surface colour and a flat shading derived from their projected normals,
+ * and their outlines are drawn as lines with the wireframe colour.
+ *
+ * All methods must be called with the OpenGL context current that the mesh
+ * is drawn in; this needs OpenGL 3.2 or later.
+ *
+ * \tparam d Render depth of the model. Meshes with more than maxDepth
+ *           dimensions can't be drawn; upload() fails for them.
+ */
+template <std::size_t d> class mesh {
+public:
+  /**\brief Default constructor
+   *
+   * Creates an empty mesh; the shader and buffers are created the first time
+   * the mesh is used.
+   */
+  mesh(void)
+      : program(0), array(0), vertexBuffer(0), triangleBuffer(0),
+        lineBuffer(0), triangles(0), lines(0), failed(false) {}
+
+  mesh(const mesh &) = delete;
+
+  /**\brief Destructor
+   *
+   * Releases the shader and buffers.
+   */
+  ~mesh(void) {
+    if (array) {
+      glDeleteVertexArrays(1, &array);
+      glDeleteBuffers(1, &vertexBuffer);
+      glDeleteBuffers(1, &triangleBuffer);
+      glDeleteBuffers(1, &lineBuffer);
+    }
+    if (program) {
+      glDeleteProgram(program);
+    }
+  }
+
+  /**\brief Upload geometry
+   *
+   * Replaces the mesh's buffers with the given geometry.
+   *
+   * \tparam G A geometry type like wrapper::geometry, with vertex lanes and
+   *           face offsets.
+   *
+   * \param[in] g The geometry to upload.
+   *
+   * \returns 'true' if the mesh can be drawn; 'false' if the shader could
+   *          not be compiled or the mesh has too many dimensions.
+   */
+  template <typename G> bool upload(const G &g) {
+    if ((d > maxDepth) || !prepare()) {
+      return false;
+    }
+
+    const std::size_t n = g.vertices.size();
+    std::vector<GLfloat> data(8 * n, 0.f);
+    for (std::size_t v = 0; v < n; v++) {
+      for (std::size_t i = 0; i < d; i++) {
+        data[8 * v + i] = GLfloat(g.vertices.lane[i][v]);
+      }
+      data[8 * v + d] = 1.f;
+    }
+
+    std::vector<GLuint> t, l;
+    for (std::size_t f = 0; f + 1 < g.offsets.size(); f++) {
+      const GLuint b = GLuint(g.offsets[f]), e = GLuint(g.offsets[f + 1]);
+      for (GLuint v = b + 1; v + 1 < e; v++) {
+        t.push_back(b);
+        t.push_back(v);
+        t.push_back(v + 1);
+      }
+      for (GLuint v = b; (e - b >= 2) && (v < e); v++) {
+        l.push_back(v);
+        l.push_back(v + 1 < e ? v + 1 : b);
+      }
+    }
+
+    glBindVertexArray(array);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), data.data(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, triangleBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, t.size() * sizeof(GLuint), t.data(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lineBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, l.size() * sizeof(GLuint), l.data(),
+                 GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    triangles = GLsizei(t.size());
+    lines = GLsizei(l.size());
+
+    return true;
+  }
+
+  /**\brief Draw mesh
+   *
+   * \param[in] matrix    The view chain from the model's depth to clip space,
+   *                      as a row-major (d+1) x 4 matrix; see
+   *                      view::chain.
+   * \param[in] surface   The surface colour, as RGBA.
+   * \param[in] wireframe The wireframe colour, as RGBA.
+   */
+  template <typename Q>
+  void draw(const std::array<Q, (d + 1) * 4> &matrix,
+            const std::array<GLfloat, 4> &surface,
+            const std::array<GLfloat, 4> &wireframe) const {
+    if (!program) {
+      return;
+    }
+
+    GLfloat m[32] = {0.f};
+    for (std::size_t i = 0; (i < matrix.size()) && (i < 32); i++) {
+      m[i] = GLfloat(matrix[i]);
+    }
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(program);
+    glUniformMatrix4fv(uLow, 1, GL_FALSE, m);
+    glUniformMatrix4fv(uHigh, 1, GL_FALSE, m + 16);
+    glBindVertexArray(array);
+
+    if (surface[3] > 0.f) {
+      glUniform4fv(uColour, 1, surface.data());
+      glUniform1f(uShade, 1.f);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, triangleBuffer);
+      glDrawElements(GL_TRIANGLES, triangles, GL_UNSIGNED_INT, 0);
+    }
+
+    if (wireframe[3] > 0.f) {
+      glUniform4fv(uColour, 1, wireframe.data());
+      glUniform1f(uShade, 0.f);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lineBuffer);
+      glDrawElements(GL_LINES, lines, GL_UNSIGNED_INT, 0);
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+  }
+
+protected:
+  /**\brief Create shader and buffers
+   *
+   * Compiles the shader and creates the buffers, unless that's been done
+   * already.
+   *
+   * \returns 'true' if the shader is ready; 'false' if it could not be
+   *          compiled, now or on an earlier call.
+   */
+  bool prepare(void) {
+    if (program || failed) {
+      return !failed;
+    }
+
+    static const char *vertexShader =
+        "#version 150\n"
+        "uniform mat4 low;\n"
+        "uniform mat4 high;\n"
+        "in vec4 coordinatesLow;\n"
+        "in vec4 coordinatesHigh;\n"
+        "out vec3 position;\n"
+        "void main() {\n"
+        "  gl_Position = low * coordinatesLow + high * coordinatesHigh;\n"
+        "  position = gl_Position.xyz / gl_Position.w;\n"
+        "}\n";
+
+    static const char *fragmentShader =
+        "#version 150\n"
+        "uniform vec4 colour;\n"
+        "uniform float shade;\n"
+        "in vec3 position;\n"
+        "out vec4 fragmentColour;\n"
+        "void main() {\n"
+        "  float light = 1.0;\n"
+        "  if (shade > 0.5) {\n"
+        "    vec3 n = normalize(cross(dFdx(position), dFdy(position)));\n"
+        "    light = 0.4 + 0.6 * abs(n.z);\n"
+        "  }\n"
+        "  fragmentColour = vec4(colour.rgb * light, colour.a);\n"
+        "}\n";
+
+    const GLuint vs = compile(GL_VERTEX_SHADER, vertexShader);
+    const GLuint fs = compile(GL_FRAGMENT_SHADER, fragmentShader);
+    GLint ok = GL_FALSE;
+
+    if (vs && fs) {
+      program = glCreateProgram();
+      glAttachShader(program, vs);
+      glAttachShader(program, fs);
+      glBindAttribLocation(program, 0, "coordinatesLow");
+      glBindAttribLocation(program, 1, "coordinatesHigh");
+      glBindFragDataLocation(program, 0, "fragmentColour");
+      glLinkProgram(program);
+      glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    }
+
+    if (vs) {
+      glDeleteShader(vs);
+    }
+    if (fs) {
+      glDeleteShader(fs);
+    }
+
+    if (ok != GL_TRUE) {
+      std::cerr << "error: could not link vertex projection shader\n";
+      if (program) {
+        glDeleteProgram(program);
+        program = 0;
+      }
+      failed = true;
+      return false;
+    }
+
+    uLow = glGetUniformLocation(program, "low");
+    uHigh = glGetUniformLocation(program, "high");
+    uColour = glGetUniformLocation(program, "colour");
+    uShade = glGetUniformLocation(program, "shade");
+
+    glGenVertexArrays(1, &array);
+    glGenBuffers(1, &vertexBuffer);
+    glGenBuffers(1, &triangleBuffer);
+    glGenBuffers(1, &lineBuffer);
+
+    glBindVertexArray(array);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
+                          (const GLvoid *)(4 * sizeof(GLfloat)));
+    glBindVertexArray(0);
+
+    return true;
+  }
+
+  /**\brief Compile shader
+   *
+   * \param[in] type   The shader type, e.g. GL_VERTEX_SHADER.
+   * \param[in] source The shader's source code.
+   *
+   * \returns The shader, or 0 if it could not be compiled.
+   */
+  static GLuint compile(const GLenum &type, const char *source) {
+    const GLuint s = glCreateShader(type);
+    GLint ok = GL_FALSE;
+
+    glShaderSource(s, 1, &source, 0);
+    glCompileShader(s);
+    glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
+
+    if (ok != GL_TRUE) {
+      char log[1024] = "";
+      glGetShaderInfoLog(s, sizeof(log), 0, log);
+      std::cerr << "error: could not compile vertex projection shader: " << log
+                << "\n";
+      glDeleteShader(s);
+      return 0;
+    }
+
+    return s;
+  }
+
+  /**\brief Shader programme
+   *
+   * The linked shader, or 0 if it hasn't been created yet.
+   */
+  GLuint program;
+
+  /**\brief Vertex array
+   *
+   * Binds the vertex buffer to the shader's attributes.
+   */
+  GLuint array;
+
+  /**\brief Buffers
+   *
+   * The vertices, with eight coordinates each, and the indices of the
+   * triangles and lines to draw.
+   */
+  GLuint vertexBuffer, triangleBuffer, lineBuffer;
+
+  /**\brief Uniform locations
+   *
+   * The locations of the shader's uniforms.
+   */
+  GLint uLow, uHigh, uColour, uShade;
+
+  /**\brief Index counts
+   *
+   * The number of indices in the triangle and line buffers.
+   */
+  GLsizei triangles, lines;
+
+  /**\brief Shader failed?
+   *
+   * Set if the shader could not be compiled, so that it isn't tried again.
+   */
+  bool failed;
+};
+}
+}
+
+#endif
@@ -0,0 +1,377 @@
+/**\file
+ * \brief Input files
+ *
+ * Contains the code that loads the XML, SVG and JSON files passed to the
+ * frontends. Files are memory-mapped where possible, their format is guessed
+ * from the first few bytes so that each file is only parsed once, and lists
+ * of files can be loaded and parsed in parallel.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_INPUT_H)
+#define TOPOLOGIC_INPUT_H
+
+#include <topologic/compress.h>
+#include <topologic/registry.h>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace topologic {
+/**\brief Input files
+ *
+ * Contains the classes and functions used to load and parse input files.
+ */
+namespace input {
+/**\brief Input file formats
+ *
+ * The formats that an input file may be in, as guessed by sniff().
+ */
+enum format {
+  fUnknown, /**< Neither; try XML first, then JSON. */
+  fXML,     /**< XML or SVG metadata. */
+  fJSON     /**< A JSON state object. */
+};
+
+/**\brief Guess file format
+ *
+ * Looks at the first byte that isn't white space, after an optional UTF-8
+ * byte order mark: XML documents start with a '<' and JSON state objects
+ * start with a '{'.
+ *
+ * \param[in] data The file's contents.
+ * \param[in] size The size of the file, in bytes.
+ *
+ * \returns The file's likely format.
+ */
+static inline enum format sniff(const char *data, const std::size_t &size) {
+  std::size_t i = 0;
+
+  if ((size >= 3) && (std::memcmp(data, "\xEF\xBB\xBF", 3) == 0)) {
+    i = 3;
+  }
+
+  for (; i < size; i++) {
+    switch (data[i]) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+      continue;
+    case '<':
+      return fXML;
+    case '{':
+      return fJSON;
+    default:
+      return fUnknown;
+    }
+  }
+
+  return fUnknown;
+}
+
+/**\brief Input file
+ *
+ * Maps a file into memory, so that the parsers can read it without copying
+ * it first. Files that can't be mapped, e.g. pipes or empty files, are read
+ * into a buffer instead. gzip and zstd compressed files - e.g. .svgz files -
+ * are recognised by their contents and decompressed into the buffer.
+ */
+class file {
+public:
+  /**\brief Construct with file name
+   *
+   * Maps or reads the given file; check 'valid' to see if that worked.
+   *
+   * \param[in] filename The file to load.
+   */
+  file(const std::string &filename)
+      : data(0), size(0), valid(false), mapped(0) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      struct stat st;
+      if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+        void *p = mmap(0, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd,
+                       0);
+        if (p != MAP_FAILED) {
+          madvise(p, std::size_t(st.st_size), MADV_SEQUENTIAL);
+          mapped = p;
+          data = (const char *)p;
+          size = std::size_t(st.st_size);
+          valid = true;
+        }
+      }
+      close(fd);
+    }
+
+    if (!valid) {
+      std::ifstream in(filename);
+      if (in) {
+        std::istreambuf_iterator<char> eos;
+        buffer.assign(std::istreambuf_iterator<char>(in), eos);
+        data = buffer.data();
+        size = buffer.size();
+        valid = true;
+      }
+    }
+
+    if (valid && (compress::detect(data, size) != compress::mNone)) {
+      std::string decompressed;
+      valid = compress::decompress(data, size, decompressed);
+      if (mapped) {
+        munmap(mapped, size);
+        mapped = 0;
+      }
+      buffer.swap(decompressed);
+      data = buffer.data();
+      size = buffer.size();
+    }
+  }
+
+  /**\brief Copy constructor
+   *
+   * Deleted, as the mapping is owned by the instance.
+   */
+  file(const file &) = delete;
+
+  /**\brief Destructor
+   *
+   * Unmaps the file, if it was mapped.
+   */
+  ~file(void) {
+    if (mapped) {
+      munmap(mapped, size);
+    }
+  }
+
+  /**\brief File contents
+   *
+   * Points to the first byte of the file; not null-terminated.
+   */
+  const char *data;
+
+  /**\brief File size
+   *
+   * The number of bytes that 'data' points to.
+   */
+  std::size_t size;
+
+  /**\brief Was the file loaded?
+   *
+   * Set to 'true' by the constructor if the file could be mapped or read.
+   */
+  bool valid;
+
+protected:
+  /**\brief Mapped memory
+   *
+   * The address of the mapping, or 0 if the file was read into 'buffer'.
+   */
+  void *mapped;
+
+  /**\brief Read buffer
+   *
+   * Holds the file's contents if it couldn't be mapped.
+   */
+  std::string buffer;
+};
+
+/**\brief Initialise XML library
+ *
+ * Makes sure libxml2 is set up before any files are parsed, and cleaned up
+ * again when the programme exits. Safe to call from several threads.
+ */
+static inline void initialise(void) {
+#if !defined(NOLIBRARIES)
+  static const xml library;
+#endif
+}
+
+/**\brief Parsed input file
+ *
+ * Loads and parses an input file, as either XML or JSON, but doesn't touch
+ * any state object yet; use apply() for that. So documents may be created
+ * in parallel, while applying them must happen in order.
+ */
+class document {
+public:
+  /**\brief Construct with file name
+   *
+   * Loads and parses the given file. Files that look like XML are only
+   * parsed as XML, files that look like JSON only as JSON. Anything else is
+   * tried as XML first, and then as JSON.
+   *
+   * \param[in] filename The file to load.
+   */
+  document(const std::string &filename) : name(filename), valid(false) {
+    std::unique_ptr<const file> contents;
+    {
+      stats::scope timer(stats::tRead);
+      contents.reset(new file(filename));
+    }
+    const file &f = *contents;
+
+    if (!f.valid) {
+      std::cerr << "error: could not read " << filename << "\n";
+      return;
+    }
+
+    const enum format type = sniff(f.data, f.size);
+
+#if !defined(NOLIBRARIES)
+    if (type != fJSON) {
+      stats::scope timer(stats::tXML);
+      parser.reset(new xml::parser(f.data, f.size, filename));
+      if (parser->valid) {
+        valid = true;
+        return;
+      }
+      parser.reset();
+      if (type == fXML) {
+        return;
+      }
+    }
+#endif
+
+    stats::scope timer(stats::tJSON);
+    // libefgy's JSON reader only reads from a std::string, which it consumes
+    // as it goes, so the mapped file has to be copied once here.
+    std::string s(f.data, f.size);
+    s >> json;
+    valid = true;
+  }
+
+  /**\brief Copy constructor
+   *
+   * Deleted, as is the XML parser's.
+   */
+  document(const document &) = delete;
+
+  /**\brief File name
+   *
+   * The name of the file that the document was loaded from.
+   */
+  const std::string name;
+
+  /**\brief Was the file parsed?
+   *
+   * Set to 'true' by the constructor if the file was parsed as either XML
+   * or JSON.
+   */
+  bool valid;
+
+#if !defined(NOLIBRARIES)
+  /**\brief XML parser
+   *
+   * Holds the XML metadata if the file has been parsed as XML, or 0
+   * otherwise.
+   */
+  std::unique_ptr<xml::parser> parser;
+#endif
+
+  /**\brief JSON value
+   *
+   * Holds the JSON state object if the file has been parsed as JSON.
+   */
+  efgy::json::value<> json;
+};
+
+/**\brief Apply parsed file to state object
+ *
+ * Updates the state object and its model with the settings in the given
+ * document, as topologic::parse() and topologic::parseModel() would.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[out] topologicState The state object to update.
+ * \param[in]  doc            The parsed input file.
+ *
+ * \returns 'true' if the document was valid and has been applied.
+ */
+template <typename Q, std::size_t d>
+static bool apply(state<Q, d> &topologicState, document &doc) {
+  if (!doc.valid) {
+    return false;
+  }
+
+#if !defined(NOLIBRARIES)
+  if (doc.parser) {
+    stats::scope timer(stats::tXML);
+    parse(topologicState, *doc.parser);
+    parseModel(topologicState, *doc.parser);
+    return true;
+  }
+#endif
+
+  stats::scope timer(stats::tJSON);
+  parse(topologicState, doc.json);
+  parseModel(topologicState, doc.json);
+  return true;
+}
+
+/**\brief Load files
+ *
+ * Loads and parses all of the given files, using up to the given number of
+ * threads. Documents are stored in the same order as the file names, so
+ * applying them in order gives the same result no matter how many threads
+ * were used.
+ *
+ * \param[out] documents Receives one document per file.
+ * \param[in]  files     The files to load.
+ * \param[in]  threads   Number of threads to use; 0 for one per core.
+ */
+static inline void load(std::vector<std::unique_ptr<document>> &documents,
+                        const std::vector<std::string> &files,
+                        std::size_t threads) {
+  initialise();
+  documents.clear();
+  documents.resize(files.size());
+
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (threads > files.size()) {
+    threads = files.size();
+  }
+
+  if (threads <= 1) {
+    for (std::size_t i = 0; i < files.size(); i++) {
+      documents[i].reset(new document(files[i]));
+    }
+    return;
+  }
+
+  std::atomic<std::size_t> next(0);
+  std::vector<std::thread> workers;
+
+  for (std::size_t t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&documents, &files, &next]() {
+      for (std::size_t i = next++; i < files.size(); i = next++) {
+        documents[i].reset(new document(files[i]));
+      }
+    }));
+  }
+
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+}
+}
+
+#endif
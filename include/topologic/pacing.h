@@ -0,0 +1,282 @@
+/**\file
+ * \brief Frame pacing
+ *
+ * Contains the render loop of the OSX frontends, which draws frames in step
+ * with the display's refresh rate using a CVDisplayLink, and only while there
+ * is something to draw: once a frame reports that nothing is left to update,
+ * the display link is stopped until the frontend wakes it up again, e.g.
+ * because of user input.
+ *
+ * This file needs CoreVideo and libdispatch, so it can only be used on OSX.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_PACING_H)
+#define TOPOLOGIC_PACING_H
+
+#include <CoreVideo/CoreVideo.h>
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+
+namespace topologic {
+/**\brief Frame pacing
+ *
+ * Contains the classes used to pace the interactive frontends' rendering.
+ */
+namespace pacing {
+/**\brief Render loop
+ *
+ * Calls a frame function on the main thread at most once per refresh of the
+ * display, for as long as the frame function asks for more frames. The
+ * display link's thread only ever queues a frame if the previous one has
+ * already been drawn, so a frame that takes longer than a refresh makes the
+ * loop skip refreshes instead of piling up frames.
+ *
+ * All methods must be called on the main thread, which is also where the
+ * frame function is called.
+ */
+class loop {
+public:
+  /**\brief Frame function
+   *
+   * Called with the time, in seconds, since the previous frame - or since the
+   * loop was woken up, for the first frame after that. Returns 'true' if
+   * another frame is needed, e.g. because a model is still being refined,
+   * or 'false' to put the loop to sleep.
+   */
+  typedef std::function<bool(const double &)> frame;
+
+  /**\brief Construct with frame function
+   *
+   * Creates the display link; the loop starts out asleep.
+   *
+   * \param[in] pFrame The function that draws a frame.
+   */
+  loop(const frame &pFrame) : self(std::make_shared<core>(pFrame)) {
+    if (CVDisplayLinkCreateWithActiveCGDisplays(&self->link) !=
+        kCVReturnSuccess) {
+      std::cerr << "error: could not create display link\n";
+      self->link = 0;
+    } else {
+      CVDisplayLinkSetOutputCallback(self->link, output, self.get());
+    }
+  }
+
+  loop(const loop &) = delete;
+
+  /**\brief Destructor
+   *
+   * Stops the display link. Frames that have already been queued are
+   * dropped, so the frame function is never called after this.
+   */
+  ~loop(void) {
+    self->draw = frame();
+    self->stop();
+  }
+
+  /**\brief Follow OpenGL context
+   *
+   * Paces the loop to the refresh rate of the display that the given
+   * OpenGL context is shown on.
+   *
+   * \param[in] context     The OpenGL context.
+   * \param[in] pixelFormat The context's pixel format.
+   *
+   * \returns 'true' if the display link now follows the context.
+   */
+  bool attach(CGLContextObj context, CGLPixelFormatObj pixelFormat) {
+    return self->link && (CVDisplayLinkSetCurrentCGDisplayFromOpenGLContext(
+                              self->link, context, pixelFormat) ==
+                          kCVReturnSuccess);
+  }
+
+  /**\brief Wake up
+   *
+   * Has the frame function called on the next refresh of the display, and
+   * on every refresh after that until it returns 'false'. Waking up a loop
+   * that is already running does nothing, so any number of changes between
+   * two refreshes result in a single frame.
+   */
+  void wake(void) {
+    core &c = *self;
+    if (c.running) {
+      return;
+    }
+
+    c.running = true;
+    c.last = clock::now();
+
+    if (c.link) {
+      CVDisplayLinkStart(c.link);
+    } else {
+      // no display link to pace with - fall back to a timer.
+      c.queue(DISPATCH_TIME_NOW);
+    }
+  }
+
+  /**\brief Put to sleep
+   *
+   * Stops the display link, until the next call to wake().
+   */
+  void stop(void) { self->stop(); }
+
+  /**\brief Running?
+   *
+   * \returns 'true' if the loop is awake.
+   */
+  bool running(void) const { return self->running; }
+
+protected:
+  /**\brief Clock
+   *
+   * The clock used to measure the time between frames.
+   */
+  typedef std::chrono::steady_clock clock;
+
+  /**\brief Shared loop state
+   *
+   * Held by the loop and by each queued frame, so that a frame that is
+   * still queued when the loop is destroyed can find out that it should
+   * be dropped.
+   */
+  class core : public std::enable_shared_from_this<core> {
+  public:
+    /**\brief Construct with frame function
+     *
+     * \param[in] pDraw The function that draws a frame.
+     */
+    core(const frame &pDraw)
+        : link(0), draw(pDraw), pending(false), running(false) {}
+
+    /**\brief Destructor
+     *
+     * Releases the display link.
+     */
+    ~core(void) {
+      if (link) {
+        CVDisplayLinkRelease(link);
+      }
+    }
+
+    /**\brief Stop display link
+     *
+     * Stops the display link; once this returns, its callback isn't running
+     * and won't be called again until the link is restarted.
+     */
+    void stop(void) {
+      running = false;
+      if (link) {
+        CVDisplayLinkStop(link);
+      }
+    }
+
+    /**\brief Queue frame
+     *
+     * Queues a frame on the main thread, unless one is queued already.
+     *
+     * \param[in] when When to draw the frame.
+     */
+    void queue(const dispatch_time_t &when) {
+      if (!pending.exchange(true)) {
+        dispatch_after_f(when, dispatch_get_main_queue(),
+                         new std::shared_ptr<core>(shared_from_this()), tick);
+      }
+    }
+
+    /**\brief Display link
+     *
+     * The display link that queues frames, or 0 if it could not be created.
+     */
+    CVDisplayLinkRef link;
+
+    /**\brief Frame function
+     *
+     * The function that draws a frame; empty once the loop is destroyed.
+     */
+    frame draw;
+
+    /**\brief Frame queued?
+     *
+     * Set while a frame is queued on the main thread; this is the only
+     * member that the display link's thread uses.
+     */
+    std::atomic<bool> pending;
+
+    /**\brief Awake?
+     *
+     * Set while the loop is awake.
+     */
+    bool running;
+
+    /**\brief Previous frame
+     *
+     * When the previous frame was drawn, or when the loop was woken up.
+     */
+    clock::time_point last;
+  };
+
+  /**\brief Display link callback
+   *
+   * Called on the display link's thread for each refresh of the display;
+   * queues a frame on the main thread.
+   *
+   * \param[in] context The loop's core.
+   *
+   * \returns kCVReturnSuccess, always.
+   */
+  static CVReturn output(CVDisplayLinkRef, const CVTimeStamp *,
+                         const CVTimeStamp *, CVOptionFlags, CVOptionFlags *,
+                         void *context) {
+    static_cast<core *>(context)->queue(DISPATCH_TIME_NOW);
+    return kCVReturnSuccess;
+  }
+
+  /**\brief Draw frame
+   *
+   * Called on the main thread for each queued frame; calls the frame
+   * function and puts the loop to sleep if it doesn't need another frame.
+   *
+   * \param[in] context The queued reference to the loop's core.
+   */
+  static void tick(void *context) {
+    const std::unique_ptr<std::shared_ptr<core>> p(
+        static_cast<std::shared_ptr<core> *>(context));
+    core &c = **p;
+
+    c.pending = false;
+    if (!c.running || !c.draw) {
+      return;
+    }
+
+    const clock::time_point now = clock::now();
+    const double elapsed = std::chrono::duration<double>(now - c.last).count();
+    c.last = now;
+
+    if (!c.draw(elapsed)) {
+      c.stop();
+    } else if (!c.link) {
+      c.queue(dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC / 60));
+    }
+  }
+
+  /**\brief Loop state
+   *
+   * The state shared with the display link and any queued frame.
+   */
+  std::shared_ptr<core> self;
+};
+}
+}
+
+#endif
@@ -23,11 +23,10 @@
 #include <ef.gy/flame.h>
 #include <ef.gy/factory.h>
 #if !defined(NOLIBRARIES)
-#include <libxml/tree.h>
 #include <libxml/parser.h>
-#include <libxml/xpath.h>
-#include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 #endif
+#include <map>
 #include <set>
 #include <sstream>
 
@@ -87,6 +86,8 @@ public:
    *          the time the function returns.
    */
   static output apply(argument out, const format &tag) {
+    stats::scope timer(stats::tModel);
+
     if (out.model) {
       delete out.model;
       out.model = 0;
@@ -189,183 +190,149 @@ public:
    */
   ~xml(void) { xmlCleanupParser(); }
 
-  /**\brief XML parser instance
+  /**\brief Metadata element
    *
-   * Objects of this class are generated by the xml class to provide
-   * access to the parsed content of an XML file.
+   * An element in Topologic's namespace, as encountered by the parser.
    */
-  class parser {
+  class element {
   public:
-    /**\brief Construct with XML data and file name
+    /**\brief Element name
      *
-     * Uses libxml2 to parse the XML file data passed in as the first
-     * argument to this function, using the given file name as a basis
-     * for relative references.
-     *
-     * \param[in] data     A proper, well-formed XML document
-     * \param[in] filename The source location of the document
+     * The local name of the element, e.g. "camera" for a t:camera element.
      */
-    parser(const std::string &data, const std::string &filename)
-        : valid(false),
-          document(xmlReadMemory(data.data(), int(data.size()),
-                                 filename.c_str(), 0,
-                                 XML_PARSE_NOERROR | XML_PARSE_NOWARNING)),
-          xpathContext(0) {
-      if (document == 0) {
-        std::cerr << "failed to parse xml file " << filename << "\n";
-        return;
-      }
-
-      xpathContext = xmlXPathNewContext(document);
-      if (xpathContext == 0) {
-        xmlFreeDoc(document);
-        document = 0;
-        std::cerr << "failed to create XPath context\n";
-      }
-
-      if (xmlXPathRegisterNs(xpathContext, (const xmlChar *)"svg",
-                             (const xmlChar *)"http://www.w3.org/2000/svg") !=
-          0) {
-        xmlXPathFreeContext(xpathContext);
-        xpathContext = 0;
-        xmlFreeDoc(document);
-        document = 0;
-        std::cerr << "failed to register namespace: svg\n";
-      }
-
-      if (xmlXPathRegisterNs(xpathContext, (const xmlChar *)"topologic",
-                             (const xmlChar *)"http://ef.gy/2012/topologic") !=
-          0) {
-        xmlXPathFreeContext(xpathContext);
-        xpathContext = 0;
-        xmlFreeDoc(document);
-        document = 0;
-        std::cerr << "failed to register namespace: topologic\n";
-      }
+    std::string name;
 
-      valid = true;
-    }
-
-    /**\brief Copy constructor
+    /**\brief Attributes
      *
-     * The copy constructor is explicitly deleted for memory management
-     * reasons.
+     * Maps the element's attribute names to their values. Namespace
+     * declarations are not included, so the size of this map corresponds
+     * to XPath's count(@*).
      */
-    parser(const parser &) = delete;
+    std::map<std::string, std::string> attributes;
 
-    /**\brief Destructor
+    /**\brief Get attribute value
      *
-     * Destroys the XPath and XML document contexts associated with
-     * this instance.
+     * \param[in] attribute The name of the attribute to look up.
+     *
+     * \returns The attribute's value, or an empty string if the element
+     *          does not have that attribute.
      */
-    ~parser(void) {
-      if (xpathContext) {
-        xmlXPathFreeContext(xpathContext);
-      }
-
-      if (document) {
-        xmlFreeDoc(document);
-      }
+    const std::string attribute(const std::string &attribute) const {
+      const auto it = attributes.find(attribute);
+      return it == attributes.end() ? "" : it->second;
     }
+  };
 
-    /**\brief Evaluate XPath expression to string
-     *
-     * Evaluates the given XPath expression in the current context and
-     * returns the string result of an implicit XPath cast.
+  /**\brief XML parser instance
+   *
+   * Objects of this class are generated by the xml class to provide
+   * access to the metadata contained in an XML file.
+   */
+  class parser {
+  public:
+    /**\brief Construct with XML data and file name
      *
-     * \param[in] expression The XPath expression to evaluate.
+     * Streams through the XML file data passed in as the first argument
+     * using a libxml2 text reader, with the given file name as a basis for
+     * relative references. Every element in Topologic's namespace is
+     * recorded in the 'elements' vector along the way; no document tree is
+     * built and the data is only read once, so this stays fast even for
+     * large SVGs with little metadata in them.
      *
-     * \returns The string value of the given expression.
+     * \param[in] data     A proper, well-formed XML document
+     * \param[in] filename The source location of the document
      */
-    const std::string evaluate(const std::string &expression) {
-      xmlXPathObjectPtr xpathObject = lookup(expression);
-
-      const xmlChar *resultc =
-          xmlXPathCastNodeSetToString(xpathObject->nodesetval);
-      const std::string result((const char *)resultc);
-      free((void *)resultc);
-
-      xmlXPathFreeObject(xpathObject);
-
-      return result;
-    }
+    parser(const std::string &data, const std::string &filename)
+        : parser(data.data(), data.size(), filename) {}
 
-    /**\brief Evaluate XPath expression to XML fragment
-     *
-     * This method works much like the evaluate() method, but instead
-     * of returning the result of an implicit XPath cast to string,
-     * this instead returns the XML fragment that the expression
-     * returned.
+    /**\brief Construct with XML data buffer and file name
      *
-     * \param[in] expression The XPath expression to evaluate.
+     * Like the constructor above, but reads the document straight from the
+     * given buffer, e.g. a memory-mapped file, without copying it first.
      *
-     * \returns An XML fragment of the given expression's result.
+     * \param[in] data     Pointer to a proper, well-formed XML document
+     * \param[in] size     The size of the document, in bytes
+     * \param[in] filename The source location of the document
      */
-    const std::string evaluateToFragment(const std::string &expression) {
-      xmlXPathObjectPtr xpathObject = lookup(expression);
-
-      xmlBufferPtr buffer = xmlBufferCreate();
-      if (buffer == 0) {
-        std::cerr << "failed to create xmlBufferPtr\n";
-        return "";
+    parser(const char *data, const std::size_t &size,
+           const std::string &filename)
+        : valid(false) {
+      xmlTextReaderPtr reader =
+          xmlReaderForMemory(data, int(size), filename.c_str(), 0,
+                             XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+      if (reader == 0) {
+        std::cerr << "failed to create XML reader\n";
+        return;
       }
 
-      xmlNodeSetPtr nodeset = xpathObject->nodesetval;
+      int status;
+      while ((status = xmlTextReaderRead(reader)) == 1) {
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+          continue;
+        }
 
-      if ((nodeset == 0) || (nodeset->nodeNr < 1) || (nodeset->nodeTab == 0)) {
-        return "";
-      }
+        const xmlChar *uri = xmlTextReaderConstNamespaceUri(reader);
+        if ((uri == 0) ||
+            (xmlStrcmp(uri, (const xmlChar *)"http://ef.gy/2012/topologic") != 0)) {
+          continue;
+        }
 
-      if (xmlNodeDump(buffer, document, nodeset->nodeTab[0], 0, 0) == -1) {
-        std::cerr << "could not generate XML fragment\n";
-        return "";
+        element e;
+        e.name = (const char *)xmlTextReaderConstLocalName(reader);
+        while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+          if (xmlTextReaderIsNamespaceDecl(reader) == 1) {
+            continue;
+          }
+          const xmlChar *value = xmlTextReaderConstValue(reader);
+          e.attributes[(const char *)xmlTextReaderConstName(reader)] =
+              value ? (const char *)value : "";
+        }
+        xmlTextReaderMoveToElement(reader);
+
+        elements.push_back(e);
       }
 
-      const std::string rv((const char *)buffer->content, buffer->size);
+      xmlFreeTextReader(reader);
 
-      xmlBufferFree(buffer);
+      if (status != 0) {
+        elements.clear();
+        std::cerr << "failed to parse xml file " << filename << "\n";
+        return;
+      }
 
-      return rv;
+      valid = true;
     }
 
-    /**\brief Update XPath evaluation context
+    /**\brief Copy constructor
      *
-     * Evaluates the provided XPath expression and sets the current
-     * XPath context to the result of this expression.
+     * The copy constructor is explicitly deleted, as the parser is only
+     * meant to be passed on by reference.
+     */
+    parser(const parser &) = delete;
+
+    /**\brief Get first attribute value
      *
-     * The expression must return exactly one node, otherwise the
-     * context is not updated.
+     * Looks for the first element with the given name that has the given
+     * attribute, in document order. This is what an XPath query of the form
+     * //topologic:name/@attribute would have produced.
      *
-     * \param[in] expression An XPath expression that is evaluated in
-     *                       the current context and which must return
-     *                       precisely one result node.
+     * \param[in] name      The local name of the element to look for.
+     * \param[in] attribute The attribute to look up.
      *
-     * \returns 'true' if the context was updated successfully, 'false'
-     *          otherwise.
+     * \returns The attribute's value, or an empty string if there is no
+     *          such element.
      */
-    bool updateContext(const std::string &expression) {
-      xmlXPathObjectPtr xpathObject = lookup(expression);
-      xmlNodeSetPtr nodeset = xpathObject->nodesetval;
-
-      if ((nodeset == 0) || (nodeset->nodeNr < 1) || (nodeset->nodeTab == 0)) {
-        return false;
-      }
-
-      if (nodeset->nodeNr != 1) {
-        return false;
-      }
-
-      xmlNodePtr node = nodeset->nodeTab[0];
-
-      if (node == 0) {
-        return false;
+    const std::string first(const std::string &name,
+                            const std::string &attribute) const {
+      for (const element &e : elements) {
+        if (e.name == name) {
+          const auto it = e.attributes.find(attribute);
+          if (it != e.attributes.end()) {
+            return it->second;
+          }
+        }
       }
-
-      xpathContext->node = node;
-
-      xmlXPathFreeObject(xpathObject);
-
-      return true;
+      return "";
     }
 
     /**\brief Has a valid XML file been loaded?
@@ -375,43 +342,12 @@ public:
      */
     bool valid;
 
-  protected:
-    /**\brief libxml2 document context
-     *
-     * This is what libxml2 came up with by parsing the XML document
-     * provided to the constructor.
-     */
-    xmlDocPtr document;
-
-    /**\brief XPath evaluation context
-     *
-     * The current context in which XPath expressions are evaluated.
-     * Defaults to the root node of the document, but can be changed
-     * with the updateContext() method.
-     */
-    xmlXPathContextPtr xpathContext;
-
-    /**\brief Evaluate XPath expression
-     *
-     * This method will evaluate the given XPath expression in the
-     * current context and return the result. Errors are signaled by
-     * throwing a std::runtime_error.
+    /**\brief Metadata elements
      *
-     * \throws std::runtime_error if the given expression is invalid.
-     *
-     * \param[in] expression The XPath expression to evaluate
-     *
-     * \returns The result of the XPath expression after evaluation.
+     * All of the elements in Topologic's namespace that the document
+     * contains, in document order.
      */
-    xmlXPathObjectPtr lookup(const std::string &expression) {
-      xmlXPathObjectPtr xpathObject = xmlXPathEvalExpression(
-          (const xmlChar *)expression.c_str(), xpathContext);
-      if (xpathObject == 0) {
-        std::cerr << "failed to evaluate XPath expression\n";
-      }
-
-      return xpathObject;
-    }
+    std::vector<element> elements;
   };
 };
 
@@ -442,73 +378,68 @@ static bool parse(state<Q, d> &s, xml::parser &parser) {
   }
 
   std::stringstream st;
-  std::string value, dims, dimssq;
+  std::string value, dims;
   st << d;
   st >> dims;
   st.clear();
-  st.str("");
-  st << ((d + 1) * (d + 1));
-  st >> dimssq;
-  st.clear();
 
-  if (parser.updateContext("//topologic:camera[count(@*) = " + dims + "][1]")) {
-    do {
-      for (std::size_t i = 0; i < d; i++) {
-        if ((i == 0) && ((value = parser.evaluate("@radius")) != "")) {
-          s.fromp[0] = Q(std::stold(value));
+  s.dirty = true;
+
+  for (const xml::element &e : parser.elements) {
+    if ((e.name != "camera") || (e.attributes.size() != d)) {
+      continue;
+    }
+
+    for (std::size_t i = 0; i < d; i++) {
+      if ((i == 0) && ((value = e.attribute("radius")) != "")) {
+        s.fromp[0] = Q(std::stold(value));
+        continue;
+      } else {
+        st.str("");
+        st << "theta-" << i;
+        if ((value = e.attribute(st.str())) != "") {
+          s.fromp[i] = Q(std::stold(value));
           continue;
-        } else {
-          st.str("");
-          st << "@theta-" << i;
-          if ((value = parser.evaluate(st.str())) != "") {
-            s.fromp[i] = Q(std::stold(value));
-            continue;
-          }
         }
+      }
 
-        if (i < sizeof(cartesianDimensions)) {
-          char r[] = {'@', cartesianDimensions[i], 0};
-          if ((value = parser.evaluate(r)) != "") {
-            s.from[i] = Q(std::stold(value));
-          }
-        } else {
-          st.str("");
-          st << "@d-" << i;
-          if ((value = parser.evaluate(st.str())) != "") {
-            s.from[i] = Q(std::stold(value));
-          }
+      if (i < sizeof(cartesianDimensions)) {
+        const char r[] = {cartesianDimensions[i], 0};
+        if ((value = e.attribute(r)) != "") {
+          s.from[i] = Q(std::stold(value));
+        }
+      } else {
+        st.str("");
+        st << "d-" << i;
+        if ((value = e.attribute(st.str())) != "") {
+          s.from[i] = Q(std::stold(value));
         }
       }
-    } while (parser.updateContext(
-        "following-sibling::topologic:camera[count(@*) = " + dims + "][1]"));
+    }
   }
 
-  if (parser.updateContext("//topologic:transformation[@depth = " + dims +
-                           "][1]")) {
-    do {
-      if ((value = parser.evaluate("@matrix")) == "identity") {
-        s.transformation = efgy::geometry::transformation::affine<Q, d>();
-      }
-    } while (parser.updateContext(
-        "following-sibling::topologic:transformation[@depth = " + dims +
-        "][1]"));
-  }
-
-  if (parser.updateContext("//topologic:transformation[count(@*) = " + dimssq +
-                           "][1]")) {
-    do {
-      for (std::size_t i = 0; i <= d; i++) {
-        for (std::size_t j = 0; j <= d; j++) {
-          st.str("");
-          st << "@e" << i << "-" << j;
-          if ((value = parser.evaluate(st.str())) != "") {
-            s.transformation.matrix[i][j] = Q(std::stold(value));
-          }
+  for (const xml::element &e : parser.elements) {
+    if ((e.name == "transformation") && (e.attribute("depth") == dims) &&
+        (e.attribute("matrix") == "identity")) {
+      s.transformation = efgy::geometry::transformation::affine<Q, d>();
+    }
+  }
+
+  for (const xml::element &e : parser.elements) {
+    if ((e.name != "transformation") ||
+        (e.attributes.size() != (d + 1) * (d + 1))) {
+      continue;
+    }
+
+    for (std::size_t i = 0; i <= d; i++) {
+      for (std::size_t j = 0; j <= d; j++) {
+        st.str("");
+        st << "e" << i << "-" << j;
+        if ((value = e.attribute(st.str())) != "") {
+          s.transformation.matrix[i][j] = Q(std::stold(value));
         }
       }
-    } while (parser.updateContext(
-        "following-sibling::topologic:transformation[count(@*) = " + dimssq +
-        "][1]"));
+    }
   }
 
   return parse<Q, d - 1>(s, parser);
@@ -546,129 +477,71 @@ static bool parse(state<Q, 1> &s, xml::parser &parser) {
   }
 
   std::string value;
-  if ((value = parser.evaluate("//topologic:precision/@polar")) != "") {
+  if ((value = parser.first("precision", "polar")) != "") {
     s.parameter.precision = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:options/@radius")) != "") {
+  if ((value = parser.first("options", "radius")) != "") {
     s.parameter.radius = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:camera/@mode[1]")) != "") {
+  if ((value = parser.first("camera", "mode")) != "") {
     s.polarCoordinates = (value == "polar");
   }
-  if ((value = parser.evaluate("//topologic:colour-background/@red")) != "") {
+  if ((value = parser.first("colour-background", "red")) != "") {
     s.background.red = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-background/@green")) != "") {
+  if ((value = parser.first("colour-background", "green")) != "") {
     s.background.green = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-background/@blue")) != "") {
+  if ((value = parser.first("colour-background", "blue")) != "") {
     s.background.blue = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-background/@alpha")) != "") {
+  if ((value = parser.first("colour-background", "alpha")) != "") {
     s.background.alpha = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@red")) != "") {
+  if ((value = parser.first("colour-wireframe", "red")) != "") {
     s.wireframe.red = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@green")) != "") {
+  if ((value = parser.first("colour-wireframe", "green")) != "") {
     s.wireframe.green = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@blue")) != "") {
+  if ((value = parser.first("colour-wireframe", "blue")) != "") {
     s.wireframe.blue = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@alpha")) != "") {
+  if ((value = parser.first("colour-wireframe", "alpha")) != "") {
     s.wireframe.alpha = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-surface/@red")) != "") {
+  if ((value = parser.first("colour-surface", "red")) != "") {
     s.surface.red = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-surface/@green")) != "") {
+  if ((value = parser.first("colour-surface", "green")) != "") {
     s.surface.green = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-surface/@blue")) != "") {
+  if ((value = parser.first("colour-surface", "blue")) != "") {
     s.surface.blue = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:colour-surface/@alpha")) != "") {
+  if ((value = parser.first("colour-surface", "alpha")) != "") {
     s.surface.alpha = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:ifs/@iterations")) != "") {
+  if ((value = parser.first("ifs", "iterations")) != "") {
     s.parameter.iterations = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:ifs/@seed")) != "") {
+  if ((value = parser.first("ifs", "seed")) != "") {
     s.parameter.seed = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:ifs/@functions")) != "") {
+  if ((value = parser.first("ifs", "functions")) != "") {
     s.parameter.functions = Q(std::stold(value));
   }
-  if ((value = parser.evaluate("//topologic:ifs/@pre-rotate")) != "") {
+  if ((value = parser.first("ifs", "pre-rotate")) != "") {
     s.parameter.preRotate = (value == "yes");
   }
-  if ((value = parser.evaluate("//topologic:ifs/@post-rotate")) != "") {
+  if ((value = parser.first("ifs", "post-rotate")) != "") {
     s.parameter.postRotate = (value == "yes");
   }
-  if ((value = parser.evaluate("//topologic:flame/@coefficients")) != "") {
+  if ((value = parser.first("flame", "coefficients")) != "") {
     s.parameter.flameCoefficients = Q(std::stold(value));
   }
   return true;
 }
-
-/**\brief Parse and update model data
- *
- * Like topologic::parse(), this function uses an XML parser object
- * instance to update a topologic::state instance with the data contained
- * in the XML file. topologic::parse() won't update the model in the state
- * object, however, which is what this function is for.
- *
- * The reason this functionality was split into two functions, is that the
- * other parser step shouldn't have to worry about which renderer template
- * will be used for the model.
- *
- * \tparam Q    Base data type for calculations.
- * \tparam d    Maximum number of dimensions supported by the given state
- *              instance
- * \tparam func State object update functor, e.g.
- *              topologic::updateModel
- *
- * \param[out] s      The global state object to update.
- * \param[out] parser An XML parser instance, hopefully containing
- *                    Topologic metadata.
- *
- * \returns 'true' if things worked out, 'false' otherwise.
- */
-template <typename Q, std::size_t d,
-          template <typename, template <class, std::size_t> class,
-                    std::size_t, std::size_t, typename> class func>
-static bool parseModel(state<Q, d> &s, xml::parser &parser) {
-  if (!parser.valid) {
-    return false;
-  }
-
-  std::string format = "cartesian", value;
-  if ((value = parser.evaluate("//topologic:coordinates/@format")) != "") {
-    format = value;
-  }
-
-  if (parser.updateContext("//topologic:model[@depth][@type][1]")) {
-    int depth = std::stoi(parser.evaluate("@depth"));
-    int rdepth = depth;
-    std::string type = parser.evaluate("@type");
-    std::string value = parser.evaluate("@render-depth");
-    if (value != "") {
-      rdepth = std::stoi(value);
-    }
-
-    if (rdepth == 0) {
-      rdepth = depth;
-      if ((type == "sphere") || (type == "moebius-strip") ||
-          (type == "klein-bagle"))
-        rdepth++;
-    }
-
-    return efgy::geometry::with<Q, func, d>(s, format, type, depth, rdepth);
-  }
-
-  return false;
-}
 #endif
 
 /**\brief Parse JSON file contents and update global state object
@@ -694,6 +567,8 @@ static bool parse(state<Q, d> &s, efgy::json::value<> &value) {
 
   bool polar = (bool)value("polar");
 
+  s.dirty = true;
+
   if (value("camera").isArray()) {
     efgy::json::value<> &cameras = value("camera");
     for (efgy::json::value<> &c : cameras.toArray()) {
@@ -811,58 +686,6 @@ static bool parse(state<Q, 1> &s, efgy::json::value<> &value) {
 
   return true;
 }
-
-/**\brief Parse and update model data
- *
- * This is analogous to topologic::parseModel() with XML data; however, this
- * parses a JSON value instead of querying an XML parser.
- *
- * \tparam Q    Base data type for calculations.
- * \tparam d    Maximum number of dimensions supported by the given state
- *              instance
- * \tparam func State object update functor, e.g.
- *              topologic::updateModel
- *
- * \param[out] s      The global state object to update.
- * \param[out] value  A JSON value, hopefully containing Topologic metadata.
- *
- * \returns 'true' if things worked out, 'false' otherwise.
- */
-template <typename Q, std::size_t d,
-          template <typename, template <class, std::size_t> class,
-                    std::size_t, std::size_t, typename> class func>
-static bool parseModel(state<Q, d> &s, efgy::json::value<> &value) {
-  if (value.type != efgy::json::value<>::object) {
-    return false;
-  }
-
-  std::string type = "cube";
-  std::string format = "cartesian";
-  int depth = 4;
-  int rdepth = 4;
-
-  auto &cformat = value("coordinateFormat");
-  if (cformat.isString()) {
-    format = cformat.asString();
-  }
-
-  auto &cmodel = value("model");
-  if (cmodel.isString()) {
-    type = cmodel.asString();
-  }
-
-  auto &cdepth = value("depth");
-  if (cdepth.isNumber()) {
-    depth = cdepth.asNumber();
-  }
-
-  auto &crdepth = value("renderDepth");
-  if (crdepth.isNumber()) {
-    rdepth = crdepth.asNumber();
-  }
-
-  return efgy::geometry::with<Q, func, d>(s, format, type, depth, rdepth);
-}
 }
 
 #endif
@@ -0,0 +1,545 @@
+/**\file
+ * \brief Software rasteriser
+ *
+ * Contains a tiled, multithreaded software rasteriser and a PNG writer, so
+ * that models can be rendered straight to pixels on machines without an
+ * OpenGL context.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_RASTER_H)
+#define TOPOLOGIC_RASTER_H
+
+#include <topologic/view.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+namespace topologic {
+/**\brief Software rasteriser
+ *
+ * Contains the image buffer, the rasteriser and the PNG writer used by the
+ * PNG output mode.
+ */
+namespace raster {
+/**\brief Tile size
+ *
+ * Width and height, in pixels, of the tiles that images are split into. Each
+ * tile is rendered by a single worker thread.
+ */
+static const std::size_t tileSize = 64;
+
+/**\brief RGBA colour
+ *
+ * A colour with straight, i.e. not premultiplied, alpha.
+ */
+class colour {
+public:
+  float red, green, blue, alpha;
+};
+
+/**\brief Image buffer
+ *
+ * Holds the pixels of a rendered image as premultiplied RGBA floats.
+ */
+class image {
+public:
+  /**\brief Construct with size
+   *
+   * \param[in] pWidth  Width of the image, in pixels.
+   * \param[in] pHeight Height of the image, in pixels.
+   */
+  image(const std::size_t &pWidth, const std::size_t &pHeight)
+      : width(pWidth), height(pHeight), pixels(pWidth * pHeight * 4, 0.f) {}
+
+  /**\brief Blend colour into pixel
+   *
+   * Composites a colour over the given pixel.
+   *
+   * \param[in] x The pixel's column.
+   * \param[in] y The pixel's row.
+   * \param[in] c The colour to composite.
+   */
+  void blend(const std::size_t &x, const std::size_t &y, const colour &c) {
+    float *p = &pixels[(y * width + x) * 4];
+    const float a = 1.f - c.alpha;
+    p[0] = c.red * c.alpha + p[0] * a;
+    p[1] = c.green * c.alpha + p[1] * a;
+    p[2] = c.blue * c.alpha + p[2] * a;
+    p[3] = c.alpha + p[3] * a;
+  }
+
+  /**\brief Write PNG
+   *
+   * Writes the image as an 8-bit RGBA PNG file with straight alpha.
+   *
+   * \param[out] out   The stream to write to.
+   * \param[in]  level zlib compression level to use.
+   *
+   * \returns 'true' if the image was compressed and written successfully.
+   */
+  bool png(std::ostream &out, int level = 6) const {
+    std::vector<unsigned char> raw((width * 4 + 1) * height);
+
+    for (std::size_t y = 0, i = 0; y < height; y++) {
+      raw[i++] = 0;
+      for (std::size_t x = 0; x < width; x++) {
+        const float *p = &pixels[(y * width + x) * 4];
+        const float a = p[3];
+        for (std::size_t c = 0; c < 3; c++) {
+          raw[i++] = byte(a > 0.f ? p[c] / a : 0.f);
+        }
+        raw[i++] = byte(a);
+      }
+    }
+
+    uLongf length = compressBound(raw.size());
+    std::vector<unsigned char> data(length);
+    if (compress2(data.data(), &length, raw.data(), raw.size(), level) !=
+        Z_OK) {
+      return false;
+    }
+    data.resize(length);
+
+    std::vector<unsigned char> header;
+    big(header, width);
+    big(header, height);
+    header.push_back(8);
+    header.push_back(6);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    out.write("\x89PNG\r\n\x1a\n", 8);
+    chunk(out, "IHDR", header);
+    chunk(out, "IDAT", data);
+    chunk(out, "IEND", std::vector<unsigned char>());
+
+    return bool(out);
+  }
+
+  /**\brief Image width
+   *
+   * In pixels.
+   */
+  const std::size_t width;
+
+  /**\brief Image height
+   *
+   * In pixels.
+   */
+  const std::size_t height;
+
+  /**\brief Pixel data
+   *
+   * Premultiplied RGBA values, row by row, starting at the top left.
+   */
+  std::vector<float> pixels;
+
+protected:
+  static unsigned char byte(const float &v) {
+    return v <= 0.f ? 0 : v >= 1.f ? 255 : (unsigned char)(v * 255.f + 0.5f);
+  }
+
+  static void big(std::vector<unsigned char> &out, const std::uint32_t &v) {
+    out.push_back((v >> 24) & 0xff);
+    out.push_back((v >> 16) & 0xff);
+    out.push_back((v >> 8) & 0xff);
+    out.push_back(v & 0xff);
+  }
+
+  static void chunk(std::ostream &out, const char *type,
+                    const std::vector<unsigned char> &data) {
+    std::vector<unsigned char> length;
+    big(length, data.size());
+    out.write((const char *)length.data(), 4);
+    out.write(type, 4);
+    out.write((const char *)data.data(), data.size());
+
+    uLong crc = crc32(0, (const Bytef *)type, 4);
+    if (!data.empty()) {
+      crc = crc32(crc, data.data(), data.size());
+    }
+    std::vector<unsigned char> c;
+    big(c, crc);
+    out.write((const char *)c.data(), 4);
+  }
+};
+
+/**\brief Tiled rasteriser
+ *
+ * Fills projected faces into an image. The image is split into tiles, which
+ * are handed out to a pool of worker threads; a face is only looked at by
+ * the tiles that its bounding box overlaps. Each tile composites its faces in
+ * model order, just like an SVG renderer paints its paths, so the output
+ * doesn't depend on the number of threads.
+ *
+ * Vertices are mapped to pixels the same way the SVG output's viewBox maps
+ * them: the square from (-1.2,-1.2) to (1.2,1.2) is scaled to fit the image
+ * and centred in it.
+ */
+class rasteriser {
+public:
+  /**\brief Construct with image and geometry
+   *
+   * \tparam Q Base data type of the projected vertices.
+   *
+   * \param[out] pImage   The image to render to.
+   * \param[in]  vertices The projected vertices of all faces.
+   * \param[in]  pOffsets The index of each face's first vertex, plus the
+   *                      number of vertices at the end.
+   */
+  template <typename Q>
+  rasteriser(image &pImage, const view::vertices<Q, 2> &vertices,
+             const arena::vector<std::size_t> &pOffsets)
+      : target(pImage), offsets(pOffsets),
+        tilesX((pImage.width + tileSize - 1) / tileSize),
+        tilesY((pImage.height + tileSize - 1) / tileSize),
+        bins(tilesX * tilesY) {
+    const float scale = float(std::min(target.width, target.height)) / 2.4f;
+    const float ox = float(target.width) / 2.f;
+    const float oy = float(target.height) / 2.f;
+
+    x.resize(vertices.size());
+    y.resize(vertices.size());
+    for (std::size_t v = 0; v < vertices.size(); v++) {
+      x[v] = ox + float(vertices.lane[0][v]) * scale;
+      y[v] = oy + float(vertices.lane[1][v]) * scale;
+    }
+
+    for (std::size_t f = 0; f + 1 < offsets.size(); f++) {
+      if (offsets[f] == offsets[f + 1]) {
+        continue;
+      }
+
+      float x0 = x[offsets[f]], x1 = x0, y0 = y[offsets[f]], y1 = y0;
+      for (std::size_t v = offsets[f]; v < offsets[f + 1]; v++) {
+        x0 = std::min(x0, x[v]);
+        x1 = std::max(x1, x[v]);
+        y0 = std::min(y0, y[v]);
+        y1 = std::max(y1, y[v]);
+      }
+
+      if (!(x1 >= 0.f) || !(y1 >= 0.f) || !(x0 < float(target.width)) ||
+          !(y0 < float(target.height))) {
+        continue;
+      }
+
+      const std::size_t tx0 = tile(x0, tilesX), tx1 = tile(x1, tilesX);
+      const std::size_t ty0 = tile(y0, tilesY), ty1 = tile(y1, tilesY);
+      for (std::size_t ty = ty0; ty <= ty1; ty++) {
+        for (std::size_t tx = tx0; tx <= tx1; tx++) {
+          bins[ty * tilesX + tx].push_back(std::uint32_t(f));
+        }
+      }
+    }
+  }
+
+  /**\brief Render faces
+   *
+   * Clears the image to the background colour, then fills all of the faces
+   * with the surface colour and outlines them with the wireframe colour.
+   *
+   * \param[in] background Background colour.
+   * \param[in] wireframe  Colour of face outlines.
+   * \param[in] surface    Colour of face interiors.
+   * \param[in] threads    Number of worker threads; 0 for one per core.
+   */
+  void render(const colour &background, const colour &wireframe,
+              const colour &surface, std::size_t threads = 0) {
+    parallel(threads, [&](const std::size_t &t) {
+      std::size_t x0, y0, x1, y1;
+      bounds(t, x0, y0, x1, y1);
+
+      for (std::size_t py = y0; py < y1; py++) {
+        for (std::size_t px = x0; px < x1; px++) {
+          target.blend(px, py, background);
+        }
+      }
+
+      for (const std::uint32_t &f : bins[t]) {
+        fill(f, x0, y0, x1, y1, [&](const std::size_t &px,
+                                    const std::size_t &py) {
+          target.blend(px, py, surface);
+        });
+        outline(f, x0, y0, x1, y1, [&](const std::size_t &px,
+                                       const std::size_t &py) {
+          target.blend(px, py, wireframe);
+        });
+      }
+    });
+  }
+
+  /**\brief Render faces with fractal flame colouring
+   *
+   * Accumulates a histogram of how often each pixel is covered, along with
+   * the average colour of the covering faces, which are coloured by their
+   * position in the model. The histogram is then mapped to the image with
+   * log-density tone mapping over the background colour, as described in the
+   * fractal flame paper.
+   *
+   * \param[in] background Background colour.
+   * \param[in] threads    Number of worker threads; 0 for one per core.
+   *
+   * \see http://flam3.com/flame_draves.pdf for the original paper
+   *      describing this colouring algorithm.
+   */
+  void flame(const colour &background, std::size_t threads = 0) {
+    const std::size_t n = target.width * target.height;
+    const std::size_t faces = offsets.empty() ? 0 : offsets.size() - 1;
+    std::vector<float> count(n, 0.f);
+    std::vector<float> sum(n * 3, 0.f);
+    std::vector<float> peak(tilesX * tilesY, 0.f);
+
+    parallel(threads, [&](const std::size_t &t) {
+      std::size_t x0, y0, x1, y1;
+      bounds(t, x0, y0, x1, y1);
+
+      for (const std::uint32_t &f : bins[t]) {
+        const colour c = palette(float(f) / float(faces));
+        fill(f, x0, y0, x1, y1, [&](const std::size_t &px,
+                                    const std::size_t &py) {
+          const std::size_t i = py * target.width + px;
+          count[i] += 1.f;
+          sum[i * 3] += c.red;
+          sum[i * 3 + 1] += c.green;
+          sum[i * 3 + 2] += c.blue;
+          peak[t] = std::max(peak[t], count[i]);
+        });
+      }
+    });
+
+    const float scale =
+        1.f / std::log1p(std::max(1.f, *std::max_element(peak.begin(),
+                                                          peak.end())));
+
+    parallel(threads, [&](const std::size_t &t) {
+      std::size_t x0, y0, x1, y1;
+      bounds(t, x0, y0, x1, y1);
+
+      for (std::size_t py = y0; py < y1; py++) {
+        for (std::size_t px = x0; px < x1; px++) {
+          const std::size_t i = py * target.width + px;
+          target.blend(px, py, background);
+          if (count[i] > 0.f) {
+            const colour c = {sum[i * 3] / count[i], sum[i * 3 + 1] / count[i],
+                              sum[i * 3 + 2] / count[i],
+                              std::log1p(count[i]) * scale};
+            target.blend(px, py, c);
+          }
+        }
+      }
+    });
+  }
+
+protected:
+  /**\brief Tile index for coordinate
+   *
+   * \param[in] v     A pixel coordinate.
+   * \param[in] tiles Number of tiles along that axis.
+   *
+   * \returns The index of the tile containing 'v', clamped to the image.
+   */
+  static std::size_t tile(const float &v, const std::size_t &tiles) {
+    if (!(v > 0.f)) {
+      return 0;
+    }
+    return std::min(std::size_t(v) / tileSize, tiles - 1);
+  }
+
+  /**\brief Get tile bounds
+   *
+   * \param[in]  t  The index of the tile.
+   * \param[out] x0 First column of the tile.
+   * \param[out] y0 First row of the tile.
+   * \param[out] x1 One past the last column of the tile.
+   * \param[out] y1 One past the last row of the tile.
+   */
+  void bounds(const std::size_t &t, std::size_t &x0, std::size_t &y0,
+              std::size_t &x1, std::size_t &y1) const {
+    x0 = (t % tilesX) * tileSize;
+    y0 = (t / tilesX) * tileSize;
+    x1 = std::min(x0 + tileSize, target.width);
+    y1 = std::min(y0 + tileSize, target.height);
+  }
+
+  /**\brief Run over all tiles in parallel
+   *
+   * Hands out tiles to a pool of worker threads, one tile at a time.
+   *
+   * \param[in] threads Number of worker threads; 0 for one per core.
+   * \param[in] f       Function to call with each tile's index.
+   */
+  template <typename F> void parallel(std::size_t threads, const F &f) {
+    const std::size_t tiles = tilesX * tilesY;
+    std::atomic<std::size_t> next(0);
+    std::vector<std::thread> workers;
+
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threads > tiles) {
+      threads = tiles;
+    }
+
+    for (std::size_t w = 1; w < threads; w++) {
+      workers.push_back(std::thread([&]() {
+        for (std::size_t t = next++; t < tiles; t = next++) {
+          f(t);
+        }
+      }));
+    }
+
+    for (std::size_t t = next++; t < tiles; t = next++) {
+      f(t);
+    }
+
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+
+  /**\brief Fill face
+   *
+   * Scan converts a face with the even-odd rule, sampling at pixel centres,
+   * and calls a function for each covered pixel within the given tile.
+   *
+   * \param[in] f     Index of the face to fill.
+   * \param[in] x0    First column of the tile.
+   * \param[in] y0    First row of the tile.
+   * \param[in] x1    One past the last column of the tile.
+   * \param[in] y1    One past the last row of the tile.
+   * \param[in] plot  Function to call with each covered pixel.
+   */
+  template <typename F>
+  void fill(const std::size_t &f, const std::size_t &x0, const std::size_t &y0,
+            const std::size_t &x1, const std::size_t &y1,
+            const F &plot) const {
+    const std::size_t b = offsets[f], e = offsets[f + 1];
+    std::vector<float> crossings;
+
+    for (std::size_t py = y0; py < y1; py++) {
+      const float cy = float(py) + 0.5f;
+      crossings.clear();
+
+      for (std::size_t v = b; v < e; v++) {
+        const std::size_t w = (v + 1 < e) ? v + 1 : b;
+        const float ya = y[v], yb = y[w];
+        if ((ya <= cy) != (yb <= cy)) {
+          crossings.push_back(x[v] + (cy - ya) / (yb - ya) * (x[w] - x[v]));
+        }
+      }
+
+      std::sort(crossings.begin(), crossings.end());
+
+      for (std::size_t i = 0; i + 1 < crossings.size(); i += 2) {
+        const float a = std::max(std::ceil(crossings[i] - 0.5f), float(x0));
+        const float z =
+            std::min(std::ceil(crossings[i + 1] - 0.5f), float(x1));
+        for (float px = a; px < z; px++) {
+          plot(std::size_t(px), py);
+        }
+      }
+    }
+  }
+
+  /**\brief Outline face
+   *
+   * Draws a hairline along each of the face's edges and calls a function for
+   * each pixel on it within the given tile. Each vertex is only plotted once,
+   * so outlines don't get darker at the corners.
+   *
+   * \param[in] f     Index of the face to outline.
+   * \param[in] x0    First column of the tile.
+   * \param[in] y0    First row of the tile.
+   * \param[in] x1    One past the last column of the tile.
+   * \param[in] y1    One past the last row of the tile.
+   * \param[in] plot  Function to call with each pixel on the outline.
+   */
+  template <typename F>
+  void outline(const std::size_t &f, const std::size_t &x0,
+               const std::size_t &y0, const std::size_t &x1,
+               const std::size_t &y1, const F &plot) const {
+    const std::size_t b = offsets[f], e = offsets[f + 1];
+
+    for (std::size_t v = b; v < e; v++) {
+      const std::size_t w = (v + 1 < e) ? v + 1 : b;
+      const float dx = x[w] - x[v], dy = y[w] - y[v];
+      const float steps = std::ceil(std::max(std::fabs(dx), std::fabs(dy)));
+
+      if (!(steps < float(target.width + target.height) * 4.f)) {
+        continue;
+      }
+
+      for (float s = 0; s < std::max(steps, 1.f); s++) {
+        const float t = steps > 0.f ? s / steps : 0.f;
+        const float px = std::floor(x[v] + dx * t);
+        const float py = std::floor(y[v] + dy * t);
+        if (px >= float(x0) && px < float(x1) && py >= float(y0) &&
+            py < float(y1)) {
+          plot(std::size_t(px), std::size_t(py));
+        }
+      }
+    }
+  }
+
+  /**\brief Flame palette
+   *
+   * Maps a position in [0,1) to a fully saturated hue.
+   *
+   * \param[in] p The position to map.
+   *
+   * \returns The colour for that position.
+   */
+  static colour palette(const float &p) {
+    const float h = (p - std::floor(p)) * 6.f;
+    const float f = h - std::floor(h);
+    switch (int(h)) {
+    case 0:
+      return {1.f, f, 0.f, 1.f};
+    case 1:
+      return {1.f - f, 1.f, 0.f, 1.f};
+    case 2:
+      return {0.f, 1.f, f, 1.f};
+    case 3:
+      return {0.f, 1.f - f, 1.f, 1.f};
+    case 4:
+      return {f, 0.f, 1.f, 1.f};
+    default:
+      return {1.f, 0.f, 1.f - f, 1.f};
+    }
+  }
+
+  image &target;
+  const arena::vector<std::size_t> &offsets;
+  const std::size_t tilesX;
+  const std::size_t tilesY;
+
+  /**\brief Pixel coordinates
+   *
+   * The vertices' positions in the image.
+   */
+  std::vector<float> x, y;
+
+  /**\brief Tile bins
+   *
+   * The faces whose bounding boxes overlap each tile, in model order.
+   */
+  std::vector<std::vector<std::uint32_t>> bins;
+};
+}
+}
+
+#endif
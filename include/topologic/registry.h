@@ -0,0 +1,375 @@
+/**\file
+ * \brief Model registry
+ *
+ * Contains the model registry, which maps model type, vector format, model
+ * depth and render depth to a factory that creates the matching renderer.
+ * The registry is filled once, the first time it is used, so selecting a
+ * model later on is a single hash table lookup instead of a search through
+ * every model, format and depth combination. The XML and JSON parsers' model
+ * selection, parseModel(), is here as well, as it goes through the registry.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_REGISTRY_H)
+#define TOPOLOGIC_REGISTRY_H
+
+#include <topologic/parse.h>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace topologic {
+/**\brief Model registry
+ *
+ * Holds a factory for every model that a state object of the given type can
+ * render. Use common() to get the registry that has all of the models known
+ * to libefgy; frontends may add their own models to other instances with
+ * add().
+ *
+ * \tparam Q   Base data type as used in the topologic::state instance
+ * \tparam dim Maximum render depth of the topologic::state instance
+ */
+template <typename Q, std::size_t dim> class registry {
+public:
+  /**\brief Model factory
+   *
+   * Replaces the model of the given state object with a new instance of the
+   * model that the factory was registered for.
+   */
+  typedef std::function<bool(state<Q, dim> &)> factory;
+
+  /**\brief Registry entry
+   *
+   * Describes a single model, format and depth combination.
+   */
+  class entry {
+  public:
+    std::string model;
+    std::string format;
+    std::size_t depth;
+    std::size_t renderDepth;
+    factory create;
+  };
+
+  /**\brief Registration functor
+   *
+   * Used with efgy::geometry::with to add every model that libefgy knows
+   * about to a registry. The factories it adds use topologic::updateModel,
+   * so models are created exactly as before.
+   *
+   * \tparam tQ     Base type for calculations.
+   * \tparam T      Model template class to use, e.g. efgy::geometry::cube
+   * \tparam d      Number of model dimensions, e.g. 4 for a tesseract
+   * \tparam e      Number of render dimensions, e.g. >= 4 for a tesseract
+   * \tparam format The vector format to use.
+   */
+  template <typename tQ, template <class, std::size_t> class T, std::size_t d,
+            std::size_t e, typename format>
+  class enrol {
+  public:
+    typedef registry &argument;
+    typedef registry &output;
+
+    template <class aQ, std::size_t aD>
+    using adapted = efgy::geometry::autoAdapt<aQ, e, T<aQ, aD>, format>;
+
+    static output apply(argument out, const format &tag) {
+      out.add(adapted<tQ, d>::id(), format::id(), d, e,
+              [tag](state<Q, dim> &s) -> bool {
+        return updateModel<Q, T, d, e, format>::apply(s, tag);
+      });
+      return out;
+    }
+
+    static output pass(argument out) { return out; }
+  };
+
+  /**\brief Default constructor
+   *
+   * Creates an empty registry.
+   */
+  registry(void) {}
+
+  /**\brief Common registry
+   *
+   * The registry with all of libefgy's models, up to the state's maximum
+   * render depth. It is filled the first time this function is called,
+   * which is safe to do from several threads.
+   *
+   * \returns The common registry.
+   */
+  static const registry &common(void) {
+    static const registry r(true);
+    return r;
+  }
+
+  /**\brief Add model
+   *
+   * Registers a factory for the given model parameters. Later registrations
+   * with the same parameters replace earlier ones.
+   *
+   * \param[in] model  The model type, e.g. "cube".
+   * \param[in] format The vector coordinate format, e.g. "cartesian".
+   * \param[in] depth  The model depth.
+   * \param[in] rdepth The render depth.
+   * \param[in] create The factory for the model.
+   */
+  void add(const std::string &model, const std::string &format,
+           const std::size_t &depth, const std::size_t &rdepth,
+           const factory &create) {
+    const std::string k = key(model, format, depth, rdepth);
+    const auto it = index.find(k);
+    const entry e = {model, format, depth, rdepth, create};
+
+    if (it != index.end()) {
+      entries[it->second] = e;
+    } else {
+      index[k] = entries.size();
+      entries.push_back(e);
+    }
+  }
+
+  /**\brief Create model
+   *
+   * Looks up the factory for the given parameters and uses it to replace
+   * the state's model.
+   *
+   * \param[out] s      The state object to update.
+   * \param[in]  format The vector coordinate format to use.
+   * \param[in]  model  The model type, e.g. "cube".
+   * \param[in]  depth  The model depth.
+   * \param[in]  rdepth The render depth.
+   *
+   * \returns 'true' if the state object has a model when the function
+   *          returns, as with efgy::geometry::with and updateModel.
+   */
+  bool create(state<Q, dim> &s, const std::string &format,
+              const std::string &model, const std::size_t &depth,
+              const std::size_t &rdepth) const {
+    const auto it = index.find(key(model, format, depth, rdepth));
+    if (it == index.end()) {
+      return s.model != 0;
+    }
+    return entries[it->second].create(s);
+  }
+
+  /**\brief Model types
+   *
+   * \returns The ids of all of the registered models.
+   */
+  std::set<std::string> models(void) const {
+    std::set<std::string> r;
+    for (const entry &e : entries) {
+      r.insert(e.model);
+    }
+    return r;
+  }
+
+  /**\brief Vector formats
+   *
+   * \param[in] model The model type to list formats for, or "*" for all.
+   *
+   * \returns The formats that the given model is registered with.
+   */
+  std::set<std::string> formats(const std::string &model = "*") const {
+    std::set<std::string> r;
+    for (const entry &e : entries) {
+      if ((model == "*") || (model == e.model)) {
+        r.insert(e.format);
+      }
+    }
+    return r;
+  }
+
+  /**\brief Model depths
+   *
+   * \param[in] model The model type to list depths for, or "*" for all.
+   *
+   * \returns The depths that the given model is registered with.
+   */
+  std::set<std::size_t> modelDimensions(const std::string &model = "*") const {
+    std::set<std::size_t> r;
+    for (const entry &e : entries) {
+      if ((model == "*") || (model == e.model)) {
+        r.insert(e.depth);
+      }
+    }
+    return r;
+  }
+
+  /**\brief Render depths
+   *
+   * \param[in] model The model type to list render depths for, or "*" for
+   *                  all.
+   * \param[in] depth The model depth to list render depths for, or 0 for
+   *                  all.
+   *
+   * \returns The render depths that the given model is registered with.
+   */
+  std::set<std::size_t> renderDimensions(const std::string &model = "*",
+                                         const std::size_t &depth = 0) const {
+    std::set<std::size_t> r;
+    for (const entry &e : entries) {
+      if (((model == "*") || (model == e.model)) &&
+          ((depth == 0) || (depth == e.depth))) {
+        r.insert(e.renderDepth);
+      }
+    }
+    return r;
+  }
+
+  /**\brief Registered models
+   *
+   * All of the entries in the registry, in the order they were added.
+   */
+  std::vector<entry> entries;
+
+protected:
+  /**\brief Construct common registry
+   *
+   * Adds all of libefgy's models with efgy::geometry::with.
+   */
+  registry(bool) {
+    efgy::geometry::with<Q, enrol, dim>(*this, "*", "*", 0, 0);
+  }
+
+  /**\brief Lookup key
+   *
+   * Uses the same D-MODEL@R:FORMAT form as the 'model' option.
+   *
+   * \returns A key for the given model parameters.
+   */
+  static std::string key(const std::string &model, const std::string &format,
+                         const std::size_t &depth, const std::size_t &rdepth) {
+    return std::to_string(depth) + "-" + model + "@" + std::to_string(rdepth) +
+           ":" + format;
+  }
+
+  /**\brief Entry index
+   *
+   * Maps lookup keys to positions in the entry list.
+   */
+  std::unordered_map<std::string, std::size_t> index;
+};
+
+#if !defined(NOLIBRARIES)
+/**\brief Parse and update model data
+ *
+ * Like topologic::parse(), this function uses an XML parser object
+ * instance to update a topologic::state instance with the data contained
+ * in the XML file. topologic::parse() won't update the model in the state
+ * object, however, which is what this function is for.
+ *
+ * The reason this functionality was split into two functions, is that the
+ * other parser step shouldn't have to worry about which renderer template
+ * will be used for the model; the model is created with the common
+ * registry's factory for it.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Maximum number of dimensions supported by the given state
+ *           instance
+ *
+ * \param[out] s      The global state object to update.
+ * \param[out] parser An XML parser instance, hopefully containing
+ *                    Topologic metadata.
+ *
+ * \returns 'true' if things worked out, 'false' otherwise.
+ */
+template <typename Q, std::size_t d>
+static bool parseModel(state<Q, d> &s, xml::parser &parser) {
+  if (!parser.valid) {
+    return false;
+  }
+
+  std::string format = "cartesian", value;
+  if ((value = parser.first("coordinates", "format")) != "") {
+    format = value;
+  }
+
+  for (const xml::element &e : parser.elements) {
+    if ((e.name != "model") || (e.attribute("depth") == "") ||
+        (e.attribute("type") == "")) {
+      continue;
+    }
+
+    int depth = std::stoi(e.attribute("depth"));
+    int rdepth = depth;
+    std::string type = e.attribute("type");
+    std::string value = e.attribute("render-depth");
+    if (value != "") {
+      rdepth = std::stoi(value);
+    }
+
+    if (rdepth == 0) {
+      rdepth = depth;
+      if ((type == "sphere") || (type == "moebius-strip") ||
+          (type == "klein-bagle"))
+        rdepth++;
+    }
+
+    return registry<Q, d>::common().create(s, format, type, depth, rdepth);
+  }
+
+  return false;
+}
+#endif
+
+/**\brief Parse and update model data
+ *
+ * This is analogous to topologic::parseModel() with XML data; however, this
+ * parses a JSON value instead of querying an XML parser.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Maximum number of dimensions supported by the given state
+ *           instance
+ *
+ * \param[out] s      The global state object to update.
+ * \param[out] value  A JSON value, hopefully containing Topologic metadata.
+ *
+ * \returns 'true' if things worked out, 'false' otherwise.
+ */
+template <typename Q, std::size_t d>
+static bool parseModel(state<Q, d> &s, efgy::json::value<> &value) {
+  if (value.type != efgy::json::value<>::object) {
+    return false;
+  }
+
+  std::string type = "cube";
+  std::string format = "cartesian";
+  int depth = 4;
+  int rdepth = 4;
+
+  auto &cformat = value("coordinateFormat");
+  if (cformat.isString()) {
+    format = cformat.asString();
+  }
+
+  auto &cmodel = value("model");
+  if (cmodel.isString()) {
+    type = cmodel.asString();
+  }
+
+  auto &cdepth = value("depth");
+  if (cdepth.isNumber()) {
+    depth = cdepth.asNumber();
+  }
+
+  auto &crdepth = value("renderDepth");
+  if (crdepth.isNumber()) {
+    rdepth = crdepth.asNumber();
+  }
+
+  return registry<Q, d>::common().create(s, format, type, depth, rdepth);
+}
+}
+
+#endif
@@ -19,9 +19,30 @@
 #define TOPOLOGIC_RENDER_H
 
 #include <ef.gy/render-svg.h>
+#include <ef.gy/render-xml.h>
 #if !defined(NO_OPENGL)
 #include <ef.gy/render-opengl.h>
+#if !defined(GL_ES_VERSION_2_0)
+#include <topologic/gpu.h>
 #endif
+#endif
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+#include <topologic/buffer.h>
+#include <topologic/raster.h>
+#include <topologic/stats.h>
+#include <topologic/view.h>
 
 namespace topologic {
 /**\brief Cartesian dimension shorthands
@@ -123,6 +144,163 @@ public:
   bool update;
 };
 
+/**\brief Geometry parameters used to build a model
+ *
+ * Keeps a copy of the model parameters that affect the geometry of a model,
+ * as opposed to the camera, transformation or colours. Two models with the
+ * same type and the same parameters have identical faces.
+ *
+ * \tparam Q Base data type for calculations.
+ */
+template <typename Q> class parameters {
+public:
+  /**\brief Construct with model parameters
+   *
+   * Copies the relevant fields of the given libefgy parameter object.
+   *
+   * \param[in] p The parameters to copy.
+   */
+  parameters(const efgy::geometry::parameters<Q> &p)
+      : radius(p.radius), radius2(p.radius2), constant(p.constant),
+        precision(p.precision), iterations(p.iterations), functions(p.functions),
+        seed(p.seed), flameCoefficients(p.flameCoefficients),
+        preRotate(p.preRotate), postRotate(p.postRotate) {}
+
+  /**\brief Compare parameters
+   *
+   * \param[in] b The parameters to compare to.
+   *
+   * \returns 'true' if all of the fields are identical.
+   */
+  bool operator==(const parameters &b) const {
+    return (radius == b.radius) && (radius2 == b.radius2) &&
+           (constant == b.constant) && (precision == b.precision) &&
+           (iterations == b.iterations) && (functions == b.functions) &&
+           (seed == b.seed) && (flameCoefficients == b.flameCoefficients) &&
+           (preRotate == b.preRotate) && (postRotate == b.postRotate);
+  }
+
+  /**\brief Compare parameters
+   *
+   * \param[in] b The parameters to compare to.
+   *
+   * \returns 'true' if any of the fields differ.
+   */
+  bool operator!=(const parameters &b) const { return !(*this == b); }
+
+  /**\brief Cache key
+   *
+   * Serialises all of the fields, with enough digits that distinct values
+   * never produce the same string.
+   *
+   * \returns A string that uniquely identifies these parameters.
+   */
+  std::string key(void) const {
+    std::ostringstream s("");
+    s << std::setprecision(std::numeric_limits<long double>::max_digits10)
+      << (long double)(radius) << ":" << (long double)(radius2) << ":"
+      << (long double)(constant) << ":" << (long double)(precision) << ":"
+      << iterations << ":" << functions << ":" << seed << ":"
+      << flameCoefficients << (preRotate ? ":pre" : "")
+      << (postRotate ? ":post" : "");
+    return s.str();
+  }
+
+  Q radius, radius2, constant, precision;
+  unsigned int iterations, functions, seed, flameCoefficients;
+  bool preRotate, postRotate;
+};
+
+/**\brief Model geometry cache
+ *
+ * Keeps the faces of recently generated models around, so that renders which
+ * only change the camera, the transformations or the colours don't have to
+ * generate the model's geometry again - even if the model itself has been
+ * recreated in the meantime, e.g. by selecting it anew.
+ *
+ * Entries are type-erased and looked up by a key that identifies both the
+ * model type and its parameters; see wrapper::key(). The least recently used
+ * entries are dropped once the cache holds more than 'capacity' entries.
+ *
+ * \note This class isn't thread safe; each state object has its own cache.
+ */
+class cache {
+public:
+  /**\brief Construct with capacity
+   *
+   * \param[in] pCapacity The maximum number of models to keep around.
+   */
+  cache(std::size_t pCapacity = 4) : capacity(pCapacity) {}
+
+  /**\brief Look up model geometry
+   *
+   * \param[in] key The key of the geometry to look up.
+   *
+   * \returns The cached geometry, or an empty pointer if there is none.
+   */
+  std::shared_ptr<void> find(const std::string &key) {
+    for (auto it = entries.begin(); it != entries.end(); it++) {
+      if (it->first == key) {
+        entries.splice(entries.begin(), entries, it);
+        return entries.front().second;
+      }
+    }
+
+    return std::shared_ptr<void>();
+  }
+
+  /**\brief Add model geometry
+   *
+   * Adds an entry to the cache, dropping the least recently used entries if
+   * that exceeds the capacity.
+   *
+   * \param[in] key   The key of the geometry.
+   * \param[in] value The geometry to keep.
+   */
+  void insert(const std::string &key, const std::shared_ptr<void> &value) {
+    entries.push_front(std::make_pair(key, value));
+    while (entries.size() > capacity) {
+      entries.pop_back();
+    }
+  }
+
+  /**\brief Drop all entries
+   *
+   * Releases all of the geometry in the cache.
+   */
+  void clear(void) { entries.clear(); }
+
+  /**\brief Add entries of other cache
+   *
+   * Adds all of the entries of another cache that this one doesn't have yet,
+   * e.g. to pick up geometry that was generated in the background. The other
+   * cache's entries keep their relative order and end up in front.
+   *
+   * \param[in] other The cache to copy entries from.
+   */
+  void adopt(const cache &other) {
+    for (auto it = other.entries.rbegin(); it != other.entries.rend(); it++) {
+      if (!find(it->first)) {
+        insert(it->first, it->second);
+      }
+    }
+  }
+
+  /**\brief Maximum number of entries
+   *
+   * The number of models to keep around at most. Set to 0 to disable the
+   * cache.
+   */
+  std::size_t capacity;
+
+protected:
+  /**\brief Cache entries
+   *
+   * Key/geometry pairs, with the most recently used entry in front.
+   */
+  std::list<std::pair<std::string, std::shared_ptr<void>>> entries;
+};
+
 /**\brief Base class for a model renderer
  *
  * The primary purpose of this class is to force certain parts of a model
@@ -154,6 +332,57 @@ public:
    */
   virtual bool svg(std::ostream &output, bool updateMatrix = false) = 0;
 
+  /**\brief Render to binary mesh
+   *
+   * Writes the model's faces as a binary mesh; see render::wrapper::binary()
+   * for the layout.
+   *
+   * \param[in] output       The stream to write to.
+   * \param[in] raw          Whether to write the vertices before projection
+   *                         instead of projected to 2D.
+   * \param[in] updateMatrix Whether to update the projection
+   *                         matrices.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool binary(std::ostream &output, bool raw,
+                      bool updateMatrix = false) = 0;
+
+  /**\brief Render to PNG
+   *
+   * Rasterises the model in software and writes the result as a PNG image.
+   *
+   * \param[in] output       The stream to write to.
+   * \param[in] updateMatrix Whether to update the projection
+   *                         matrices.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool png(std::ostream &output, bool updateMatrix = false) = 0;
+
+  /**\brief Generate geometry ahead of time
+   *
+   * Generates the model's faces, as the next render is going to use them
+   * with the state's current settings, and adds them to the state's
+   * geometry cache, so that the render doesn't have to. That includes the
+   * level of detail picked for the OpenGL viewport or, for file output, the
+   * image size. Iterative models are skipped in progressive mode, since the
+   * OpenGL renderer builds them up one level per frame. Meant to be run on a
+   * background thread, with a state object that isn't used for anything
+   * else in the mean time; see topologic::builder.
+   *
+   * \param[in] cancel      Checked while generating; once it is set,
+   *                        generation stops and nothing is added to the
+   *                        cache.
+   * \param[in] interactive Prepare for the OpenGL renderer rather than for
+   *                        file output.
+   *
+   * \returns 'true' if the geometry is in the cache when the function
+   *          returns, or if there is nothing to prepare.
+   */
+  virtual bool prepare(const std::atomic<bool> &cancel,
+                       bool interactive = true) = 0;
+
 #if !defined(NO_OPENGL)
   /**\brief Render to OpenGL context
    *
@@ -208,11 +437,534 @@ public:
    * \param[in]     pFormat The vector format tag to use
    */
   wrapper(stateType &pState, const format &pFormat)
-      : gState(pState), object(gState.parameter, pFormat),
-        base(d, modelType::renderDepth, modelType::id(),
-             modelType::format::id()) {}
+      : gState(pState), object(gState.parameter, pFormat), tag(pFormat),
+        level(0), base(d, modelType::renderDepth, modelType::id(),
+                       modelType::format::id()) {}
+
+  /**\brief Generated model geometry
+   *
+   * Holds all of the faces of a model, as generated by the model with a
+   * given set of parameters. Faces are only kept as a structure-of-arrays
+   * vertex buffer and the offset of each face's first vertex in it; the
+   * geometry still iterates like the model itself, by putting each face
+   * back together as it is dereferenced, so it can be passed to libefgy's
+   * renderers in its place.
+   *
+   * The vertices and offsets are both stored in a single block of the
+   * geometry's own arena, which goes back to the common block pool in one
+   * piece when the geometry is released, e.g. when the model is replaced and
+   * drops out of the geometry cache.
+   */
+  class geometry {
+  protected:
+    /**\brief Arena
+     *
+     * Holds the storage of all of the containers below; declared first, so
+     * that it outlives them.
+     */
+    arena::region storage;
+
+  public:
+    /**\brief Face type
+     *
+     * The type of the faces produced by the model.
+     */
+    using face = typename std::decay<decltype(
+        *std::declval<const modelType &>().begin())>::type;
+
+    /**\brief Render depth
+     *
+     * Same as the model's render depth.
+     */
+    static const std::size_t renderDepth = modelType::renderDepth;
+
+    /**\brief Model iterator
+     *
+     * The type of the iterators returned by the model's begin() and end().
+     */
+    using iterator = typename std::decay<decltype(
+        std::declval<const modelType &>().begin())>::type;
+
+    /**\brief Generate geometry
+     *
+     * Runs the model's generator once and keeps all of the faces. They are
+     * collected in containers from the common block pool first, since their
+     * number isn't known up front, and then copied to the arena in one go,
+     * without any slack.
+     *
+     * Faces are generated on a single thread: splitting them over several
+     * would need copies of the model's iterators to share no mutable state
+     * and to be safe to dereference on several threads at once, and libefgy
+     * doesn't promise either for any of its models.
+     *
+     * \param[in] model  The model to generate the faces of.
+     * \param[in] cancel If given, generation stops early once this is set;
+     *                   the geometry is then incomplete.
+     */
+    geometry(const modelType &model, const std::atomic<bool> *cancel = 0)
+        : vertices(arena::allocator<Q>(&storage)),
+          offsets(arena::allocator<std::size_t>(&storage)) {
+      part p;
+      p.collect(model.begin(), model.end(), cancel);
+
+      const std::size_t nf = p.offsets.size(), nv = p.vertices.size();
+
+      storage.reserve(bytes<std::size_t>(nf + 1) + renderDepth * bytes<Q>(nv));
+      vertices.reserve(nv);
+      offsets.reserve(nf + 1);
+
+      for (std::size_t i = 0; i < renderDepth; i++) {
+        vertices.lane[i].insert(vertices.lane[i].end(),
+                                p.vertices.lane[i].begin(),
+                                p.vertices.lane[i].end());
+      }
+      offsets.insert(offsets.end(), p.offsets.begin(), p.offsets.end());
+      offsets.push_back(nv);
+    }
+
+    geometry(const geometry &) = delete;
+
+    /**\brief Face iterator
+     *
+     * Iterates over the geometry's faces, in the order the model produced
+     * them. Dereferencing the iterator puts the face together from the
+     * vertex buffer and returns it by value.
+     */
+    class const_iterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = face;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const face *;
+      using reference = face;
+
+      /**\brief Construct with geometry and face
+       *
+       * \param[in] pGeometry The geometry to iterate over.
+       * \param[in] pIndex    The index of the face to point to.
+       */
+      const_iterator(const geometry &pGeometry, const std::size_t &pIndex)
+          : g(&pGeometry), index(pIndex) {}
+
+      face operator*(void) const { return g->at(index); }
+
+      const_iterator &operator++(void) {
+        index++;
+        return *this;
+      }
+
+      const_iterator operator++(int) {
+        const_iterator r = *this;
+        index++;
+        return r;
+      }
+
+      bool operator==(const const_iterator &b) const {
+        return (g == b.g) && (index == b.index);
+      }
+
+      bool operator!=(const const_iterator &b) const { return !(*this == b); }
+
+    protected:
+      const geometry *g;
+      std::size_t index;
+    };
+
+    const_iterator begin(void) const { return const_iterator(*this, 0); }
+
+    const_iterator end(void) const { return const_iterator(*this, size()); }
+
+    /**\brief Number of faces
+     *
+     * \returns The number of faces in the geometry.
+     */
+    std::size_t size(void) const { return offsets.size() - 1; }
+
+    /**\brief Get face
+     *
+     * Puts a face back together from the vertex buffer.
+     *
+     * \param[in] f The index of the face; less than size().
+     *
+     * \returns The face, as the model produced it.
+     */
+    face at(const std::size_t &f) const {
+      face r = face();
+      for (std::size_t i = 0, n = offsets[f];
+           (i < r.size()) && (n < offsets[f + 1]); i++, n++) {
+        for (std::size_t j = 0; j < renderDepth; j++) {
+          r[i][j] = vertices.lane[j][n];
+        }
+      }
+      return r;
+    }
+
+    /**\brief Vertices
+     *
+     * The vertices of all faces, in the same order, as a structure-of-arrays
+     * buffer for the projection kernel.
+     */
+    view::vertices<Q, renderDepth, arena::allocator<Q>> vertices;
+
+    /**\brief Face offsets
+     *
+     * The index of each face's first vertex in 'vertices', plus the total
+     * number of vertices at the end.
+     */
+    arena::vector<std::size_t> offsets;
+
+  protected:
+    /**\brief Generated faces
+     *
+     * The model's faces, with their vertices, as collected before they are
+     * copied to the arena.
+     */
+    class part {
+    public:
+      /**\brief Collect faces
+       *
+       * Generates and keeps the faces in the given range.
+       *
+       * \param[in] it     The first face to keep.
+       * \param[in] end    The face after the last face to keep.
+       * \param[in] cancel If given, generation stops early once this is set.
+       */
+      void collect(iterator it, const iterator &end,
+                   const std::atomic<bool> *cancel) {
+        for (; it != end; ++it) {
+          if (cancel && cancel->load(std::memory_order_relaxed)) {
+            break;
+          }
+          const face &p = *it;
+          offsets.push_back(vertices.size());
+          for (std::size_t i = 0; i < p.size(); i++) {
+            vertices.push_back(p[i]);
+          }
+        }
+      }
+
+      /**\brief Vertices
+       *
+       * The vertices of all faces, in the order the model produced them.
+       */
+      view::vertices<Q, renderDepth, arena::allocator<Q>> vertices;
+
+      /**\brief Face offsets
+       *
+       * The index of each face's first vertex in 'vertices'.
+       */
+      arena::vector<std::size_t> offsets;
+    };
+
+    /**\brief Arena space
+     *
+     * \tparam T The type of the objects to make room for.
+     *
+     * \param[in] n The number of objects to make room for.
+     *
+     * \returns The number of bytes to reserve in the arena for an array of
+     *          'n' objects, including room for its alignment.
+     */
+    template <typename T> static std::size_t bytes(const std::size_t &n) {
+      return n * sizeof(T) + alignof(T) - 1;
+    }
+  };
+
+  /**\brief Geometry cache key
+   *
+   * Identifies the model type and all of the parameters that have an effect
+   * on the model's faces. The precision is left out for models that don't
+   * use it, so that these share a single entry for all levels of detail.
+   *
+   * \param[in] p The parameters to generate the model with.
+   *
+   * \returns The key to look up this model's geometry with.
+   */
+  std::string key(const efgy::geometry::parameters<Q> &p) const {
+    parameters<Q> k(p);
+    if (!tessellated()) {
+      k.precision = Q(0);
+    }
+
+    std::ostringstream s("");
+    s << metadata::name() << "@" << metadata::renderDepth << ":"
+      << metadata::formatID << ":" << k.key();
+    return s.str();
+  }
+
+  /**\brief Geometry cache key
+   *
+   * \returns The key for the model with the state's current parameters.
+   */
+  std::string key(void) const { return key(gState.parameter); }
+
+  /**\brief Level of detail
+   *
+   * Picks the precision to generate the model with, so that a tessellation
+   * step is about as long on screen as the state's 'detail' setting asks
+   * for. The model's extent is estimated by projecting its radius along
+   * each axis with the current view.
+   *
+   * The result only depends on the state and the viewport: file output is
+   * keyed by it in the render cache, and has to come out the same no matter
+   * what was rendered before. See precision(const Q &, bool) for the
+   * interactive variant.
+   *
+   * \param[in] pixels The smaller of the viewport's sides, in pixels.
+   *
+   * \returns The ideal precision, not rounded; 0 if the level of detail is
+   *          turned off or the model couldn't be measured.
+   */
+  Q ideal(const Q &pixels) const {
+    if (!(gState.detail > Q(0))) {
+      return Q(0);
+    }
+
+    const std::size_t rd = modelType::renderDepth;
+    const view::chain<Q, rd> project(gState);
+    const Q extent =
+        std::abs(gState.parameter.radius) + std::abs(gState.parameter.radius2);
+    std::array<Q, rd *(2 * rd + 1)> in;
+    std::array<Q, 2 * (2 * rd + 1)> out;
+
+    in.fill(Q(0));
+    for (std::size_t i = 0; i < rd; i++) {
+      in[(2 * i + 1) * rd + i] = extent;
+      in[(2 * i + 2) * rd + i] = -extent;
+    }
+    project(in.data(), 2 * rd + 1, out.data());
+
+    Q size = 0;
+    for (std::size_t v = 1; v <= 2 * rd; v++) {
+      const Q x = out[2 * v] - out[0], y = out[2 * v + 1] - out[1];
+      size = std::max(size, Q(std::sqrt(x * x + y * y)));
+    }
+
+    // the viewport maps 2.4 units to 'pixels' pixels, as in the SVG output.
+    const Q i = Q(2 * M_PI) * size * pixels / Q(2.4) / gState.detail;
+    return std::isfinite(double(i)) && (i > Q(0)) ? i : Q(0);
+  }
+
+  /**\brief Round level of detail
+   *
+   * \param[in] i An ideal precision, as returned by ideal().
+   *
+   * \returns The nearest power of two between 4 and 1024.
+   */
+  static Q quantise(const Q &i) {
+    const double l = std::round(std::log2(double(i)));
+    return Q(std::exp2(std::min(std::max(l, 2.), 10.)));
+  }
+
+  /**\brief Level of detail
+   *
+   * Picks the precision to generate the model with, as ideal() rounded to a
+   * power of two; see quantise().
+   *
+   * Interactive renderers set 'interactive', so that the level only changes
+   * once it is off by more than a factor of about 1.7, and small camera
+   * moves don't regenerate the model. That makes the result depend on the
+   * level picked last, so it is only used for the OpenGL output.
+   *
+   * \param[in] pixels      The smaller of the viewport's sides, in pixels.
+   * \param[in] interactive Keep the previous level if it's close enough.
+   *
+   * \returns The precision to use; the state's own precision if the level of
+   *          detail is turned off or the model couldn't be measured.
+   */
+  Q precision(const Q &pixels, bool interactive = false) {
+    const Q i = ideal(pixels);
+
+    if (!interactive) {
+      return i > Q(0) ? quantise(i) : gState.parameter.precision;
+    }
+
+    if (!(i > Q(0))) {
+      return level > Q(0) ? level : gState.parameter.precision;
+    }
+
+    if (!(level > Q(0)) || (std::abs(std::log2(double(i / level))) > 0.75)) {
+      level = quantise(i);
+    }
+
+    return level;
+  }
+
+  /**\brief Get model geometry
+   *
+   * Returns the model's faces for the current parameters, either from this
+   * wrapper's last lookup, from the state's geometry cache or by generating
+   * them anew.
+   *
+   * \returns The model's geometry.
+   */
+  const geometry &faces(void) {
+    const std::string k = key();
+
+    if (!generated || (k != generatedKey)) {
+      generated = std::static_pointer_cast<geometry>(gState.cache.find(k));
+      if (!generated) {
+        stats::scope timer(stats::tModel);
+        generated = std::make_shared<geometry>(object);
+        gState.cache.insert(k, generated);
+      }
+      generatedKey = k;
+    }
+
+    return *generated;
+  }
+
+  /**\brief Get model geometry for viewport
+   *
+   * Like faces(), but with the precision picked by precision() for the given
+   * viewport size. Each level is generated by a separate model instance and
+   * kept in the state's geometry cache, so zooming back and forth doesn't
+   * regenerate the model. Models whose geometry doesn't depend on the
+   * precision, see tessellated(), always use faces().
+   *
+   * \param[in] pixels      The smaller of the viewport's sides, in pixels.
+   * \param[in] interactive Passed on to precision(); only set for OpenGL.
+   *
+   * \returns The model's geometry.
+   */
+  const geometry &faces(const Q &pixels, bool interactive = false) {
+    if (!(gState.detail > Q(0)) || !tessellated()) {
+      return faces();
+    }
+
+    efgy::geometry::parameters<Q> p = gState.parameter;
+    p.precision = precision(pixels, interactive);
+    return generate(p);
+  }
+
+  /**\brief Iterative model?
+   *
+   * Tells whether the model's geometry depends on the 'iterations'
+   * parameter, which is the case for the IFS and fractal flame models but
+   * not for the polytopes or the parametric models.
+   *
+   * \returns 'true' if the model is iterative.
+   */
+  static bool iterative(void) {
+    const std::string id = modelType::id();
+    return (id == "sierpinski-gasket") || (id == "sierpinski-carpet") ||
+           (id == "random-affine-ifs") || (id == "random-flame");
+  }
+
+  /**\brief Tessellated model?
+   *
+   * Tells whether the model's geometry depends on the 'precision' parameter,
+   * which is the case for the parametric models, e.g. spheres and tori, but
+   * not for the polytopes or the iterative models. Models not known to
+   * ignore the precision are assumed to use it.
+   *
+   * \returns 'true' if the model is tessellated.
+   */
+  static bool tessellated(void) {
+    const std::string id = modelType::id();
+    return !iterative() && (id != "cube") && (id != "simplex");
+  }
+
+  /**\brief Get model geometry progressively
+   *
+   * Like faces(), but for iterative models it doesn't jump straight to the
+   * state's iteration count if that level isn't in the geometry cache yet:
+   * each call generates the level above the highest one that is cached, or
+   * level 0 if there is none. So scrubbing through the iterations of an IFS
+   * shows a coarse model at once and refines it on later frames, instead of
+   * rebuilding the full model before anything is drawn. Sets the 'update'
+   * flag while there are levels left to generate, so that the frontends keep
+   * redrawing.
+   *
+   * This is not incremental: libefgy's models don't expose their functions,
+   * so every level is generated in full by a model instance of its own,
+   * rather than by applying the functions once more to the level below.
+   * With k functions, the levels below the target cost about 1/(k-1) of the
+   * target's own work on top of it.
+   *
+   * The state's geometry cache is grown, if need be, to hold every level up
+   * to the current one plus one more model, so that stepping back down to a
+   * level that was already generated doesn't start over from level 0. The
+   * levels below an IFS's current one only add up to a fraction of its
+   * size, so this at most about doubles the memory it takes. Models that
+   * don't depend on the iteration count are passed on to faces() as is.
+   *
+   * \param[in] pixels The smaller of the viewport's sides, in pixels.
+   *
+   * \returns The model's geometry at the current level.
+   */
+  const geometry &refine(const Q &pixels) {
+    if (!iterative()) {
+      return faces(pixels, true);
+    }
+
+    efgy::geometry::parameters<Q> p = gState.parameter;
+    const unsigned int target = p.iterations;
+
+    if ((gState.cache.capacity > 0) &&
+        (gState.cache.capacity < std::size_t(target) + 2)) {
+      gState.cache.capacity = std::size_t(target) + 2;
+    }
+
+    if (generated && (key(p) == generatedKey)) {
+      return *generated;
+    }
+
+    unsigned int next = 0;
+    for (unsigned int i = target;; i--) {
+      p.iterations = i;
+      if (gState.cache.find(key(p))) {
+        next = i < target ? i + 1 : i;
+        break;
+      }
+      if (i == 0) {
+        break;
+      }
+    }
+
+    p.iterations = next;
+    const geometry &g = generate(p);
+    if (next < target) {
+      metadata::update = true;
+    }
+    return g;
+  }
+
+  bool prepare(const std::atomic<bool> &cancel, bool interactive = true) {
+    // building the full model here would hide refine()'s coarse levels.
+    if (interactive && gState.progressive && iterative()) {
+      return true;
+    }
+
+    efgy::geometry::parameters<Q> p = gState.parameter;
+    if ((gState.detail > Q(0)) && tessellated()) {
+      p.precision =
+          precision(interactive ? Q(std::min(gState.width, gState.height))
+                                : viewport());
+    }
+
+    const std::string k = key(p);
+
+    if (gState.cache.find(k)) {
+      return true;
+    }
+
+    stats::scope timer(stats::tModel);
+    const modelType model(p, tag);
+    const std::shared_ptr<geometry> g =
+        std::make_shared<geometry>(model, &cancel);
+    if (cancel) {
+      return false;
+    }
+
+    gState.cache.insert(k, g);
+    return true;
+  }
 
   bool svg(std::ostream &output, bool updateMatrix = false) {
+    stats::scope timer(stats::tOutput);
+    const std::streamoff start = output.tellp();
+
     if (metadata::update) {
       metadata::update = false;
     }
@@ -223,7 +975,20 @@ public:
       gState.updateMatrix();
     }
 
-    gState.svg.frameStart();
+    gState.svg().frameStart();
+
+    if ((gState.digits >= 0) || gState.compact) {
+      output::writer out(output, buffer, gState.digits);
+      if (gState.compact) {
+        compact(out);
+      } else {
+        svg(out);
+      }
+      out.flush();
+      stats::count(stats::cBytes, out.bytes);
+      gState.svg().frameEnd();
+      return true;
+    }
 
     output << "<?xml version='1.0' encoding='utf-8'?>"
               "<svg xmlns='http://www.w3.org/2000/svg'"
@@ -253,19 +1018,408 @@ public:
            << double(gState.surface.blue) * 100. << "%,"
            << double(gState.surface.alpha) << "); }</style>";
     if (gState.surface.alpha > Q(0.)) {
-      output << gState.svg << object;
+      const geometry &g = faces(viewport());
+      output << gState.svg() << g;
+      tally(g);
     }
     output << "</svg>\n";
 
-    gState.svg.frameEnd();
+    gState.svg().frameEnd();
+    written(output, start);
 
     return true;
   }
 
+  /**\brief Render to SVG with buffered writer
+   *
+   * Writes the same document as the iostream-based SVG renderer, but with
+   * Topologic's own buffered writer and number formatting. Used when the
+   * state's 'digits' setting is 0 or greater. The state's matrices are folded
+   * into a view chain once per document, and all of the model's vertices are
+   * projected in one go before any of the faces are written.
+   *
+   * \param[out] out The writer to render to.
+   */
+  void svg(output::writer &out) {
+    header(out, "-1.2 -1.2 2.4 2.4", "0.002");
+
+    if (gState.surface.alpha > Q(0.)) {
+      const view::chain<Q, modelType::renderDepth> project(gState);
+      const geometry &g = faces(viewport());
+      std::size_t n = 0;
+
+      project(g.vertices, projected);
+      tally(g);
+
+      for (std::size_t f = 1; f < g.offsets.size(); f++) {
+        out << "<path d='";
+        for (; n < g.offsets[f]; n++) {
+          out << (n == g.offsets[f - 1] ? 'M' : 'L')
+              << double(projected.lane[0][n]) << ','
+              << double(projected.lane[1][n]);
+        }
+        out << "Z'/>";
+      }
+    }
+
+    out << "</svg>\n";
+  }
+
+  /**\brief Render to compact SVG
+   *
+   * Writes an SVG with the same metadata and style as svg(), but with as
+   * little path data as possible:
+   *
+   * - the view box is scaled by 10^N, with N being the state's 'digits'
+   *   setting - 3 if it's 0 or less, and no more than 9 - so that all
+   *   coordinates can be rounded to integers;
+   * - faces that are entirely outside of the view box, that have fewer than
+   *   two distinct vertices after rounding or that have non-finite
+   *   coordinates are dropped, as are faces with the same vertices as an
+   *   earlier face, whatever their order;
+   * - all remaining faces are merged into a single path element, each as a
+   *   subpath with relative line commands. Subpaths are all turned to the
+   *   same orientation, so that with the default non-zero fill rule, the
+   *   path covers every one of its faces.
+   *
+   * \param[out] out The writer to render to.
+   */
+  void compact(output::writer &out) {
+    out.digits = gState.digits > 0 ? std::min(gState.digits, 9) : 3;
+
+    const double scale = std::pow(10., double(out.digits));
+    const long long limit = std::llround(1.2 * scale);
+    {
+      char box[128], stroke[32];
+      std::size_t b = output::format(box, -double(limit), 0);
+      box[b++] = ' ';
+      b += output::format(box + b, -double(limit), 0);
+      box[b++] = ' ';
+      b += output::format(box + b, 2. * double(limit), 0);
+      box[b++] = ' ';
+      b += output::format(box + b, 2. * double(limit), 0);
+      const std::size_t s = output::format(stroke, 0.002 * scale, 0);
+      header(out, std::string(box, b), std::string(stroke, s));
+    }
+
+    if (gState.surface.alpha > Q(0.)) {
+      const view::chain<Q, modelType::renderDepth> project(gState);
+      const geometry &g = faces(viewport());
+      std::vector<std::array<long long, 2>> p;
+      std::unordered_set<std::vector<std::array<long long, 2>>, outline>
+          seen;
+      bool open = false;
+
+      project(g.vertices, projected);
+      tally(g);
+
+      for (std::size_t f = 0; f + 1 < g.offsets.size(); f++) {
+        if (!vertices(g.offsets[f], g.offsets[f + 1], scale, p)) {
+          continue;
+        }
+
+        long long x0 = p[0][0], x1 = x0, y0 = p[0][1], y1 = y0;
+        double area = 0;
+        for (std::size_t i = 0; i < p.size(); i++) {
+          const std::array<long long, 2> &a = p[i];
+          const std::array<long long, 2> &b = p[(i + 1) % p.size()];
+          x0 = std::min(x0, a[0]);
+          x1 = std::max(x1, a[0]);
+          y0 = std::min(y0, a[1]);
+          y1 = std::max(y1, a[1]);
+          area += double(a[0]) * double(b[1]) - double(b[0]) * double(a[1]);
+        }
+
+        if ((x1 < -limit) || (x0 > limit) || (y1 < -limit) || (y0 > limit)) {
+          continue;
+        }
+
+        if (area < 0) {
+          std::reverse(p.begin(), p.end());
+        }
+        std::rotate(p.begin(), std::min_element(p.begin(), p.end()), p.end());
+
+        if (!seen.insert(p).second) {
+          continue;
+        }
+
+        if (!open) {
+          out << "<path d='";
+          open = true;
+        }
+
+        out << 'M' << double(p[0][0]);
+        separate(out, p[0][1]);
+        out << 'l';
+        for (std::size_t i = 1; i < p.size(); i++) {
+          const long long dx = p[i][0] - p[i - 1][0];
+          const long long dy = p[i][1] - p[i - 1][1];
+          if (i > 1) {
+            separate(out, dx);
+          } else {
+            out << double(dx);
+          }
+          separate(out, dy);
+        }
+        out << 'z';
+      }
+
+      if (open) {
+        out << "'/>";
+      }
+    }
+
+    out << "</svg>\n";
+  }
+
+protected:
+  /**\brief Write SVG header
+   *
+   * Writes the start of an SVG document as used by the buffered SVG writers,
+   * up to and including the style sheet.
+   *
+   * \param[out] out     The writer to render to.
+   * \param[in]  viewBox The document's view box.
+   * \param[in]  stroke  The stroke width to use for paths.
+   */
+  void header(output::writer &out, const std::string &viewBox,
+              const std::string &stroke) {
+    std::ostringstream meta("");
+    meta << efgy::xml::tag() << gState;
+
+    out << "<?xml version='1.0' encoding='utf-8'?>"
+           "<svg xmlns='http://www.w3.org/2000/svg'"
+           " xmlns:xlink='http://www.w3.org/1999/xlink'"
+           " version='1.1' width='100%' height='100%' viewBox='"
+        << viewBox << "'>"
+                      "<title>"
+        << metadata::name() << "</title>"
+                               "<metadata xmlns:t='http://ef.gy/2012/topologic'>"
+        << meta.str() << "</metadata>"
+                             "<style type='text/css'>svg { background: rgba("
+        << double(gState.background.red) * 100. << "%,"
+        << double(gState.background.green) * 100. << "%,"
+        << double(gState.background.blue) * 100. << "%,"
+        << double(gState.background.alpha)
+        << "); }"
+           " path { stroke-width: "
+        << stroke << "; stroke: rgba("
+        << double(gState.wireframe.red) * 100. << "%,"
+        << double(gState.wireframe.green) * 100. << "%,"
+        << double(gState.wireframe.blue) * 100. << "%,"
+        << double(gState.wireframe.alpha) << ");"
+                                             " fill: rgba("
+        << double(gState.surface.red) * 100. << "%,"
+        << double(gState.surface.green) * 100. << "%,"
+        << double(gState.surface.blue) * 100. << "%,"
+        << double(gState.surface.alpha) << "); }</style>";
+  }
+
+  /**\brief Round face for compact SVG
+   *
+   * Scales and rounds a face's projected vertices to integers, dropping any
+   * vertex that rounds to the same point as the one before it.
+   *
+   * \param[in]  begin The index of the face's first vertex in 'projected'.
+   * \param[in]  end   The index after the face's last vertex.
+   * \param[in]  scale The factor to scale coordinates by.
+   * \param[out] p     Receives the rounded vertices.
+   *
+   * \returns 'true' if the face has at least two distinct vertices, all of
+   *          them finite.
+   */
+  bool vertices(const std::size_t &begin, const std::size_t &end,
+                const double &scale, std::vector<std::array<long long, 2>> &p) {
+    p.clear();
+    for (std::size_t v = begin; v < end; v++) {
+      std::array<long long, 2> r;
+      for (std::size_t i = 0; i < 2; i++) {
+        const double c = double(projected.lane[i][v]) * scale;
+        if (!std::isfinite(c)) {
+          return false;
+        }
+        r[i] = std::llround(std::min(std::max(c, -1e12), 1e12));
+      }
+      if (p.empty() || (r != p.back())) {
+        p.push_back(r);
+      }
+    }
+    while ((p.size() > 1) && (p.back() == p.front())) {
+      p.pop_back();
+    }
+    return p.size() >= 2;
+  }
+
+  /**\brief Hash rounded face
+   *
+   * Hashes the rounded vertices of a face for compact(), with 64-bit FNV-1a
+   * over the coordinates. Faces with the same hash are still compared vertex
+   * by vertex before one of them is dropped.
+   */
+  class outline {
+  public:
+    std::size_t
+    operator()(const std::vector<std::array<long long, 2>> &p) const {
+      std::uint64_t hash = 14695981039346656037ull;
+      for (const auto &v : p) {
+        for (const long long &c : v) {
+          hash = (hash ^ std::uint64_t(c)) * 1099511628211ull;
+        }
+      }
+      return std::size_t(hash);
+    }
+  };
+
+  /**\brief Write separated number
+   *
+   * Writes an integer that follows another one in path data, with a space in
+   * between unless the minus sign already separates them.
+   *
+   * \param[out] out The writer to write to.
+   * \param[in]  v   The number to write.
+   */
+  static void separate(output::writer &out, const long long &v) {
+    if (v >= 0) {
+      out << ' ';
+    }
+    out << double(v);
+  }
+
+public:
+  /**\brief Render to binary mesh
+   *
+   * Writes the model's faces in a packed, little-endian layout that can be
+   * mapped into memory and used as is. All offsets are relative to the start
+   * of the file, and every section starts on an 8-byte boundary:
+   *
+   * - 8 bytes: the magic string "TPLGMESH"
+   * - uint32: format version, currently 1
+   * - uint32: number of coordinates per vertex; 2, or the render depth for
+   *   raw meshes
+   * - uint64: length of the JSON metadata, in bytes
+   * - uint64: number of faces, F
+   * - uint64: number of vertices, V
+   * - the JSON metadata, as written by the JSON output mode and padded with
+   *   zeroes to a multiple of 8 bytes
+   * - uint64[F+1]: index of each face's first vertex, plus V at the end
+   * - float64[V * coordinates]: the vertices, one after the other
+   *
+   * \param[out] output       The stream to write to.
+   * \param[in]  raw          Whether to write the vertices before projection
+   *                          instead of projected to 2D.
+   * \param[in]  updateMatrix Whether to update the projection matrices.
+   *
+   * \returns 'true' upon success.
+   */
+  bool binary(std::ostream &output, bool raw, bool updateMatrix = false) {
+    stats::scope timer(stats::tOutput);
+
+    if (updateMatrix) {
+      gState.width = 3;
+      gState.height = 3;
+      gState.updateMatrix();
+    }
+
+    std::ostringstream meta("");
+    meta << efgy::json::tag() << gState;
+    const std::string json = meta.str();
+
+    const geometry &g = faces(viewport());
+    const std::size_t coordinates = raw ? modelType::renderDepth : 2;
+    output::writer out(output, buffer);
+
+    out.write("TPLGMESH", 8);
+    out.little(1, 4).little(coordinates, 4);
+    out.little(json.size(), 8).little(g.size(), 8);
+    out.little(g.vertices.size(), 8);
+    out << json;
+    for (std::size_t i = json.size(); i % 8 != 0; i++) {
+      out << '\0';
+    }
+
+    for (const std::size_t &o : g.offsets) {
+      out.little(o, 8);
+    }
+
+    if (raw) {
+      for (std::size_t v = 0; v < g.vertices.size(); v++) {
+        for (std::size_t i = 0; i < coordinates; i++) {
+          out.little(double(g.vertices.lane[i][v]));
+        }
+      }
+    } else {
+      const view::chain<Q, modelType::renderDepth> project(gState);
+      project(g.vertices, projected);
+
+      for (std::size_t v = 0; v < projected.size(); v++) {
+        out.little(double(projected.lane[0][v]));
+        out.little(double(projected.lane[1][v]));
+      }
+    }
+
+    tally(g);
+    out.flush();
+    stats::count(stats::cBytes, out.bytes);
+
+    return true;
+  }
+
+  /**\brief Render to PNG
+   *
+   * Rasterises the model with the software rasteriser and writes the result
+   * as a PNG image of the state's image size. The model is laid out like in
+   * the SVG output; faces are filled and outlined with the state's colours,
+   * or tone mapped from a density histogram with fractal flame colouring.
+   *
+   * \param[out] output       The stream to write to.
+   * \param[in]  updateMatrix Whether to update the projection matrices.
+   *
+   * \returns 'true' upon success.
+   */
+  bool png(std::ostream &output, bool updateMatrix = false) {
+    stats::scope timer(stats::tOutput);
+    const std::streamoff start = output.tellp();
+
+    if (updateMatrix) {
+      gState.width = 3;
+      gState.height = 3;
+      gState.updateMatrix();
+    }
+
+    raster::image img(gState.imageWidth, gState.imageHeight);
+    const raster::colour background = colour(gState.background);
+
+    if (gState.surface.alpha > Q(0.)) {
+      const view::chain<Q, modelType::renderDepth> project(gState);
+      const geometry &g = faces(viewport());
+
+      project(g.vertices, projected);
+      tally(g);
+
+      raster::rasteriser r(img, projected, g.offsets);
+      if (gState.fractalFlameColouring) {
+        r.flame(background, gState.threads);
+      } else {
+        r.render(background, colour(gState.wireframe), colour(gState.surface),
+                 gState.threads);
+      }
+    } else {
+      const arena::vector<std::size_t> none;
+      raster::rasteriser r(img, projected, none);
+      r.render(background, background, background, gState.threads);
+    }
+
+    const bool ok = img.png(output);
+    written(output, start);
+    return ok;
+  }
+
 #if !defined(NO_OPENGL)
   bool opengl(bool updateMatrix = false) {
+    stats::scope timer(stats::tOutput);
+
     if (metadata::update) {
-      gState.opengl.context.prepared = false;
+      gState.opengl().context.prepared = false;
       metadata::update = false;
     }
 
@@ -273,31 +1427,204 @@ public:
       gState.updateMatrix();
     }
 
-    gState.opengl.context.fractalFlameColouring = gState.fractalFlameColouring;
-    gState.opengl.context.width = gState.width;
-    gState.opengl.context.height = gState.height;
+#if !defined(GL_ES_VERSION_2_0)
+    if ((modelType::renderDepth > 3) && !gState.fractalFlameColouring &&
+        shader()) {
+      return true;
+    }
+#endif
+
+    gState.opengl().context.fractalFlameColouring =
+        gState.fractalFlameColouring;
+    gState.opengl().context.width = gState.width;
+    gState.opengl().context.height = gState.height;
 
     if (!gState.fractalFlameColouring) {
       glClearColor(gState.background.red, gState.background.green,
                    gState.background.blue, gState.background.alpha);
     }
 
-    gState.opengl.frameStart();
+    gState.opengl().frameStart();
 
-    gState.opengl.context.wireframeColour = gState.wireframe;
-    gState.opengl.context.surfaceColour = gState.surface;
+    gState.opengl().context.wireframeColour = gState.wireframe;
+    gState.opengl().context.surfaceColour = gState.surface;
 
-    if (!gState.opengl.context.prepared) {
-      std::cerr << gState.opengl << object;
+    if (!gState.opengl().context.prepared ||
+        (!gState.building && (gState.progressive || (gState.detail > Q(0))))) {
+      const Q pixels = std::min(gState.width, gState.height);
+      const std::string k = generatedKey;
+      const geometry &g = (gState.building && generated)
+                              ? *generated
+                              : gState.progressive ? refine(pixels)
+                                                   : faces(pixels, true);
+      if (k != generatedKey) {
+        gState.opengl().context.prepared = false;
+      }
+      if (!gState.opengl().context.prepared) {
+        std::cerr << gState.opengl() << g;
+        tally(g);
+      }
     }
 
-    gState.opengl.frameEnd();
+    gState.opengl().frameEnd();
 
     return true;
   }
 #endif
 
 protected:
+#if !defined(NO_OPENGL) && !defined(GL_ES_VERSION_2_0)
+  /**\brief Render with vertex shader projection
+   *
+   * Draws the model with a gpu::mesh instead of libefgy's OpenGL renderer.
+   * The model's vertices are only uploaded when its geometry changes; for
+   * each frame, the state's matrices are folded into a single view chain
+   * that goes all the way to clip space, and the shader applies that. Used
+   * for models with more than three dimensions, unless fractal flame
+   * colouring is turned on.
+   *
+   * \returns 'true' if the model was drawn; 'false' if the shader isn't
+   *          available, in which case libefgy's renderer should be used.
+   */
+  bool shader(void) {
+    const Q pixels = std::min(gState.width, gState.height);
+    const geometry &g = (gState.building && generated)
+                            ? *generated
+                            : gState.progressive ? refine(pixels)
+                                                 : faces(pixels, true);
+
+    if (uploadedKey != generatedKey) {
+      if (!uploaded.upload(g)) {
+        return false;
+      }
+      uploadedKey = generatedKey;
+      tally(g);
+    }
+
+    const std::size_t rd = modelType::renderDepth;
+    const view::chain<Q, rd, 3> project(gState);
+    const state<Q, 3> &s = gState;
+    std::array<Q, 16> tp;
+    std::array<Q, (rd + 1) * 4> clip;
+
+    for (std::size_t i = 0; i < 4; i++) {
+      for (std::size_t j = 0; j < 4; j++) {
+        Q v = Q(0);
+        for (std::size_t k = 0; k < 4; k++) {
+          v += s.transformation.matrix[i][k] * s.projection.matrix[k][j];
+        }
+        tp[i * 4 + j] = v;
+      }
+    }
+
+    for (std::size_t i = 0; i <= rd; i++) {
+      for (std::size_t j = 0; j < 4; j++) {
+        Q v = Q(0);
+        for (std::size_t k = 0; k < 4; k++) {
+          v += project.matrix[i * 4 + k] * tp[k * 4 + j];
+        }
+        clip[i * 4 + j] = v;
+      }
+    }
+
+    glViewport(0, 0, GLsizei(gState.width), GLsizei(gState.height));
+    glClearColor(gState.background.red, gState.background.green,
+                 gState.background.blue, gState.background.alpha);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    uploaded.draw(clip, rgba(gState.surface), rgba(gState.wireframe));
+
+    // libefgy's buffers are stale now, in case it's needed again.
+    gState.opengl().context.prepared = false;
+
+    return true;
+  }
+
+  /**\brief Convert colour for shader
+   *
+   * \param[in] c A colour as used by the state object.
+   *
+   * \returns The same colour as an RGBA array.
+   */
+  static std::array<GLfloat, 4>
+  rgba(const efgy::math::vector<Q, 4, efgy::math::format::RGB> &c) {
+    return {{GLfloat(c.red), GLfloat(c.green), GLfloat(c.blue),
+             GLfloat(c.alpha)}};
+  }
+#endif
+
+  /**\brief Image viewport size
+   *
+   * \returns The smaller of the state's image sides, in pixels, as used by
+   *          the SVG, PNG and binary mesh output.
+   */
+  Q viewport(void) const {
+    return Q(std::min(gState.imageWidth, gState.imageHeight));
+  }
+
+  /**\brief Generate model geometry
+   *
+   * Looks up or generates the geometry for the given parameters, using a
+   * separate model instance if it isn't in the state's geometry cache yet.
+   *
+   * \param[in] p The parameters to generate the model with.
+   *
+   * \returns The model's geometry.
+   */
+  const geometry &generate(const efgy::geometry::parameters<Q> &p) {
+    const std::string k = key(p);
+
+    if (!generated || (k != generatedKey)) {
+      generated = std::static_pointer_cast<geometry>(gState.cache.find(k));
+      if (!generated) {
+        stats::scope timer(stats::tModel);
+        const modelType model(p, tag);
+        generated = std::make_shared<geometry>(model);
+        gState.cache.insert(k, generated);
+      }
+      generatedKey = k;
+    }
+
+    return *generated;
+  }
+
+  /**\brief Count faces and vertices
+   *
+   * Adds the given geometry's faces and vertices to the global statistics.
+   *
+   * \param[in] g The geometry that was rendered.
+   */
+  static void tally(const geometry &g) {
+    stats::count(stats::cFaces, g.size());
+    stats::count(stats::cVertices, g.vertices.size());
+  }
+
+  /**\brief Count bytes written
+   *
+   * Adds the number of bytes written to a stream since the given position to
+   * the global statistics. Streams that can't report their position, e.g.
+   * pipes, are not counted.
+   *
+   * \param[in] output The stream that was written to.
+   * \param[in] start  The stream's position before writing.
+   */
+  static void written(std::ostream &output, const std::streamoff &start) {
+    const std::streamoff end = output.tellp();
+    if (start >= 0 && end >= start) {
+      stats::count(stats::cBytes, std::uint64_t(end - start));
+    }
+  }
+
+  /**\brief Convert colour for rasteriser
+   *
+   * \param[in] c A colour as used by the state object.
+   *
+   * \returns The same colour as a raster::colour.
+   */
+  static raster::colour
+  colour(const efgy::math::vector<Q, 4, efgy::math::format::RGB> &c) {
+    return {float(c.red), float(c.green), float(c.blue), float(c.alpha)};
+  }
+
   /**\brief Global state object
    *
    * A reference to the global state object, which was passed to
@@ -312,6 +1639,61 @@ protected:
    * trying to create a representation of.
    */
   modelType object;
+
+  /**\brief Vector format tag
+   *
+   * The tag that 'object' was created with; used to create the models for
+   * other levels of detail and iterations.
+   */
+  const format tag;
+
+  /**\brief Current level of detail
+   *
+   * The precision last picked by precision() for interactive output, or 0
+   * if there is none yet.
+   */
+  Q level;
+
+  /**\brief Current geometry
+   *
+   * The geometry returned by the last call to faces(); shared with the
+   * state's geometry cache.
+   */
+  std::shared_ptr<geometry> generated;
+
+  /**\brief Key of current geometry
+   *
+   * The cache key that 'generated' was looked up with.
+   */
+  std::string generatedKey;
+
+  /**\brief Output buffer
+   *
+   * Storage for the buffered SVG writer and binary meshes; kept around so
+   * that subsequent renders don't have to allocate it again.
+   */
+  std::vector<char> buffer;
+
+  /**\brief Projected vertices
+   *
+   * Storage for the 2D vertices of the buffered SVG writer and binary
+   * meshes; kept around for the same reason as 'buffer'.
+   */
+  view::vertices<Q, 2> projected;
+
+#if !defined(NO_OPENGL) && !defined(GL_ES_VERSION_2_0)
+  /**\brief Uploaded mesh
+   *
+   * The geometry drawn by shader(), in OpenGL buffers.
+   */
+  gpu::mesh<modelType::renderDepth> uploaded;
+
+  /**\brief Key of uploaded mesh
+   *
+   * The cache key of the geometry in 'uploaded', or empty if there is none.
+   */
+  std::string uploadedKey;
+#endif
 };
 }
 }
@@ -0,0 +1,669 @@
+/**\file
+ * \brief Render server
+ *
+ * Contains the server mode of the CLI frontend, which keeps a pool of worker
+ * threads with their own state objects around and renders requests sent to
+ * it over a local socket. Models and their geometry stay cached between
+ * requests, so a request only pays for what actually changed since the
+ * worker's previous request.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_SERVER_H)
+#define TOPOLOGIC_SERVER_H
+
+#include <topologic/batch.h>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace topologic {
+/**\brief Render server
+ *
+ * Contains the classes and functions used by the server mode.
+ *
+ * The protocol is line based: each line that a client sends is a request,
+ * in the same form as a line of a batch manifest - a list of command line
+ * arguments - or a JSON state object, as written by the JSON output mode.
+ * The line 'stats' requests the statistics report instead. Each request is
+ * answered with a line of the form 'OK N' or 'ERROR N', followed by N bytes
+ * of output or of an error message. Clients may send any number of requests
+ * over one connection.
+ */
+namespace server {
+/**\brief Open listening socket
+ *
+ * \param[in] address Either a TCP port number up to 65535, to listen on the
+ *                    loopback interface, or the path of a Unix domain socket
+ *                    to create; an existing file of that name is replaced.
+ *
+ * \returns The listening socket, or -1 on error.
+ */
+static inline int listen(const std::string &address) {
+  const bool port =
+      !address.empty() &&
+      (address.find_first_not_of("0123456789") == std::string::npos);
+  int fd = -1;
+  bool ok = false;
+
+  if (port) {
+    // checking the length first keeps stoul() from overflowing.
+    if ((address.size() > 5) || (std::stoul(address) > 65535)) {
+      std::cerr << "error: " << address << " is not a valid port\n";
+      return -1;
+    }
+
+    struct sockaddr_in in;
+    std::memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons((unsigned short)(std::stoul(address)));
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    const int yes = 1;
+    ok = (fd >= 0) &&
+         (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == 0) &&
+         (bind(fd, (struct sockaddr *)&in, sizeof(in)) == 0);
+  } else {
+    struct sockaddr_un un;
+    std::memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    if (address.size() < sizeof(un.sun_path)) {
+      std::strcpy(un.sun_path, address.c_str());
+      unlink(address.c_str());
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      ok = (fd >= 0) && (bind(fd, (struct sockaddr *)&un, sizeof(un)) == 0);
+    }
+  }
+
+  if (!ok || (::listen(fd, 64) != 0)) {
+    std::cerr << "error: could not listen on " << address << "\n";
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+
+  return fd;
+}
+
+/**\brief Client connection
+ *
+ * Reads requests from and writes replies to a connected socket, which is
+ * closed when the connection object is destroyed.
+ */
+class connection {
+public:
+  /**\brief Construct with socket
+   *
+   * \param[in] pFD The connected socket.
+   */
+  connection(int pFD) : fd(pFD) {
+#if defined(SO_NOSIGPIPE)
+    const int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+  }
+
+  connection(const connection &) = delete;
+
+  ~connection(void) { close(fd); }
+
+  /**\brief Maximum request size
+   *
+   * The longest line, in bytes, that read() accepts.
+   */
+  static const std::size_t limit = 1 << 20;
+
+  /**\brief Socket
+   *
+   * \returns The connected socket, e.g. to poll() it.
+   */
+  int descriptor(void) const { return fd; }
+
+  /**\brief Receive data
+   *
+   * Reads whatever the client has sent so far into the read buffer, with a
+   * single recv() call; this only blocks if nothing has arrived yet.
+   *
+   * \returns 'false' once the client has closed the connection.
+   */
+  bool receive(void) {
+    char buffer[4096];
+    const ssize_t r = recv(fd, buffer, sizeof(buffer), 0);
+    if (r <= 0) {
+      return false;
+    }
+    input.append(buffer, std::size_t(r));
+    return true;
+  }
+
+  /**\brief Is a request waiting?
+   *
+   * \returns 'true' if read() can return without waiting for the client,
+   *          i.e. if a whole line or more than 'limit' bytes are buffered.
+   */
+  bool pending(void) const {
+    return (input.find('\n') != std::string::npos) || (input.size() > limit);
+  }
+
+  /**\brief Read request
+   *
+   * Lines longer than 'limit' are answered with an error, after which the
+   * connection is given up, so that a client can't make the server buffer
+   * an unbounded amount of data.
+   *
+   * \param[out] line Receives the next line, without the line break.
+   *
+   * \returns 'true' if a line was read, 'false' once the client has closed
+   *          the connection or sent a line that is too long.
+   */
+  bool read(std::string &line) {
+    while (true) {
+      const std::size_t n = input.find('\n');
+      if (n != std::string::npos) {
+        line = input.substr(0, n);
+        input.erase(0, n + 1);
+        if (!line.empty() && (line.back() == '\r')) {
+          line.pop_back();
+        }
+        return true;
+      }
+
+      if (input.size() > limit) {
+        input.clear();
+        write(false, "request too long\n");
+        return false;
+      }
+
+      if (!receive()) {
+        return false;
+      }
+    }
+  }
+
+  /**\brief Write reply
+   *
+   * \param[in] ok      Whether the request succeeded.
+   * \param[in] payload The output or error message to send.
+   *
+   * \returns 'true' if the whole reply was sent.
+   */
+  bool write(bool ok, const std::string &payload) {
+    return write(ok, payload.data(), payload.size());
+  }
+
+  /**\brief Write reply from memory
+   *
+   * Like the above, but sends the payload straight from the given memory,
+   * e.g. a render cache entry's mapped file.
+   *
+   * \param[in] ok   Whether the request succeeded.
+   * \param[in] data The output or error message to send.
+   * \param[in] size The number of bytes in 'data'.
+   *
+   * \returns 'true' if the whole reply was sent.
+   */
+  bool write(bool ok, const char *data, const std::size_t &size) {
+    std::ostringstream header("");
+    header << (ok ? "OK " : "ERROR ") << size << "\n";
+    const std::string h = header.str();
+    return send(h.data(), h.size()) && send(data, size);
+  }
+
+protected:
+  /**\brief Send data
+   *
+   * \param[in] data The bytes to send.
+   * \param[in] size The number of bytes in 'data'.
+   *
+   * \returns 'true' if all of the data was sent.
+   */
+  bool send(const char *data, const std::size_t &size) {
+#if defined(MSG_NOSIGNAL)
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    for (std::size_t i = 0; i < size;) {
+      const ssize_t w = ::send(fd, data + i, size - i, flags);
+      if (w <= 0) {
+        return false;
+      }
+      i += std::size_t(w);
+    }
+    return true;
+  }
+
+  /**\brief Socket
+   *
+   * The connected socket.
+   */
+  const int fd;
+
+  /**\brief Read buffer
+   *
+   * Data received but not yet returned by read().
+   */
+  std::string input;
+};
+
+/**\brief Connection queue
+ *
+ * Hands connections between run()'s polling loop and the workers. The loop
+ * watches idle connections and queues each one as soon as a whole request
+ * has arrived on it; a worker takes one connection at a time off the queue,
+ * answers a single request and hands the connection back. So a client that
+ * keeps its connection open only holds up a worker while one of its requests
+ * is actually being rendered.
+ */
+class queue {
+public:
+  /**\brief Default constructor
+   *
+   * Creates the pipe that wakes the polling loop up when connections are
+   * handed back; check 'valid' to see if that worked.
+   */
+  queue(void) : valid(pipe(wake) == 0), stopped(false) {}
+
+  queue(const queue &) = delete;
+
+  /**\brief Destructor
+   *
+   * Closes the wakeup pipe; queued connections are closed as well.
+   */
+  ~queue(void) {
+    if (valid) {
+      close(wake[0]);
+      close(wake[1]);
+    }
+  }
+
+  /**\brief Queue connection
+   *
+   * \param[in] c A connection with a request waiting; see
+   *              connection::pending().
+   */
+  void push(std::unique_ptr<connection> c) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.push_back(std::move(c));
+    available.notify_one();
+  }
+
+  /**\brief Take connection
+   *
+   * Waits until a connection with a request is queued.
+   *
+   * \returns The connection that has waited the longest, or 0 once stop()
+   *          has been called.
+   */
+  std::unique_ptr<connection> pop(void) {
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this]()->bool {
+      return stopped || !ready.empty();
+    });
+    std::unique_ptr<connection> c;
+    if (!stopped) {
+      c = std::move(ready.front());
+      ready.pop_front();
+    }
+    return c;
+  }
+
+  /**\brief Hand connection back
+   *
+   * Queues the connection again if its client has already sent another
+   * request, behind all of the other waiting connections; otherwise it is
+   * handed back to the polling loop.
+   *
+   * \param[in] c The connection a worker has answered a request on.
+   */
+  void done(std::unique_ptr<connection> c) {
+    if (c->pending()) {
+      push(std::move(c));
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    idle.push_back(std::move(c));
+    const char b = 0;
+    if (::write(wake[1], &b, 1) < 0) {
+      // the pipe is full, so the loop is going to wake up anyway.
+    }
+  }
+
+  /**\brief Collect idle connections
+   *
+   * Called by the polling loop once the wakeup pipe is readable.
+   *
+   * \param[out] connections Receives the connections handed back with
+   *                         done().
+   */
+  void collect(std::vector<std::unique_ptr<connection>> &connections) {
+    char buffer[64];
+    if (::read(wake[0], buffer, sizeof(buffer)) < 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &c : idle) {
+      connections.push_back(std::move(c));
+    }
+    idle.clear();
+  }
+
+  /**\brief Stop workers
+   *
+   * Makes pop() return 0 from now on, so that the workers exit.
+   */
+  void stop(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    available.notify_all();
+  }
+
+  /**\brief Was the wakeup pipe created?
+   *
+   * Set by the constructor.
+   */
+  const bool valid;
+
+  /**\brief Wakeup pipe
+   *
+   * done() writes a byte to the second descriptor whenever it hands a
+   * connection back; the polling loop polls the first one.
+   */
+  int wake[2];
+
+protected:
+  /**\brief Queue lock
+   *
+   * Protects all of the members below.
+   */
+  std::mutex mutex;
+
+  /**\brief Queue signal
+   *
+   * Notified when a connection is queued or the queue is stopped.
+   */
+  std::condition_variable available;
+
+  /**\brief Waiting connections
+   *
+   * Connections with a request waiting, oldest first.
+   */
+  std::deque<std::unique_ptr<connection>> ready;
+
+  /**\brief Idle connections
+   *
+   * Connections handed back with done() but not yet collected.
+   */
+  std::vector<std::unique_ptr<connection>> idle;
+
+  /**\brief Stopped?
+   *
+   * Set by stop().
+   */
+  bool stopped;
+};
+
+/**\brief Check request argument
+ *
+ * Requests may only select the model, the output format, the camera and the
+ * model's parameters. Anything that reaches the server's file system - the
+ * render cache, batch manifests, input files - or changes how the server
+ * runs, e.g. its number of threads, is refused, as is anything that isn't an
+ * option at all.
+ *
+ * \param[in] arg The argument to check.
+ *
+ * \returns 'true' if requests may use the argument.
+ */
+static inline bool allowed(const std::string &arg) {
+  static const std::regex options(
+      "-{0,2}((m(odel)?|r(andom)?|R|radius|p|precision|c|constant|i|"
+      "iterations|f(rom)?|t(ransform)?|digits|size|lod):.+|colour(:.+)?|"
+      "compress[:=].+|compact|none|json|svg|arguments|binary(:raw)?|png)");
+  return std::regex_match(arg, options);
+}
+
+/**\brief Handle request
+ *
+ * Renders a single request with the given state object, using the batch
+ * mode's job handling; see batch::apply(). Requests with arguments that
+ * aren't allowed() are refused, and none of their arguments are read as
+ * input files.
+ *
+ * With a render cache, output that is already in the cache is not copied to
+ * 'reply'; it is returned in 'hit' instead, so that it can be sent straight
+ * from its mapped file. Anything else that is rendered is stored in the
+ * cache.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[out] topologicState The worker's state object.
+ * \param[in]  prototype      The state object set up from the command line;
+ *                            each request starts from its settings.
+ * \param[in]  line           The request.
+ * \param[in]  programme      The programme name, as in argv[0].
+ * \param[in]  out            Output mode for requests that don't select one.
+ * \param[out] reply          Receives the output or an error message.
+ * \param[out] hit            Receives the cached output, if there is any.
+ *
+ * \returns 'true' if the request was rendered successfully.
+ */
+template <typename Q, std::size_t d>
+static bool respond(state<Q, d> &topologicState, const state<Q, d> &prototype,
+                    const std::string &line, const std::string &programme,
+                    enum outputMode out, std::string &reply,
+                    std::unique_ptr<const store::entry> &hit) {
+  hit.reset();
+
+  if (line == "stats") {
+    std::ostringstream s("");
+    stats::report(s);
+    reply = s.str();
+    return true;
+  }
+
+  stats::sample timer(stats::dRequest);
+
+  const std::size_t start = line.find_first_not_of(" \t");
+  const bool json = (start != std::string::npos) && (line[start] == '{');
+  const batch::manifest m(json ? "[" + line + "]" : line, "request");
+
+  if (!m.valid || (m.jobs.size() != 1)) {
+    reply = "invalid request\n";
+    return false;
+  }
+
+  for (const std::string &arg : m.jobs[0].args) {
+    if (!allowed(arg)) {
+      reply = "option not allowed in requests: " + arg + "\n";
+      return false;
+    }
+  }
+
+  if (!batch::apply(topologicState, prototype, m, 0, programme, out, false)) {
+    reply = "invalid request\n";
+    return false;
+  }
+
+  std::string key;
+  if (!topologicState.outputCache.empty()) {
+    hit = store::find(topologicState, out, topologicState.compression, key);
+    if (hit) {
+      reply.clear();
+      return true;
+    }
+  }
+
+  std::ostringstream s("");
+  if (!write(s, topologicState, out)) {
+    reply = "could not render request\n";
+    return false;
+  }
+
+  reply = s.str();
+  if (!key.empty()) {
+    store::directory(topologicState.outputCache).insert(key, reply);
+  }
+  return true;
+}
+
+/**\brief Run render server
+ *
+ * Listens on the given address and handles requests with a pool of worker
+ * threads until the process is terminated. The calling thread accepts
+ * connections and polls the idle ones, and queues each connection that has
+ * a request waiting; see queue. Workers answer one request per connection
+ * that they take off the queue, so any number of clients may keep their
+ * connections open. Each worker has its own state object, whose models and
+ * geometry cache stay warm between requests, and each request starts from
+ * the prototype's settings.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[in] prototype The state object set up from the command line.
+ * \param[in] address   The address to listen on; see listen().
+ * \param[in] programme The programme name, as in argv[0].
+ * \param[in] out       Output mode for requests that don't select one.
+ * \param[in] threads   Number of worker threads to use; 0 for one per core.
+ *
+ * \returns 'false' if the server could not be started.
+ */
+template <typename Q, std::size_t d>
+static bool run(const state<Q, d> &prototype, const std::string &address,
+                const std::string &programme, const enum outputMode &out,
+                std::size_t threads) {
+  const int fd = listen(address);
+  if (fd < 0) {
+    return false;
+  }
+
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+
+  queue requests;
+  if (!requests.valid) {
+    std::cerr << "error: could not create wakeup pipe\n";
+    close(fd);
+    return false;
+  }
+
+  std::vector<std::thread> workers;
+
+  for (std::size_t t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&prototype, &programme, &out, &requests]() {
+      state<Q, d> topologicState;
+      topologicState.threads = 1;
+      std::string line, reply;
+      std::unique_ptr<const store::entry> hit;
+
+      while (true) {
+        std::unique_ptr<connection> c = requests.pop();
+        if (!c) {
+          return;
+        }
+        // pending() guarantees that this doesn't wait for the client.
+        if (!c->read(line)) {
+          continue;
+        }
+        if (line.find_first_not_of(" \t") != std::string::npos) {
+          const bool ok = respond(topologicState, prototype, line, programme,
+                                  out, reply, hit);
+          if (!(hit ? c->write(ok, hit->data, hit->size)
+                    : c->write(ok, reply))) {
+            continue;
+          }
+        }
+        requests.done(std::move(c));
+      }
+    }));
+  }
+
+  std::vector<std::unique_ptr<connection>> idle;
+  std::vector<struct pollfd> fds;
+
+  while (true) {
+    fds.resize(idle.size() + 2);
+    fds[0].fd = fd;
+    fds[1].fd = requests.wake[0];
+    for (std::size_t i = 0; i < idle.size(); i++) {
+      fds[i + 2].fd = idle[i]->descriptor();
+    }
+    for (auto &p : fds) {
+      p.events = POLLIN;
+      p.revents = 0;
+    }
+
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "error: could not poll connections\n";
+      break;
+    }
+
+    // going backwards keeps the remaining connections lined up with 'fds'
+    // while others are taken out.
+    for (std::size_t i = fds.size() - 2; i-- > 0;) {
+      if (fds[i + 2].revents == 0) {
+        continue;
+      }
+      if (!idle[i]->receive()) {
+        idle.erase(idle.begin() + i);
+      } else if (idle[i]->pending()) {
+        requests.push(std::move(idle[i]));
+        idle.erase(idle.begin() + i);
+      }
+    }
+
+    if (fds[1].revents != 0) {
+      requests.collect(idle);
+    }
+
+    if (fds[0].revents != 0) {
+      const int client = accept(fd, 0, 0);
+      if (client >= 0) {
+        idle.push_back(std::unique_ptr<connection>(new connection(client)));
+      } else if ((errno != EINTR) && (errno != ECONNABORTED)) {
+        std::cerr << "error: could not accept connection\n";
+        break;
+      }
+    }
+  }
+
+  requests.stop();
+  for (auto &w : workers) {
+    w.join();
+  }
+
+  close(fd);
+  return true;
+}
+}
+}
+
+#endif
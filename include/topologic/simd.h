@@ -0,0 +1,138 @@
+/**\file
+ * \brief SIMD lanes
+ *
+ * Contains thin wrappers around the vector instructions that the vertex
+ * projection kernel uses, with AVX2 and NEON implementations for 'float' and
+ * 'double' and a scalar fallback for everything else.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_SIMD_H)
+#define TOPOLOGIC_SIMD_H
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace topologic {
+/**\brief SIMD helpers
+ *
+ * Contains the lane types used by the vertex projection kernel.
+ */
+namespace simd {
+/**\brief Scalar lane
+ *
+ * Processes a single value at a time; used for the tail end of vectorised
+ * loops.
+ *
+ * \tparam Q Base data type for calculations.
+ */
+template <typename Q> class scalar {
+public:
+  using type = Q;
+
+  /**\brief Lane width
+   *
+   * Number of values processed by each operation.
+   */
+  static const std::size_t width = 1;
+
+  static type load(const Q *p) { return *p; }
+  static void store(Q *p, const type &v) { *p = v; }
+  static type set(const Q &v) { return v; }
+  static type fma(const type &a, const type &b, const type &c) {
+    return a * b + c;
+  }
+  static type div(const type &a, const type &b) { return a / b; }
+};
+
+/**\brief Vector lane
+ *
+ * The widest lane available for a data type on the current target. Falls back
+ * to the scalar lane for data types and targets without a vector
+ * implementation.
+ *
+ * \tparam Q Base data type for calculations.
+ */
+template <typename Q> class lane : public scalar<Q> {};
+
+#if defined(__AVX2__)
+template <> class lane<float> {
+public:
+  using type = __m256;
+  static const std::size_t width = 8;
+
+  static type load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, const type &v) { _mm256_storeu_ps(p, v); }
+  static type set(const float &v) { return _mm256_set1_ps(v); }
+  static type fma(const type &a, const type &b, const type &c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+  }
+  static type div(const type &a, const type &b) { return _mm256_div_ps(a, b); }
+};
+
+template <> class lane<double> {
+public:
+  using type = __m256d;
+  static const std::size_t width = 4;
+
+  static type load(const double *p) { return _mm256_loadu_pd(p); }
+  static void store(double *p, const type &v) { _mm256_storeu_pd(p, v); }
+  static type set(const double &v) { return _mm256_set1_pd(v); }
+  static type fma(const type &a, const type &b, const type &c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_pd(a, b, c);
+#else
+    return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+  }
+  static type div(const type &a, const type &b) { return _mm256_div_pd(a, b); }
+};
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+template <> class lane<float> {
+public:
+  using type = float32x4_t;
+  static const std::size_t width = 4;
+
+  static type load(const float *p) { return vld1q_f32(p); }
+  static void store(float *p, const type &v) { vst1q_f32(p, v); }
+  static type set(const float &v) { return vdupq_n_f32(v); }
+  static type fma(const type &a, const type &b, const type &c) {
+    return vfmaq_f32(c, a, b);
+  }
+  static type div(const type &a, const type &b) { return vdivq_f32(a, b); }
+};
+
+template <> class lane<double> {
+public:
+  using type = float64x2_t;
+  static const std::size_t width = 2;
+
+  static type load(const double *p) { return vld1q_f64(p); }
+  static void store(double *p, const type &v) { vst1q_f64(p, v); }
+  static type set(const double &v) { return vdupq_n_f64(v); }
+  static type fma(const type &a, const type &b, const type &c) {
+    return vfmaq_f64(c, a, b);
+  }
+  static type div(const type &a, const type &b) { return vdivq_f64(a, b); }
+};
+#endif
+}
+}
+
+#endif
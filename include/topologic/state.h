@@ -26,9 +26,11 @@
 #include <ef.gy/render-svg.h>
 #include <ef.gy/render-json.h>
 #include <ef.gy/render-css.h>
+#include <memory>
 #include <sstream>
 #include <type_traits>
 
+#include <topologic/compress.h>
 #include <topologic/render.h>
 
 namespace topologic {
@@ -76,7 +78,29 @@ enum outputMode {
    * Output is supposed to be a set of arguments, which could be passed to the
    * command line topologic binary.
    */
-  outArguments = 5
+  outArguments = 5,
+
+  /**\brief Binary mesh label
+   *
+   * Output is a compact binary mesh: a fixed header, the JSON metadata and
+   * then the model's faces as packed, little-endian arrays of projected 2D
+   * vertices. Meant to be mapped into memory and used without parsing.
+   */
+  outBinary = 6,
+
+  /**\brief Raw binary mesh label
+   *
+   * Same as outBinary, but with the vertices' coordinates before projection,
+   * i.e. with as many coordinates per vertex as the model's render depth.
+   */
+  outBinaryRaw = 7,
+
+  /**\brief PNG label
+   *
+   * Output is a PNG image, rendered with Topologic's own software
+   * rasteriser. Works without an OpenGL context.
+   */
+  outPNG = 8
 };
 
 /**\brief Topologic global programme state object
@@ -120,31 +144,16 @@ public:
 
   /**\brief Default constructor
    *
-   * Sets up default projection and transformation matrices, as well as
-   * an instance of libefgy's SVG renderer. If the NO_OPENGL macro has
-   * not been defined then this constructor will also set up an instance
-   * of libefgy's OpenGL renderer.
+   * Sets up default projection and transformation matrices. libefgy's SVG
+   * and OpenGL renderers for this dimension are only created once they are
+   * first used; see svg() and opengl().
    */
   state(void)
       : projection(efgy::math::vector<Q, d>(), efgy::math::vector<Q, d>(),
                    Q(M_PI_4), false),
-        from(projection.from), to(projection.to),
-#if !defined(NO_OPENGL)
-        opengl(transformation, projection, state<Q, d - 1>::opengl),
-#endif
-        svg(transformation, projection, state<Q, d - 1>::svg), active(d == 3) {
-    if (d == 3) {
-      fromp[0] = 3;
-      fromp[1] = 1;
-      fromp[2] = 1;
-    } else {
-      fromp[0] = 2;
-      for (int i = 1; i < d; i++) {
-        fromp[i] = 1.57;
-      }
-    }
-  
-    from = fromp;
+        from(projection.from), to(projection.to), dirty(true),
+        active(d == 3) {
+    resetCamera();
   }
 
   /**\brief Polar 'from' point
@@ -186,38 +195,118 @@ public:
 
   /**\brief libefgy SVG renderer instance
    *
-   * This is an instance of libefgy's SVG renderer for this template's
-   * render depth.
+   * Returns libefgy's SVG renderer for this template's render depth,
+   * creating it - and those of the lower dimensions - on first use. So a
+   * state with a high maximum render depth only sets up renderers for the
+   * dimensions that its models are actually rendered in.
+   *
+   * \returns The SVG renderer for this dimension.
    */
-  typename efgy::render::svg<Q, d> svg;
+  typename efgy::render::svg<Q, d> &svg(void) {
+    if (!svgRenderer) {
+      svgRenderer.reset(new efgy::render::svg<Q, d>(transformation, projection,
+                                                    parent::svg()));
+    }
+    return *svgRenderer;
+  }
 
 #if !defined(NO_OPENGL)
   /**\brief libefgy OpenGL renderer instance
    *
-   * This is an instance of libefgy's OpenGL renderer for this template's
-   * render depth.
+   * Returns libefgy's OpenGL renderer for this template's render depth,
+   * creating it - and those of the lower dimensions - on first use, like
+   * svg().
+   *
+   * \returns The OpenGL renderer for this dimension.
    */
-  typename efgy::render::opengl<Q, d> opengl;
+  typename efgy::render::opengl<Q, d> &opengl(void) {
+    if (!openglRenderer) {
+      openglRenderer.reset(new efgy::render::opengl<Q, d>(
+          transformation, projection, parent::opengl()));
+    }
+    return *openglRenderer;
+  }
 #endif
 
+  /**\brief Projection needs to be updated
+   *
+   * Set whenever something changes that the projection matrix of this
+   * dimension depends on, e.g. the 'from' point or the coordinate mode.
+   * Frontends that modify 'from' or 'fromp' directly should call
+   * invalidateMatrix() afterwards.
+   */
+  bool dirty;
+
   /**\brief Update projection matrices
    *
    * Resets the projection matrix's parameters and forces it to be updated
    * with the new parameters, then keeps doing so recursively for all its
-   * parent classes.
+   * parent classes. Dimensions whose projection hasn't changed since the
+   * last update are skipped; the aspect ratio of the 3D projection is
+   * compared to the current viewport each time.
    *
    * \returns 'true' when matrices have been updated successfully.
    */
   bool updateMatrix(void) {
-    projection.aspect =
-        (d == 3) ? Q(base::width) / Q(base::height) : Q(1);
-    if (base::polarCoordinates) {
-      from = fromp;
+    stats::scope timer(stats::tMatrix);
+    const Q aspect = (d == 3) ? Q(base::width) / Q(base::height) : Q(1);
+    if (dirty || !(projection.aspect == aspect)) {
+      projection.aspect = aspect;
+      if (base::polarCoordinates) {
+        from = fromp;
+      }
+      projection.updateMatrix();
+      dirty = false;
     }
-    projection.updateMatrix();
     return state<Q, d - 1>::updateMatrix();
   }
 
+  /**\brief Mark projection matrices as stale
+   *
+   * Forces the next call to updateMatrix() to recalculate the projection
+   * matrices of all dimensions.
+   *
+   * \returns 'true', as this cannot fail.
+   */
+  bool invalidateMatrix(void) {
+    dirty = true;
+    return state<Q, d - 1>::invalidateMatrix();
+  }
+
+  /**\brief Reset to defaults
+   *
+   * Resets the cameras, transformation matrices and all of the settings in
+   * the 1D fix point to the values that a freshly constructed state object
+   * would have. The model is kept, so that a subsequent render with the same
+   * model type doesn't need to create a new one.
+   *
+   * \returns 'true' when all dimensions have been reset.
+   */
+  bool reset(void) {
+    resetCamera();
+    return state<Q, d - 1>::reset();
+  }
+
+  /**\brief Copy settings
+   *
+   * Sets the cameras, transformation matrices and all of the settings in
+   * the 1D fix point to those of another state object, e.g. one that was
+   * set up from the command line. The model, the geometry cache and the
+   * renderers are not copied; like with reset(), the model is kept.
+   *
+   * \param[in] prototype The state object to copy the settings of.
+   *
+   * \returns 'true' when all dimensions have been copied.
+   */
+  bool assign(const state &prototype) {
+    fromp = prototype.fromp;
+    from = prototype.from;
+    transformation = prototype.transformation;
+    active = prototype.active;
+    dirty = true;
+    return state<Q, d - 1>::assign(prototype);
+  }
+
   bool invalidateCache(void) {
 #if !defined(NO_OPENGL)
 #if defined(TRANSFORM_4D_IN_PIXEL_SHADER)
@@ -226,7 +315,7 @@ public:
     if (d > 3)
 #endif
     {
-      opengl.context.prepared = false;
+      opengl().context.prepared = false;
     }
 #endif
 
@@ -377,6 +466,7 @@ public:
     }
 
     invalidateCache();
+    dirty = true;
 
     if (base::polarCoordinates) {
       fromp[coord] = value;
@@ -443,6 +533,7 @@ public:
    */
   bool translatePolarToCartesian(void) {
     from = fromp;
+    dirty = true;
     return state<Q, d - 1>::translatePolarToCartesian();
   }
 
@@ -457,6 +548,7 @@ public:
    */
   bool translateCartesianToPolar(void) {
     fromp = from;
+    dirty = true;
     return state<Q, d - 1>::translateCartesianToPolar();
   }
 
@@ -566,6 +658,28 @@ public:
   }
 
 protected:
+  /**\brief Reset camera and transformation
+   *
+   * Sets this dimension's 'from' point and affine transformation matrix to
+   * their default values. Unlike reset(), this does not recurse.
+   */
+  void resetCamera(void) {
+    if (d == 3) {
+      fromp[0] = 3;
+      fromp[1] = 1;
+      fromp[2] = 1;
+    } else {
+      fromp[0] = 2;
+      for (int i = 1; i < d; i++) {
+        fromp[i] = 1.57;
+      }
+    }
+
+    from = fromp;
+    transformation = efgy::geometry::transformation::affine<Q, d>();
+    dirty = true;
+  }
+
   /**\brief Is this the currently active dimension?
    *
    * Certain state-modifying methods need to know which dimension is
@@ -576,6 +690,20 @@ protected:
    * You should only set this flag with the setActive() method.
    */
   bool active;
+
+  /**\brief SVG renderer
+   *
+   * The renderer returned by svg(), or 0 until it is first used.
+   */
+  std::unique_ptr<efgy::render::svg<Q, d>> svgRenderer;
+
+#if !defined(NO_OPENGL)
+  /**\brief OpenGL renderer
+   *
+   * The renderer returned by opengl(), or 0 until it is first used.
+   */
+  std::unique_ptr<efgy::render::opengl<Q, d>> openglRenderer;
+#endif
 };
 
 /**\brief Topologic programme state (1D fix point)
@@ -598,14 +726,41 @@ public:
    * defaults.
    */
   state(void)
-      : polarCoordinates(true), svg(),
-#if !defined(NO_OPENGL)
-        opengl(),
-#endif
-        background(Q(1), Q(1), Q(1), Q(1)), wireframe(Q(0), Q(0), Q(0), Q(0.8)),
-        surface(Q(0), Q(0), Q(0), Q(0.2)), fractalFlameColouring(false),
-        model(0) {
+      : polarCoordinates(true), background(Q(1), Q(1), Q(1), Q(1)),
+        wireframe(Q(0), Q(0), Q(0), Q(0.8)), surface(Q(0), Q(0), Q(0), Q(0.2)),
+        fractalFlameColouring(false),
+        digits(-1), compact(false), compression(compress::mNone),
+        imageWidth(1024), imageHeight(1024), threads(0), detail(0),
+        progressive(false), building(false), model(0) {
+    parameter.radius = Q(1);
+    parameter.precision = Q(10);
+    parameter.iterations = 4;
+    parameter.functions = 3;
+    parameter.seed = 0;
+    parameter.preRotate = true;
+    parameter.postRotate = false;
+    parameter.flameCoefficients = 3;
+  }
+
+  /**\brief Reset to defaults; 1D fix point
+   *
+   * Restores the colours, model parameters and coordinate mode to the values
+   * set by the default constructor. The model pointer is left untouched.
+   *
+   * \returns 'true', as there is nothing that could fail here.
+   */
+  bool reset(void) {
+    polarCoordinates = true;
+    background = efgy::math::vector<Q, 4, efgy::math::format::RGB>(
+        Q(1), Q(1), Q(1), Q(1));
+    wireframe = efgy::math::vector<Q, 4, efgy::math::format::RGB>(
+        Q(0), Q(0), Q(0), Q(0.8));
+    surface = efgy::math::vector<Q, 4, efgy::math::format::RGB>(
+        Q(0), Q(0), Q(0), Q(0.2));
+    fractalFlameColouring = false;
     parameter.radius = Q(1);
+    parameter.radius2 = Q(0.5);
+    parameter.constant = Q(0.9);
     parameter.precision = Q(10);
     parameter.iterations = 4;
     parameter.functions = 3;
@@ -613,6 +768,38 @@ public:
     parameter.preRotate = true;
     parameter.postRotate = false;
     parameter.flameCoefficients = 3;
+    return true;
+  }
+
+  /**\brief Copy settings; 1D fix point
+   *
+   * Copies the colours, model parameters, coordinate mode and all of the
+   * output settings of another state object. The model pointer, geometry
+   * cache and renderers are left untouched, as is the 'building' flag.
+   *
+   * \param[in] prototype The state object to copy the settings of.
+   *
+   * \returns 'true', as there is nothing that could fail here.
+   */
+  bool assign(const state &prototype) {
+    polarCoordinates = prototype.polarCoordinates;
+    parameter = prototype.parameter;
+    background = prototype.background;
+    wireframe = prototype.wireframe;
+    surface = prototype.surface;
+    width = prototype.width;
+    height = prototype.height;
+    fractalFlameColouring = prototype.fractalFlameColouring;
+    digits = prototype.digits;
+    compact = prototype.compact;
+    compression = prototype.compression;
+    outputCache = prototype.outputCache;
+    imageWidth = prototype.imageWidth;
+    imageHeight = prototype.imageHeight;
+    threads = prototype.threads;
+    detail = prototype.detail;
+    progressive = prototype.progressive;
+    return true;
   }
 
   /**\brief Destructor
@@ -638,6 +825,14 @@ public:
    */
   constexpr bool updateMatrix(void) const { return true; }
 
+  /**\brief Mark projection matrices as stale; 1D fix point
+   *
+   * There's no 1D projection, so there's nothing to mark.
+   *
+   * \returns 'true', as this cannot fail.
+   */
+  constexpr bool invalidateMatrix(void) const { return true; }
+
   /**\brief Apply scale; 1D fix point
    *
    * Applies a scale to the affine transformation matrix; since the 1D
@@ -886,19 +1081,26 @@ public:
    */
   render::base *model;
 
+  /**\brief Model geometry cache
+   *
+   * Keeps the faces of recently rendered models, so that they needn't be
+   * generated again when only the camera, transformations or colours change.
+   */
+  render::cache cache;
+
   /**\brief libefgy SVG renderer instance; 1D fix point
    *
-   * This is an instance of the 1D fix point of libefgy's SVG renderer.
+   * \returns The 1D fix point of libefgy's SVG renderer, which the
+   *          renderers of all higher dimensions are built on.
    */
-  typename efgy::render::svg<Q, 1> svg;
+  typename efgy::render::svg<Q, 1> &svg(void) { return svgRenderer; }
 
 #if !defined(NO_OPENGL)
   /**\brief libefgy OpenGL renderer instance; 1D fix point
    *
-   * This is an instance of the 1D fix point of libefgy's OpenGL
-   * renderer.
+   * \returns The 1D fix point of libefgy's OpenGL renderer.
    */
-  typename efgy::render::opengl<Q, 1> opengl;
+  typename efgy::render::opengl<Q, 1> &opengl(void) { return openglRenderer; }
 #endif
 
   /**\brief Use polar coordinates?
@@ -967,6 +1169,103 @@ public:
    *      describing this colouring algorithm.
    */
   bool fractalFlameColouring;
+
+  /**\brief SVG number precision
+   *
+   * Selects how SVG output is written. With the default of -1, libefgy's SVG
+   * renderer writes the output through iostreams. Values of 0 and above
+   * select Topologic's buffered SVG writer, which formats numbers itself:
+   * with that many fractional digits, or with the shortest round-trip
+   * representation for 0. See output::format().
+   */
+  int digits;
+
+  /**\brief Compact SVG output
+   *
+   * Set to 'true' to write SVGs with the buffered writer in its compact
+   * form: faces outside of the view box and duplicate faces are dropped, and
+   * all others are merged into a single path with integer, relative
+   * coordinates. See render::wrapper::compact().
+   */
+  bool compact;
+
+  /**\brief Output compression
+   *
+   * The method that write() compresses output with; compress::mNone to
+   * write it as is.
+   */
+  compress::method compression;
+
+  /**\brief Render cache
+   *
+   * The directory that the CLI, batch and server modes keep rendered output
+   * in; see store::write(). Empty to render everything anew.
+   */
+  std::string outputCache;
+
+  /**\brief Raster image width
+   *
+   * Width, in pixels, of images produced by the PNG output mode.
+   */
+  std::size_t imageWidth;
+
+  /**\brief Raster image height
+   *
+   * Height, in pixels, of images produced by the PNG output mode.
+   */
+  std::size_t imageHeight;
+
+  /**\brief Worker threads
+   *
+   * Number of worker threads used by the software rasteriser; 0 uses one
+   * worker per processor core.
+   */
+  std::size_t threads;
+
+  /**\brief Adaptive level of detail
+   *
+   * The length, in pixels, that a single tessellation step of a parametric
+   * model should have on screen. When set, renderers pick the model's
+   * precision from its projected size instead of using parameter.precision;
+   * see render::wrapper::precision(). The default of 0 turns this off.
+   */
+  Q detail;
+
+  /**\brief Progressive refinement
+   *
+   * Set to 'true' to have the OpenGL renderer show iterative models, e.g.
+   * IFS and fractal flames, at a coarse iteration first and step up to the
+   * full iteration count one level per frame; see render::wrapper::refine().
+   * Each level is generated in full, so this spreads the work over frames
+   * instead of saving any. Other models are drawn as usual. While this is on, the geometry cache
+   * grows to hold every iteration level up to the current one. The
+   * interactive frontends turn this on.
+   */
+  bool progressive;
+
+  /**\brief New model pending
+   *
+   * Set by topologic::builder while a new model is being generated in the
+   * background. The OpenGL renderer keeps drawing the model's current
+   * geometry in the mean time, instead of generating new geometry for
+   * changed parameters itself.
+   */
+  bool building;
+
+protected:
+  /**\brief SVG renderer; 1D fix point
+   *
+   * The renderer returned by svg().
+   */
+  typename efgy::render::svg<Q, 1> svgRenderer;
+
+#if !defined(NO_OPENGL)
+  /**\brief OpenGL renderer; 1D fix point
+   *
+   * The renderer returned by opengl().
+   */
+  typename efgy::render::opengl<Q, 1> openglRenderer;
+#endif
 };
 
 /**\brief Gather model metadata
@@ -1123,6 +1422,89 @@ template <typename C, typename Q, std::size_t d>
   pState.model->svg(stream.stream, true);
   return stream;
 }
+
+/**\brief Write state in the given output mode
+ *
+ * Renders the given state object's model to a stream, using the output mode
+ * selected with the command line parameters. This is what the CLI frontend
+ * sends to stdout; the batch mode uses it to write to individual files.
+ *
+ * With a compression method other than compress::mNone, the output is
+ * compressed on a separate thread while it is being rendered.
+ *
+ * \param[out] output      The stream to write to.
+ * \param[in]  pState      The state to render.
+ * \param[in]  out         The output mode to use.
+ * \param[in]  compression The compression method to use.
+ *
+ * \returns 'true' if something was written, 'false' if the state has no
+ *          model, the output mode doesn't produce anything or the output
+ *          could not be compressed.
+ *
+ * \tparam Q Base data type; should be a class that acts like a rational
+ *           base arithmetic type.
+ * \tparam d Maximum render depth
+ */
+template <typename Q, std::size_t d>
+static bool write(std::ostream &output, const state<Q, d> &pState,
+                  const enum outputMode &out,
+                  const compress::method &compression) {
+  if (!pState.model) {
+    return false;
+  }
+
+  if (compression != compress::mNone) {
+    compress::ostream z(output, compression);
+    const bool ok = write(z, pState, out, compress::mNone);
+    return z.finish() && ok;
+  }
+
+  switch (out) {
+  case outSVG:
+    output << efgy::svg::tag() << pState;
+    return true;
+  case outJSON:
+    output << efgy::json::tag() << pState;
+    return true;
+  case outBinary:
+    return pState.model->binary(output, false, true);
+  case outBinaryRaw:
+    return pState.model->binary(output, true, true);
+  case outPNG:
+    return pState.model->png(output, true);
+  case outArguments: {
+    std::vector<std::string> v;
+    output << "topologic";
+    for (const auto &arg : pState.args(v)) {
+      output << " " << arg;
+    }
+    output << "\n";
+  }
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**\brief Write state with its own compression setting
+ *
+ * Same as the above, with the state's 'compression' setting.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  pState The state to render.
+ * \param[in]  out    The output mode to use.
+ *
+ * \returns 'true' if something was written.
+ *
+ * \tparam Q Base data type; should be a class that acts like a rational
+ *           base arithmetic type.
+ * \tparam d Maximum render depth
+ */
+template <typename Q, std::size_t d>
+static bool write(std::ostream &output, const state<Q, d> &pState,
+                  const enum outputMode &out) {
+  return write(output, pState, out, pState.compression);
+}
 }
 
 #endif
@@ -0,0 +1,471 @@
+/**\file
+ * \brief Runtime statistics
+ *
+ * Contains scoped timers and counters for Topologic's hot paths, e.g. parsing,
+ * model generation, matrix updates and output. The CLI frontend prints these
+ * with the 'stats' option; other frontends may poll them directly, e.g. to
+ * show frame timings.
+ *
+ * Define the NO_STATS macro to compile out all of the timers and counters;
+ * the statistics then simply stay at zero.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_STATS_H)
+#define TOPOLOGIC_STATS_H
+
+#include <ef.gy/render-json.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace topologic {
+/**\brief Runtime statistics
+ *
+ * Contains the global statistics registry and the helpers that update it.
+ */
+namespace stats {
+/**\brief Timers
+ *
+ * The parts of a render that are timed. Timers are inclusive, so e.g. the
+ * time spent creating a model while parsing an XML file counts towards both
+ * tXML and tModel.
+ */
+enum timer {
+  tOptions, /**< Command line option parsing. */
+  tRead,    /**< Reading input files. */
+  tXML,     /**< Parsing XML and SVG state files. */
+  tJSON,    /**< Parsing JSON state files. */
+  tModel,   /**< Creating models and generating their geometry. */
+  tMatrix,  /**< Updating projection matrices. */
+  tOutput,  /**< Rendering output. */
+  timers
+};
+
+/**\brief Counters
+ *
+ * Quantities counted while rendering output.
+ */
+enum counter {
+  cFaces,    /**< Faces rendered. */
+  cVertices, /**< Vertices rendered. */
+  cBytes,    /**< Bytes of output written. */
+  cHits,     /**< Renders served from the render cache. */
+  cMisses,   /**< Renders not found in the render cache. */
+  counters
+};
+
+/**\brief Distributions
+ *
+ * Durations that are recorded individually, so that percentiles can be
+ * reported in addition to totals.
+ */
+enum distribution {
+  dRequest, /**< Requests handled by the render server. */
+  distributions
+};
+
+/**\brief Timer names
+ *
+ * Used as keys in the JSON report; same order as the timer enum.
+ */
+static const char *const timerNames[] = {"options", "read",   "xml",   "json",
+                                         "model",   "matrix", "output"};
+
+/**\brief Counter names
+ *
+ * Used as keys in the JSON report; same order as the counter enum.
+ */
+static const char *const counterNames[] = {"faces", "vertices", "bytes",
+                                           "cacheHits", "cacheMisses"};
+
+/**\brief Distribution names
+ *
+ * Used as keys in the JSON report; same order as the distribution enum.
+ */
+static const char *const distributionNames[] = {"request"};
+
+/**\brief Duration histogram
+ *
+ * Counts durations in logarithmic buckets, four per power of two, so that
+ * percentiles can be estimated to within 25% without keeping every sample
+ * around. All updates are atomic.
+ */
+class histogram {
+public:
+  histogram(void) { reset(); }
+
+  /**\brief Number of buckets
+   *
+   * Enough to hold any 64-bit duration.
+   */
+  static const std::size_t buckets = 252;
+
+  /**\brief Reset histogram
+   *
+   * Sets all buckets back to zero.
+   */
+  void reset(void) {
+    for (std::size_t i = 0; i < buckets; i++) {
+      bucket[i] = 0;
+    }
+    maximum = 0;
+  }
+
+  /**\brief Add sample
+   *
+   * \param[in] ns The duration to add, in nanoseconds.
+   */
+  void add(const std::uint64_t &ns) {
+    bucket[index(ns)].fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t m = maximum;
+    while ((ns > m) && !maximum.compare_exchange_weak(m, ns)) {
+    }
+  }
+
+  /**\brief Number of samples
+   *
+   * \returns The number of durations added so far.
+   */
+  std::uint64_t count(void) const {
+    std::uint64_t n = 0;
+    for (std::size_t i = 0; i < buckets; i++) {
+      n += bucket[i];
+    }
+    return n;
+  }
+
+  /**\brief Estimate percentile
+   *
+   * \param[in] p The percentile to estimate, between 0 and 1.
+   *
+   * \returns The upper bound of the bucket that the given percentile falls
+   *          into, in nanoseconds, but never more than the longest duration
+   *          added; 0 if there are no samples.
+   */
+  std::uint64_t percentile(const double &p) const {
+    const std::uint64_t n = count();
+    if (n == 0) {
+      return 0;
+    }
+
+    const std::uint64_t rank = std::uint64_t(p * double(n - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets; i++) {
+      seen += bucket[i];
+      if (seen >= rank) {
+        const std::uint64_t bound =
+            i + 1 < buckets ? lower(i + 1) - 1 : std::uint64_t(-1);
+        return bound < maximum ? bound : std::uint64_t(maximum);
+      }
+    }
+    return maximum;
+  }
+
+  /**\brief Longest duration
+   *
+   * \returns The longest duration added so far, in nanoseconds.
+   */
+  std::uint64_t max(void) const { return maximum; }
+
+protected:
+  /**\brief Bucket for duration
+   *
+   * Durations below 4ns have a bucket each; above that, each power of two is
+   * split into four buckets by the two bits after the leading one.
+   *
+   * \param[in] ns A duration, in nanoseconds.
+   *
+   * \returns The index of the bucket that the duration falls into.
+   */
+  static std::size_t index(const std::uint64_t &ns) {
+    if (ns < 4) {
+      return std::size_t(ns);
+    }
+    std::size_t b = 0;
+    for (std::uint64_t n = ns; n > 1; n >>= 1) {
+      b++;
+    }
+    return 4 * (b - 1) + std::size_t((ns >> (b - 2)) & 3);
+  }
+
+  /**\brief Lower bound of bucket
+   *
+   * \param[in] i The index of a bucket.
+   *
+   * \returns The shortest duration that falls into the bucket.
+   */
+  static std::uint64_t lower(const std::size_t &i) {
+    if (i < 4) {
+      return i;
+    }
+    return std::uint64_t(4 + i % 4) << (i / 4 - 1);
+  }
+
+  std::atomic<std::uint64_t> bucket[buckets];
+  std::atomic<std::uint64_t> maximum;
+};
+
+/**\brief Statistics registry
+ *
+ * Holds the accumulated times and counts. All updates are atomic, so the
+ * batch mode's worker threads may share a single registry.
+ */
+class registry {
+public:
+  registry(void) { reset(); }
+
+  /**\brief Reset statistics
+   *
+   * Sets all times and counts back to zero.
+   */
+  void reset(void) {
+    for (std::size_t i = 0; i < timers; i++) {
+      time[i] = 0;
+      number[i] = 0;
+    }
+    for (std::size_t i = 0; i < counters; i++) {
+      value[i] = 0;
+    }
+    for (std::size_t i = 0; i < distributions; i++) {
+      samples[i].reset();
+    }
+  }
+
+  /**\brief Add timing
+   *
+   * \param[in] t  The timer to update.
+   * \param[in] ns The time to add, in nanoseconds.
+   */
+  void add(const timer &t, const std::uint64_t &ns) {
+    time[t].fetch_add(ns, std::memory_order_relaxed);
+    number[t].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**\brief Add to counter
+   *
+   * \param[in] c The counter to update.
+   * \param[in] n The amount to add.
+   */
+  void add(const counter &c, const std::uint64_t &n) {
+    value[c].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /**\brief Add duration sample
+   *
+   * \param[in] t  The distribution to update.
+   * \param[in] ns The duration to add, in nanoseconds.
+   */
+  void add(const distribution &t, const std::uint64_t &ns) {
+    samples[t].add(ns);
+  }
+
+  /**\brief Accumulated time
+   *
+   * \param[in] t The timer to query.
+   *
+   * \returns The total time recorded for the timer, in nanoseconds.
+   */
+  std::uint64_t nanoseconds(const timer &t) const { return time[t]; }
+
+  /**\brief Number of timings
+   *
+   * \param[in] t The timer to query.
+   *
+   * \returns How often the timer has been recorded.
+   */
+  std::uint64_t calls(const timer &t) const { return number[t]; }
+
+  /**\brief Counter value
+   *
+   * \param[in] c The counter to query.
+   *
+   * \returns The counter's current value.
+   */
+  std::uint64_t count(const counter &c) const { return value[c]; }
+
+  /**\brief Duration samples
+   *
+   * \param[in] t The distribution to query.
+   *
+   * \returns The histogram of the distribution's samples.
+   */
+  const histogram &durations(const distribution &t) const {
+    return samples[t];
+  }
+
+  /**\brief Get JSON value
+   *
+   * Modifies the passed-in value so that it contains all of the statistics,
+   * as an object with a "timers", a "counters" and a "distributions" object.
+   * Distributions are reported with their number of samples and the 50th,
+   * 90th and 99th percentiles and maximum, in nanoseconds.
+   *
+   * \param[out] v The JSON value object to modify.
+   *
+   * \returns The value that was passed in, after it has been modified.
+   */
+  template <typename Q> efgy::json::value<Q> &json(efgy::json::value<Q> &v) const {
+    v.toObject();
+    v("timers").toObject();
+    v("counters").toObject();
+    v("distributions").toObject();
+
+    for (std::size_t i = 0; i < timers; i++) {
+      efgy::json::value<Q> &t = v("timers")(timerNames[i]);
+      t.toObject();
+      t("nanoseconds") = Q(nanoseconds(timer(i)));
+      t("calls") = Q(calls(timer(i)));
+    }
+
+    for (std::size_t i = 0; i < counters; i++) {
+      v("counters")(counterNames[i]) = Q(count(counter(i)));
+    }
+
+    for (std::size_t i = 0; i < distributions; i++) {
+      const histogram &h = samples[i];
+      efgy::json::value<Q> &t = v("distributions")(distributionNames[i]);
+      t.toObject();
+      t("count") = Q(h.count());
+      t("p50") = Q(h.percentile(0.5));
+      t("p90") = Q(h.percentile(0.9));
+      t("p99") = Q(h.percentile(0.99));
+      t("max") = Q(h.max());
+    }
+
+    return v;
+  }
+
+protected:
+  std::atomic<std::uint64_t> time[timers];
+  std::atomic<std::uint64_t> number[timers];
+  std::atomic<std::uint64_t> value[counters];
+  histogram samples[distributions];
+};
+
+/**\brief Global registry
+ *
+ * \returns The registry that all timers and counters are recorded in.
+ */
+static inline registry &global(void) {
+  static registry r;
+  return r;
+}
+
+#if defined(NO_STATS)
+class scope {
+public:
+  scope(const timer &) {}
+};
+
+static inline void count(const counter &, const std::uint64_t &) {}
+
+class sample {
+public:
+  sample(const distribution &) {}
+};
+#else
+/**\brief Scoped timer
+ *
+ * Records the time between its construction and destruction. Only the
+ * outermost scope of each timer on a thread is recorded, so recursive
+ * functions such as state::updateMatrix() are only timed once per call.
+ */
+class scope {
+public:
+  /**\brief Start timer
+   *
+   * \param[in] pTimer The timer to record to.
+   */
+  scope(const timer &pTimer)
+      : t(pTimer), outermost(depth()[pTimer]++ == 0),
+        start(std::chrono::steady_clock::now()) {}
+
+  /**\brief Stop timer
+   *
+   * Adds the elapsed time to the global registry.
+   */
+  ~scope(void) {
+    if (outermost) {
+      global().add(t, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start).count());
+    }
+    depth()[t]--;
+  }
+
+  scope(const scope &) = delete;
+
+protected:
+  static unsigned int *depth(void) {
+    static thread_local unsigned int d[timers] = {0};
+    return d;
+  }
+
+  const timer t;
+  const bool outermost;
+  const std::chrono::steady_clock::time_point start;
+};
+
+/**\brief Add to counter
+ *
+ * \param[in] c The counter to update.
+ * \param[in] n The amount to add.
+ */
+static inline void count(const counter &c, const std::uint64_t &n) {
+  global().add(c, n);
+}
+
+/**\brief Scoped duration sample
+ *
+ * Records the time between its construction and destruction as a single
+ * sample of the given distribution.
+ */
+class sample {
+public:
+  /**\brief Start timer
+   *
+   * \param[in] pDistribution The distribution to record to.
+   */
+  sample(const distribution &pDistribution)
+      : t(pDistribution), start(std::chrono::steady_clock::now()) {}
+
+  /**\brief Stop timer
+   *
+   * Adds the elapsed time to the global registry.
+   */
+  ~sample(void) {
+    global().add(t, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+  }
+
+  sample(const sample &) = delete;
+
+protected:
+  const distribution t;
+  const std::chrono::steady_clock::time_point start;
+};
+#endif
+
+/**\brief Write report
+ *
+ * Writes all of the statistics in the global registry as JSON.
+ *
+ * \param[out] out The stream to write to.
+ */
+static inline void report(std::ostream &out) {
+  efgy::json::value<> v;
+  out << efgy::json::tag() << global().json(v);
+  out << "\n";
+}
+}
+}
+
+#endif
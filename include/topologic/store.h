@@ -0,0 +1,372 @@
+/**\file
+ * \brief Render cache
+ *
+ * Contains the on-disk cache that the CLI, batch and server modes keep
+ * rendered output in. Output is filed under a hash of everything that has an
+ * effect on it - the canonical state, the output settings and the versions
+ * of Topologic and libefgy - so rendering the exact same thing again only
+ * takes a lookup, and the stored output is memory-mapped and written out as
+ * is.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_STORE_H)
+#define TOPOLOGIC_STORE_H
+
+#include <topologic/input.h>
+#include <ef.gy/version.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace topologic {
+/**\brief Render cache
+ *
+ * Contains the classes and functions used to keep rendered output on disk.
+ *
+ * Each output is stored in a file of its own, named after a 128-bit hash of
+ * its key. The file starts with the 8 characters "TPLGSTOR", followed by the
+ * length of the key as a little-endian uint64, the key itself and then the
+ * output. Lookups compare the stored key with the one they are looking for,
+ * so a hash collision is a miss rather than the wrong output.
+ */
+namespace store {
+/**\brief Hash key
+ *
+ * \param[in] key  The key to hash.
+ * \param[in] seed The hash's offset basis.
+ *
+ * \returns The 64-bit FNV-1a hash of the key.
+ */
+static inline std::uint64_t hash(const std::string &key,
+                                 std::uint64_t seed = 14695981039346656037ull) {
+  for (const char &c : key) {
+    seed = (seed ^ std::uint64_t((unsigned char)(c))) * 1099511628211ull;
+  }
+  return seed;
+}
+
+/**\brief Cache entry
+ *
+ * A stored output, memory-mapped from its file.
+ */
+class entry {
+public:
+  /**\brief Construct with file and key
+   *
+   * Maps the given file and checks that it holds the output for the given
+   * key; check 'valid' to see if it does.
+   *
+   * \param[in] filename The file to load.
+   * \param[in] key      The key that the file should hold the output for.
+   */
+  entry(const std::string &filename, const std::string &key)
+      : data(0), size(0), valid(false), contents(filename) {
+    if (!contents.valid || (contents.size < 16) ||
+        (std::memcmp(contents.data, "TPLGSTOR", 8) != 0)) {
+      return;
+    }
+
+    std::uint64_t length = 0;
+    for (std::size_t i = 0; i < 8; i++) {
+      length |= std::uint64_t((unsigned char)(contents.data[8 + i])) << (8 * i);
+    }
+
+    if ((length != key.size()) || (contents.size - 16 < length) ||
+        (std::memcmp(contents.data + 16, key.data(), key.size()) != 0)) {
+      return;
+    }
+
+    data = contents.data + 16 + length;
+    size = contents.size - 16 - length;
+    valid = true;
+  }
+
+  entry(const entry &) = delete;
+
+  /**\brief Output
+   *
+   * Points to the first byte of the stored output.
+   */
+  const char *data;
+
+  /**\brief Output size
+   *
+   * The number of bytes that 'data' points to.
+   */
+  std::size_t size;
+
+  /**\brief Is the entry usable?
+   *
+   * Set to 'true' by the constructor if the file holds the output for the
+   * key it was looked up with.
+   */
+  bool valid;
+
+protected:
+  /**\brief File contents
+   *
+   * The mapped file.
+   */
+  const input::file contents;
+};
+
+/**\brief Cache directory
+ *
+ * Looks up and stores outputs in a directory, which is created when the
+ * first output is stored. Any number of threads and processes may use the
+ * same directory at the same time: outputs are written to a temporary file
+ * first and then renamed, so readers never see a partial file.
+ */
+class directory {
+public:
+  /**\brief Construct with path
+   *
+   * \param[in] pPath The directory to keep the outputs in.
+   */
+  directory(const std::string &pPath) : path(pPath) {}
+
+  /**\brief File name for key
+   *
+   * \param[in] key The key of an output.
+   *
+   * \returns The file that the output is stored in.
+   */
+  std::string name(const std::string &key) const {
+    static const char digits[] = "0123456789abcdef";
+    const std::uint64_t h[2] = {hash(key), hash(key, 0x6c62272e07bb0142ull)};
+    std::string n = path + "/";
+
+    for (const std::uint64_t &v : h) {
+      for (int i = 60; i >= 0; i -= 4) {
+        n += digits[(v >> i) & 0xf];
+      }
+    }
+
+    return n;
+  }
+
+  /**\brief Look up output
+   *
+   * \param[in] key The key of the output.
+   *
+   * \returns The stored output, or 0 if there is none.
+   */
+  std::unique_ptr<const entry> find(const std::string &key) const {
+    std::unique_ptr<const entry> e(new entry(name(key), key));
+    if (!e->valid) {
+      e.reset();
+    }
+    return e;
+  }
+
+  /**\brief Store output
+   *
+   * \param[in] key  The key of the output.
+   * \param[in] data The output.
+   *
+   * \returns 'true' if the output has been stored.
+   */
+  bool insert(const std::string &key, const std::string &data) const {
+    static std::atomic<std::uint64_t> counter(0);
+
+    mkdir(path.c_str(), 0777);
+
+    const std::string file = name(key);
+    std::ostringstream t("");
+    t << file << ".tmp." << getpid() << "." << counter++;
+    const std::string temporary = t.str();
+
+    char header[16] = {'T', 'P', 'L', 'G', 'S', 'T', 'O', 'R'};
+    for (std::size_t i = 0; i < 8; i++) {
+      header[8 + i] = char((std::uint64_t(key.size()) >> (8 * i)) & 0xff);
+    }
+
+    const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    bool ok = (fd >= 0) && put(fd, header, sizeof(header)) &&
+              put(fd, key.data(), key.size()) &&
+              put(fd, data.data(), data.size());
+    if (fd >= 0) {
+      ok = (close(fd) == 0) && ok;
+    }
+    ok = ok && (rename(temporary.c_str(), file.c_str()) == 0);
+
+    if (!ok) {
+      std::cerr << "error: could not store output in " << path << "\n";
+      unlink(temporary.c_str());
+    }
+
+    return ok;
+  }
+
+  /**\brief Path
+   *
+   * The directory that outputs are kept in.
+   */
+  const std::string path;
+
+protected:
+  /**\brief Write to file
+   *
+   * \param[in] fd   The file to write to.
+   * \param[in] data The data to write.
+   * \param[in] size The number of bytes in 'data'.
+   *
+   * \returns 'true' if all of the data was written.
+   */
+  static bool put(const int &fd, const char *data, std::size_t size) {
+    while (size > 0) {
+      const ssize_t w = ::write(fd, data, size);
+      if (w < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += w;
+      size -= std::size_t(w);
+    }
+    return true;
+  }
+};
+
+/**\brief Output key
+ *
+ * Describes everything that the output of a state object depends on: the
+ * versions of Topologic and libefgy, the base data type, the output mode
+ * and settings, the state's canonical arguments and its full JSON form,
+ * which also has the camera positions and transformations of all
+ * dimensions.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[in] s           The state object to render.
+ * \param[in] out         The output mode.
+ * \param[in] compression The compression method.
+ *
+ * \returns The key to store the output under.
+ */
+template <typename Q, std::size_t d>
+static std::string key(const state<Q, d> &s, const enum outputMode &out,
+                       const compress::method &compression) {
+  std::ostringstream k("");
+  std::vector<std::string> args;
+
+  k << "topologic/" << version << " libefgy/" << efgy::version << " Q"
+    << sizeof(Q) << "/" << d << " out:" << int(out) << " compress:"
+    << int(compression) << " digits:" << s.digits << " compact:" << s.compact
+    << " size:" << s.imageWidth << "x" << s.imageHeight
+    << " lod:" << double(s.detail) << "\n";
+  for (const std::string &a : s.args(args)) {
+    k << a << "\n";
+  }
+  k << efgy::json::tag() << s;
+
+  return k.str();
+}
+
+/**\brief Look up output for state
+ *
+ * Looks the state's output up in the render cache set with its
+ * 'outputCache' setting, and counts the hit or miss.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[in]  s           The state object to render.
+ * \param[in]  out         The output mode.
+ * \param[in]  compression The compression method.
+ * \param[out] k           Receives the output's key; see key().
+ *
+ * \returns The stored output, or 0 if there is none.
+ */
+template <typename Q, std::size_t d>
+static std::unique_ptr<const entry> find(const state<Q, d> &s,
+                                         const enum outputMode &out,
+                                         const compress::method &compression,
+                                         std::string &k) {
+  k = key(s, out, compression);
+  std::unique_ptr<const entry> e = directory(s.outputCache).find(k);
+  stats::count(e ? stats::cHits : stats::cMisses, 1);
+  return e;
+}
+
+/**\brief Write state, using the render cache
+ *
+ * Does the same as topologic::write(), but with the render cache set with
+ * the state's 'outputCache' setting, if there is one: stored output is
+ * written straight from its mapped file, and anything that had to be
+ * rendered is stored for next time.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[out] output      The stream to write to.
+ * \param[in]  s           The state to render.
+ * \param[in]  out         The output mode to use.
+ * \param[in]  compression The compression method to use.
+ *
+ * \returns 'true' if something was written.
+ */
+template <typename Q, std::size_t d>
+static bool write(std::ostream &output, const state<Q, d> &s,
+                  const enum outputMode &out,
+                  const compress::method &compression) {
+  if (s.outputCache.empty() || !s.model) {
+    return topologic::write(output, s, out, compression);
+  }
+
+  std::string k;
+  if (const std::unique_ptr<const entry> e = find(s, out, compression, k)) {
+    output.write(e->data, std::streamsize(e->size));
+    stats::count(stats::cBytes, e->size);
+    return bool(output);
+  }
+
+  std::ostringstream r("");
+  if (!topologic::write(r, s, out, compression)) {
+    return false;
+  }
+
+  const std::string data = r.str();
+  directory(s.outputCache).insert(k, data);
+  output.write(data.data(), std::streamsize(data.size()));
+  return bool(output);
+}
+
+/**\brief Write state with its own compression setting, using the cache
+ *
+ * Same as the above, with the state's 'compression' setting.
+ *
+ * \tparam Q Base data type as used in the topologic::state instance
+ * \tparam d Maximum render depth of the topologic::state instance
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  s      The state to render.
+ * \param[in]  out    The output mode to use.
+ *
+ * \returns 'true' if something was written.
+ */
+template <typename Q, std::size_t d>
+static bool write(std::ostream &output, const state<Q, d> &s,
+                  const enum outputMode &out) {
+  return write(output, s, out, s.compression);
+}
+}
+}
+
+#endif
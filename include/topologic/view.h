@@ -0,0 +1,367 @@
+/**\file
+ * \brief Compiled view chains
+ *
+ * Contains the view chain template, which folds the per-dimension
+ * transformation and projection matrices of a state object into a single
+ * matrix. Projecting a vertex then takes one matrix multiplication and a
+ * single perspective divide, no matter how many dimensions it passes through.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_VIEW_H)
+#define TOPOLOGIC_VIEW_H
+
+#include <ef.gy/euclidian.h>
+#include <topologic/arena.h>
+#include <topologic/simd.h>
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace topologic {
+template <typename Q, std::size_t d> class state;
+
+/**\brief View chain compilation
+ *
+ * Templates that fold the matrices of a state object into a view chain.
+ */
+namespace view {
+/**\brief Fold stage into matrix
+ *
+ * Multiplies a (rows x (e+1)) matrix with the transformation and projection
+ * matrices of dimension e, then drops the depth column so the result
+ * describes homogeneous coordinates in e-1 dimensions. libefgy multiplies row
+ * vectors with its matrices, so the chain is built up left to right.
+ *
+ * A projection divides by the homogeneous coordinate, and dropping a
+ * coordinate is linear, so everything but that division composes. Since
+ * homogeneous coordinates that only differ by a factor describe the same
+ * point, the division can be deferred to the very end of the chain.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam e Dimension of the stage to fold in.
+ * \tparam t Target dimension of the chain.
+ */
+template <typename Q, std::size_t e, std::size_t t> class fold {
+public:
+  /**\brief Apply stage
+   *
+   * \param[in]     s    The state object with the matrices to fold in.
+   * \param[in,out] m    The matrix to fold the stage into; row-major with
+   *                     e+1 columns on input and e columns on output.
+   * \param[in]     rows The number of rows in 'm'.
+   */
+  static void apply(const state<Q, e> &s, std::vector<Q> &m,
+                    const std::size_t &rows) {
+    std::vector<Q> r(rows * (e + 1));
+    std::vector<Q> p(rows * e);
+
+    for (std::size_t i = 0; i < rows; i++) {
+      for (std::size_t j = 0; j <= e; j++) {
+        Q v = Q(0);
+        for (std::size_t k = 0; k <= e; k++) {
+          v += m[i * (e + 1) + k] * s.transformation.matrix[k][j];
+        }
+        r[i * (e + 1) + j] = v;
+      }
+    }
+
+    for (std::size_t i = 0; i < rows; i++) {
+      for (std::size_t j = 0, c = 0; j <= e; j++) {
+        if (j == e - 1) {
+          continue;
+        }
+        Q v = Q(0);
+        for (std::size_t k = 0; k <= e; k++) {
+          v += r[i * (e + 1) + k] * s.projection.matrix[k][j];
+        }
+        p[i * e + c] = v;
+        c++;
+      }
+    }
+
+    m.swap(p);
+
+    const state<Q, e - 1> &lower = s;
+    fold<Q, e - 1, t>::apply(lower, m, rows);
+  }
+};
+
+/**\brief Fold stage into matrix; target fix point
+ *
+ * Ends the recursion at the chain's target dimension. Chains that go all the
+ * way down to 2D also fold in the 2D transformation, since there is no
+ * renderer below that which would apply it; chains that stop at 3D leave the
+ * 3D transformation and projection to the 3D renderer.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam t Target dimension of the chain.
+ */
+template <typename Q, std::size_t t> class fold<Q, t, t> {
+public:
+  static void apply(const state<Q, t> &s, std::vector<Q> &m,
+                    const std::size_t &rows) {
+    if (t != 2) {
+      return;
+    }
+
+    std::vector<Q> r(rows * (t + 1));
+
+    for (std::size_t i = 0; i < rows; i++) {
+      for (std::size_t j = 0; j <= t; j++) {
+        Q v = Q(0);
+        for (std::size_t k = 0; k <= t; k++) {
+          v += m[i * (t + 1) + k] * s.transformation.matrix[k][j];
+        }
+        r[i * (t + 1) + j] = v;
+      }
+    }
+
+    m.swap(r);
+  }
+};
+
+/**\brief Vertex buffer
+ *
+ * Stores vertices as structure-of-arrays, i.e. with one contiguous lane per
+ * coordinate, so that the projection kernel can process whole blocks of
+ * vertices with vector instructions.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Number of coordinates per vertex.
+ * \tparam A Allocator for the lanes.
+ */
+template <typename Q, std::size_t d, typename A = std::allocator<Q>>
+class vertices {
+public:
+  /**\brief Construct with allocator
+   *
+   * \param[in] allocator The allocator to use for all of the lanes.
+   */
+  vertices(const A &allocator = A()) {
+    for (auto &l : lane) {
+      l = std::vector<Q, A>(allocator);
+    }
+  }
+
+  /**\brief Number of vertices
+   *
+   * \returns The number of vertices in the buffer.
+   */
+  std::size_t size(void) const { return lane[0].size(); }
+
+  /**\brief Resize buffer
+   *
+   * \param[in] n The new number of vertices.
+   */
+  void resize(const std::size_t &n) {
+    for (auto &l : lane) {
+      l.resize(n);
+    }
+  }
+
+  /**\brief Reserve space
+   *
+   * \param[in] n The number of vertices to make room for.
+   */
+  void reserve(const std::size_t &n) {
+    for (auto &l : lane) {
+      l.reserve(n);
+    }
+  }
+
+  /**\brief Append vertex
+   *
+   * \param[in] v The vertex to append.
+   */
+  void push_back(const efgy::math::vector<Q, d> &v) {
+    for (std::size_t i = 0; i < d; i++) {
+      lane[i].push_back(v[i]);
+    }
+  }
+
+  /**\brief Coordinate lanes
+   *
+   * One array per coordinate; lane[i][n] is the i'th coordinate of the n'th
+   * vertex.
+   */
+  std::array<std::vector<Q, A>, d> lane;
+};
+
+/**\brief Compiled view chain
+ *
+ * Holds the combined transformations and projections that take a vertex from
+ * 'd' dimensions down to 't' dimensions, as a flat, row-major
+ * ((d+1) x (t+1)) matrix. A vertex is projected by multiplying it - as a
+ * homogeneous row vector - with this matrix and dividing by the last
+ * resulting coordinate.
+ *
+ * The chain must be compiled again whenever the state's transformations or
+ * projections change; it is cheap enough to do that once per frame.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Depth of the vertices to project.
+ * \tparam t Target dimension; 2 for SVG output, 3 for OpenGL.
+ */
+template <typename Q, std::size_t d, std::size_t t = 2> class chain {
+public:
+  /**\brief Construct with state
+   *
+   * Compiles the chain with the current matrices of the given state object.
+   *
+   * \param[in] s The state object to compile the chain for.
+   */
+  chain(const state<Q, d> &s) { compile(s); }
+
+  /**\brief Compile chain
+   *
+   * Folds the state's matrices into this chain, replacing any earlier ones.
+   *
+   * \param[in] s The state object to compile the chain for.
+   */
+  void compile(const state<Q, d> &s) {
+    std::vector<Q> m((d + 1) * (d + 1), Q(0));
+    for (std::size_t i = 0; i <= d; i++) {
+      m[i * (d + 1) + i] = Q(1);
+    }
+
+    fold<Q, d, t>::apply(s, m, d + 1);
+
+    for (std::size_t i = 0; i < matrix.size(); i++) {
+      matrix[i] = m[i];
+    }
+  }
+
+  /**\brief Project vertex
+   *
+   * \param[in] v The vertex to project.
+   *
+   * \returns The projected vertex.
+   */
+  efgy::math::vector<Q, t> operator()(const efgy::math::vector<Q, d> &v) const {
+    std::array<Q, t + 1> h;
+    for (std::size_t j = 0; j <= t; j++) {
+      h[j] = matrix[d * (t + 1) + j];
+    }
+    for (std::size_t i = 0; i < d; i++) {
+      for (std::size_t j = 0; j <= t; j++) {
+        h[j] += v[i] * matrix[i * (t + 1) + j];
+      }
+    }
+
+    efgy::math::vector<Q, t> r;
+    for (std::size_t j = 0; j < t; j++) {
+      r[j] = h[j] / h[t];
+    }
+    return r;
+  }
+
+  /**\brief Project vertex batch
+   *
+   * Projects 'n' vertices at once. The input holds 'd' coordinates per
+   * vertex and the output receives 't' coordinates per vertex, both densely
+   * packed.
+   *
+   * \param[in]  in  The vertices to project.
+   * \param[in]  n   The number of vertices.
+   * \param[out] out Where to write the projected vertices to.
+   */
+  void operator()(const Q *in, const std::size_t &n, Q *out) const {
+    for (std::size_t v = 0; v < n; v++, in += d, out += t) {
+      std::array<Q, t + 1> h;
+      for (std::size_t j = 0; j <= t; j++) {
+        h[j] = matrix[d * (t + 1) + j];
+      }
+      for (std::size_t i = 0; i < d; i++) {
+        for (std::size_t j = 0; j <= t; j++) {
+          h[j] += in[i] * matrix[i * (t + 1) + j];
+        }
+      }
+      for (std::size_t j = 0; j < t; j++) {
+        out[j] = h[j] / h[t];
+      }
+    }
+  }
+
+  /**\brief Project vertex buffer
+   *
+   * Runs the chain and the perspective divide over all vertices in a buffer.
+   * Blocks of vertices are processed with the widest vector lane available
+   * for Q - AVX2 or NEON for 'float' and 'double' - and any remaining
+   * vertices one at a time.
+   *
+   * \tparam A Allocator of the input vertices.
+   *
+   * \param[in]  in  The vertices to project.
+   * \param[out] out Where to write the projected vertices to; resized to
+   *                 the number of vertices in 'in'.
+   */
+  template <typename A>
+  void operator()(const vertices<Q, d, A> &in, vertices<Q, t> &out) const {
+    out.resize(in.size());
+    const std::size_t n = project<simd::lane<Q>, A>(in, out, 0);
+    project<simd::scalar<Q>, A>(in, out, n);
+  }
+
+  /**\brief Combined matrix
+   *
+   * The folded transformations and projections, row-major with t+1 columns;
+   * the last row holds the translation part.
+   */
+  std::array<Q, (d + 1) * (t + 1)> matrix;
+
+protected:
+  /**\brief Projection kernel
+   *
+   * Projects vertices in blocks of L::width, starting at the given vertex,
+   * for as long as there are full blocks left.
+   *
+   * \tparam L The lane type to process vertices with.
+   * \tparam A Allocator of the input vertices.
+   *
+   * \param[in]  in  The vertices to project.
+   * \param[out] out Where to write the projected vertices to.
+   * \param[in]  v   The first vertex to project.
+   *
+   * \returns The first vertex that has not been projected.
+   */
+  template <typename L, typename A>
+  std::size_t project(const vertices<Q, d, A> &in, vertices<Q, t> &out,
+                      std::size_t v) const {
+    typename L::type m[d + 1][t + 1];
+    for (std::size_t i = 0; i <= d; i++) {
+      for (std::size_t j = 0; j <= t; j++) {
+        m[i][j] = L::set(matrix[i * (t + 1) + j]);
+      }
+    }
+
+    for (const std::size_t n = in.size(); v + L::width <= n; v += L::width) {
+      typename L::type h[t + 1];
+      for (std::size_t j = 0; j <= t; j++) {
+        h[j] = m[d][j];
+      }
+      for (std::size_t i = 0; i < d; i++) {
+        const typename L::type c = L::load(&in.lane[i][v]);
+        for (std::size_t j = 0; j <= t; j++) {
+          h[j] = L::fma(c, m[i][j], h[j]);
+        }
+      }
+      for (std::size_t j = 0; j < t; j++) {
+        L::store(&out.lane[j][v], L::div(h[j], h[t]));
+      }
+    }
+
+    return v;
+  }
+};
+}
+}
+
+#endif
@@ -0,0 +1,339 @@
+/**\ingroup topologic-frontend
+ * \defgroup frontend-bench Benchmark frontend
+ * \brief Benchmarks for Topologic's hot paths
+ *
+ * Times model generation, matrix updates, SVG emission and metadata parsing,
+ * and writes the results as JSON so they can be compared between releases.
+ *
+ * \{
+ */
+
+/**\file
+ * \brief Topologic benchmarks
+ *
+ * Runs each benchmark for at least a minimum amount of time and reports the
+ * average time, output size and number of allocations per operation. The
+ * allocations include the blocks that the geometry arenas' pool gets from
+ * the system allocator, which are also reported on their own.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#include <topologic/cli.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <regex>
+
+/**\brief Number of allocations
+ *
+ * Incremented by every call to the global operator new in this programme.
+ * The block pool calls std::malloc() directly, so it counts its own; see
+ * arena::pool::allocations.
+ */
+static std::atomic<unsigned long long> allocations(0);
+
+void *operator new(std::size_t size) {
+  allocations++;
+  void *p = std::malloc(size > 0 ? size : 1);
+  if (p == 0) {
+    std::abort();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace topologic {
+/**\brief Benchmark helpers
+ *
+ * Contains the measurement code for the benchmark frontend.
+ */
+namespace bench {
+/**\brief Counting stream buffer
+ *
+ * Discards all output, but keeps track of how many bytes were written.
+ */
+class counter : public std::streambuf {
+public:
+  counter(void) : bytes(0) {}
+
+  /**\brief Bytes written
+   *
+   * Number of bytes written to the stream buffer so far.
+   */
+  std::size_t bytes;
+
+protected:
+  virtual int_type overflow(int_type c) {
+    bytes++;
+    return c == traits_type::eof() ? traits_type::not_eof(c) : c;
+  }
+
+  virtual std::streamsize xsputn(const char *, std::streamsize n) {
+    bytes += std::size_t(n);
+    return n;
+  }
+};
+
+/**\brief Benchmark result
+ *
+ * Averages for a single benchmark.
+ */
+class result {
+public:
+  std::string name;
+  std::size_t iterations;
+  double nanoseconds;
+  double bytes;
+  double allocations;
+  double poolAllocations;
+};
+
+/**\brief Run benchmark
+ *
+ * Calls a function once to warm up, then in batches of increasing size until
+ * a batch took at least the given amount of time. The averages of the last
+ * batch are reported.
+ *
+ * \tparam F Function type; called without arguments and returns the number
+ *           of bytes that it emitted.
+ *
+ * \param[in] name    The name of the benchmark.
+ * \param[in] f       The operation to measure.
+ * \param[in] minimum Minimum duration of the reported batch, in seconds.
+ *
+ * \returns The benchmark's averages.
+ */
+template <typename F>
+static result measure(const std::string &name, const F &f,
+                      const double &minimum) {
+  result r = {name, 1, 0, 0, 0, 0};
+  const std::atomic<unsigned long long> &pooled =
+      arena::pool::common().allocations;
+
+  f();
+
+  for (std::size_t n = 1;; n *= 2) {
+    const unsigned long long a = allocations, p = pooled;
+    std::size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < n; i++) {
+      bytes += f();
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    r.iterations = n;
+    r.nanoseconds = elapsed.count() * 1e9 / double(n);
+    r.bytes = double(bytes) / double(n);
+    r.poolAllocations = double(pooled - p) / double(n);
+    r.allocations = double(allocations - a) / double(n) + r.poolAllocations;
+
+    if (elapsed.count() >= minimum) {
+      break;
+    }
+  }
+
+  return r;
+}
+
+/**\brief Write results as JSON
+ *
+ * \param[out] out     The stream to write to.
+ * \param[in]  results The results to write.
+ */
+static void write(std::ostream &out, const std::vector<result> &results) {
+  out << std::setprecision(std::numeric_limits<double>::max_digits10)
+      << "{\"topologic\":" << version << ",\"results\":[";
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const result &r = results[i];
+    out << (i > 0 ? "," : "") << "{\"name\":\"" << r.name
+        << "\",\"iterations\":" << r.iterations
+        << ",\"nsPerOp\":" << r.nanoseconds << ",\"bytesPerOp\":" << r.bytes
+        << ",\"allocationsPerOp\":" << r.allocations
+        << ",\"poolAllocationsPerOp\":" << r.poolAllocations << "}";
+  }
+  out << "]}\n";
+}
+}
+}
+
+/**\brief Topologic benchmark main function
+ *
+ * Runs all benchmarks whose names match the 'filter:REGEX' option, prints a
+ * summary to stderr and writes the results as JSON to stdout, or to the file
+ * given with the 'output:FILE' option. Each benchmark runs for at least 0.1
+ * seconds, or as long as set with the 'time:SECONDS' option.
+ *
+ * \param[in] argc The number of arguments in the argv array.
+ * \param[in] argv The actual command line arguments passed to the programme.
+ *
+ * \returns 0 on success, nonzero otherwise.
+ */
+int main(int argc, char *argv[]) {
+  using namespace topologic;
+  using Q = double;
+
+  std::vector<std::string> args(argv, argv + argc);
+  double minimum = 0.1;
+  std::string output, filter = ".*";
+
+  efgy::cli::option otime("-{0,2}time:([0-9.]+)",
+                          [&minimum](std::smatch & m)->bool {
+    minimum = std::stod(m[1]);
+    return true;
+  },
+                          "Minimum duration of each benchmark, in seconds.");
+
+  efgy::cli::option ooutput("-{0,2}output:(.+)",
+                            [&output](std::smatch & m)->bool {
+    output = m[1];
+    return true;
+  },
+                            "Write JSON results to the given file.");
+
+  efgy::cli::option ofilter("-{0,2}filter:(.+)",
+                            [&filter](std::smatch & m)->bool {
+    filter = m[1];
+    return true;
+  },
+                            "Only run benchmarks matching the given regex.");
+
+  efgy::cli::options<>::common().apply(args);
+
+#if !defined(NOLIBRARIES)
+  xml XML;
+#endif
+  const std::regex match(filter);
+  std::vector<bench::result> results;
+  bench::counter null;
+  std::ostream out(&null);
+  state<Q, MAXDEPTH> s;
+
+  auto run = [&](const std::string &name,
+                 const std::function<std::size_t(void)> &f) {
+    if (!std::regex_search(name, match)) {
+      return;
+    }
+    results.push_back(bench::measure(name, f, minimum));
+    const bench::result &r = results.back();
+    std::cerr << r.name << ": " << r.nanoseconds << " ns/op, " << r.bytes
+              << " bytes/op, " << r.allocations << " allocations/op ("
+              << r.poolAllocations << " from the block pool)\n";
+  };
+
+  const registry<Q, MAXDEPTH> &models = registry<Q, MAXDEPTH>::common();
+
+  for (const auto &e : models.entries) {
+    std::ostringstream name("");
+    name << "model/" << e.model << "/" << e.depth << "@" << e.renderDepth << ":"
+         << e.format;
+    run(name.str(), [&]() -> std::size_t {
+      s.cache.clear();
+      if (setModel(s, e.format, e.model, e.depth, e.renderDepth, true)) {
+        s.model->binary(out, true);
+      }
+      return 0;
+    });
+  }
+
+  s.cache.clear();
+  setModel(s, "cartesian", "cube", 4, 4, true);
+
+  run("state/updateMatrix", [&]() -> std::size_t {
+    s.invalidateMatrix();
+    s.updateMatrix();
+    return 0;
+  });
+
+  s.setActive(4);
+  run("state/interpretDrag", [&]() -> std::size_t {
+    s.interpretDrag(Q(1), Q(1), Q(0));
+    return 0;
+  });
+  s.reset();
+  s.invalidateMatrix();
+
+  for (const std::string &m : models.models()) {
+    const std::set<std::size_t> depths = models.modelDimensions(m);
+    if (depths.empty()) {
+      continue;
+    }
+    const std::set<std::size_t> rdepths =
+        models.renderDimensions(m, *depths.begin());
+    if (rdepths.empty() ||
+        !setModel(s, "cartesian", m, *depths.begin(), *rdepths.begin())) {
+      continue;
+    }
+
+    for (const int &digits : {-1, 6}) {
+      std::ostringstream name("");
+      name << "svg/" << (digits < 0 ? "libefgy" : "buffered") << "/" << m
+           << "/" << *depths.begin() << "@" << *rdepths.begin();
+      s.digits = digits;
+      run(name.str(), [&]() -> std::size_t {
+        const std::size_t before = null.bytes;
+        s.model->svg(out, true);
+        out.flush();
+        return null.bytes - before;
+      });
+    }
+    s.digits = -1;
+  }
+
+  setModel(s, "cartesian", "cube", 4, 4);
+
+#if !defined(NOLIBRARIES)
+  std::ostringstream svg("");
+  write(svg, s, outSVG);
+  const std::string svgData = svg.str();
+
+  run("parse/xml", [&]() -> std::size_t {
+    state<Q, MAXDEPTH> t;
+    xml::parser p(svgData, "bench.svg");
+    parse(t, p);
+    parseModel(t, p);
+    return 0;
+  });
+#endif
+
+  std::ostringstream json("");
+  write(json, s, outJSON);
+  const std::string jsonData = json.str();
+
+  run("parse/json", [&]() -> std::size_t {
+    state<Q, MAXDEPTH> t;
+    std::string data = jsonData;
+    efgy::json::value<> v;
+    data >> v;
+    parse(t, v);
+    parseModel(t, v);
+    return 0;
+  });
+
+  if (output == "") {
+    bench::write(std::cout, results);
+  } else {
+    std::ofstream file(output);
+    bench::write(file, results);
+    if (!file) {
+      std::cerr << "error: could not write " << output << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/** \} */
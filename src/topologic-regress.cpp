@@ -0,0 +1,559 @@
+/**\ingroup topologic-frontend
+ * \defgroup frontend-regress Regression frontend
+ * \brief End-to-end regression checks against a stored baseline
+ *
+ * Renders a fixed corpus with the CLI frontend and compares each output's
+ * hash and size, and each run's wall time and peak memory use, with a
+ * baseline, so that optimisations can't silently change the output or make
+ * it slower.
+ *
+ * \{
+ */
+
+/**\file
+ * \brief Topologic regression checks
+ *
+ * Runs the topologic binary once per case and output mode, and either
+ * records the results as the new baseline or compares them with the
+ * existing one.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#include <topologic/cli.h>
+#include <chrono>
+#include <map>
+#include <regex>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace topologic {
+/**\brief Regression helpers
+ *
+ * Contains the measurement and comparison code for the regression frontend.
+ */
+namespace regress {
+/**\brief Case result
+ *
+ * The measurements for a single case, or its entry in the baseline.
+ */
+class result {
+public:
+  /**\brief Name
+   *
+   * The arguments that the case passes to the binary, separated by spaces;
+   * this is what results are matched up with the baseline by.
+   */
+  std::string name;
+
+  /**\brief Wall time
+   *
+   * The shortest time, in seconds, that a run of the case took.
+   */
+  double seconds;
+
+  /**\brief Peak memory use
+   *
+   * The smallest peak resident set size, in bytes, of a run of the case.
+   */
+  double memory;
+
+  /**\brief Output size
+   *
+   * The number of bytes that the case wrote to stdout.
+   */
+  std::size_t bytes;
+
+  /**\brief Output hash
+   *
+   * The 64-bit FNV-1a hash of the case's output; see store::hash().
+   */
+  std::uint64_t hash;
+};
+
+/**\brief Hash as text
+ *
+ * \param[in] hash The hash to format.
+ *
+ * \returns The hash as 16 hexadecimal digits.
+ */
+static inline std::string hex(const std::uint64_t &hash) {
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  for (int i = 60; i >= 0; i -= 4) {
+    s += digits[(hash >> i) & 0xf];
+  }
+  return s;
+}
+
+/**\brief Run case once
+ *
+ * Runs the binary with the given arguments, with its output going to a
+ * pipe, and measures the run.
+ *
+ * \param[in]  binary The programme to run.
+ * \param[in]  args   The arguments to pass to the programme.
+ * \param[out] r      Receives the run's measurements; the name is left
+ *                    untouched.
+ *
+ * \returns 'true' if the programme exited successfully and wrote something.
+ */
+static bool run(const std::string &binary,
+                const std::vector<std::string> &args, result &r) {
+  std::vector<char *> argv;
+  argv.push_back(const_cast<char *>(binary.c_str()));
+  for (const std::string &a : args) {
+    argv.push_back(const_cast<char *>(a.c_str()));
+  }
+  argv.push_back(0);
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::cerr << "error: could not create pipe\n";
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const pid_t pid = fork();
+
+  if (pid < 0) {
+    std::cerr << "error: could not run " << binary << "\n";
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execv(binary.c_str(), argv.data());
+    _exit(127);
+  }
+
+  close(fds[1]);
+
+  std::string output;
+  char buffer[65536];
+  while (true) {
+    const ssize_t n = ::read(fds[0], buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      break;
+    }
+    output.append(buffer, std::size_t(n));
+  }
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage;
+  while (wait4(pid, &status, 0, &usage) < 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  r.seconds = elapsed.count();
+#if defined(__APPLE__)
+  r.memory = double(usage.ru_maxrss);
+#else
+  r.memory = double(usage.ru_maxrss) * 1024.;
+#endif
+  r.bytes = output.size();
+  r.hash = store::hash(output);
+
+  return WIFEXITED(status) && (WEXITSTATUS(status) == 0) && !output.empty();
+}
+
+/**\brief Measure case
+ *
+ * Runs a case the given number of times. The output has to be the same for
+ * every run; the shortest time and smallest peak memory use are reported,
+ * as they are the least affected by whatever else the machine is doing.
+ *
+ * \param[in]  binary The programme to run.
+ * \param[in]  args   The arguments to pass to the programme.
+ * \param[in]  runs   The number of runs.
+ * \param[out] r      Receives the measurements.
+ *
+ * \returns 'true' if all runs succeeded with the same output.
+ */
+static bool measure(const std::string &binary,
+                    const std::vector<std::string> &args,
+                    const std::size_t &runs, result &r) {
+  for (std::size_t i = 0; i < runs; i++) {
+    result t;
+    if (!run(binary, args, t)) {
+      std::cerr << "error: " << r.name << ": run failed\n";
+      return false;
+    }
+
+    if (i == 0) {
+      r.seconds = t.seconds;
+      r.memory = t.memory;
+      r.bytes = t.bytes;
+      r.hash = t.hash;
+    } else if ((t.hash != r.hash) || (t.bytes != r.bytes)) {
+      std::cerr << "error: " << r.name << ": output differs between runs\n";
+      return false;
+    } else {
+      r.seconds = std::min(r.seconds, t.seconds);
+      r.memory = std::min(r.memory, t.memory);
+    }
+  }
+
+  return true;
+}
+
+/**\brief Read baseline
+ *
+ * \param[in]  filename The baseline file, as written by write().
+ * \param[out] baseline Receives the baseline's results, by name.
+ *
+ * \returns 'true' if the baseline could be read.
+ */
+static bool read(const std::string &filename,
+                 std::map<std::string, result> &baseline) {
+  const input::file f(filename);
+  if (!f.valid) {
+    return false;
+  }
+
+  std::string data(f.data, f.size);
+  efgy::json::value<> v;
+  data >> v;
+
+  if ((v.type != efgy::json::value<>::object) || !v("cases").isArray()) {
+    std::cerr << "error: " << filename << " is not a baseline\n";
+    return false;
+  }
+
+  for (efgy::json::value<> &c : v("cases").toArray()) {
+    if (!c("name").isString() || !c("hash").isString()) {
+      continue;
+    }
+    result r;
+    r.name = c("name").asString();
+    r.seconds = c("seconds").asNumber();
+    r.memory = c("memory").asNumber();
+    r.bytes = std::size_t(c("bytes").asNumber());
+    r.hash = std::stoull(c("hash").asString(), 0, 16);
+    baseline[r.name] = r;
+  }
+
+  return true;
+}
+
+/**\brief Write results as JSON
+ *
+ * Writes the results in the format that read() expects, so that they can
+ * be used as the next baseline.
+ *
+ * \param[out] out     The stream to write to.
+ * \param[in]  results The results to write.
+ */
+static void write(std::ostream &out, const std::vector<result> &results) {
+  out << std::setprecision(std::numeric_limits<double>::max_digits10)
+      << "{\"topologic\":" << version << ",\"cases\":[";
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const result &r = results[i];
+    out << (i > 0 ? ",\n" : "\n") << "{\"name\":\"" << r.name
+        << "\",\"seconds\":" << r.seconds << ",\"memory\":" << r.memory
+        << ",\"bytes\":" << r.bytes << ",\"hash\":\"" << hex(r.hash)
+        << "\"}";
+  }
+  out << "\n]}\n";
+}
+}
+}
+
+/**\brief Topologic regression main function
+ *
+ * Renders every model in the registry at its three lowest depths, each with
+ * its lowest render depth, and every line of the corpus - 'corpus:FILE',
+ * 'regress/corpus.txt' by default - as SVG and as JSON with the binary set
+ * with 'binary:FILE', './topologic' by default. Each case is run three
+ * times, or as often as set with 'runs:N'; only cases whose arguments match
+ * 'filter:REGEX' are run.
+ *
+ * With the 'update' option, the results are written to the baseline file -
+ * 'baseline:FILE', 'regress/baseline.json' by default. Otherwise they are
+ * compared with the baseline, and a case fails if its output's hash or size
+ * changed, if it took more than 'time:X' - 0.25 by default - longer than in
+ * the baseline, plus 20ms to allow for timer noise, or if its peak memory
+ * use grew by more than 'memory:X' - 0.1 by default - plus 1MiB. Cases in
+ * the baseline that weren't run fail as well, so cases can't be lost
+ * silently; new cases are only reported. The results may also be written to
+ * the file given with 'output:FILE'.
+ *
+ * Cases with a 'precision:float' argument are also compared with the same
+ * case without it, if there is one, and reported as matching double
+ * precision or not; this is how the single precision limits in the manual
+ * are checked. These comparisons never fail the run.
+ *
+ * \param[in] argc The number of arguments in the argv array.
+ * \param[in] argv The actual command line arguments passed to the programme.
+ *
+ * \returns 0 if all cases passed, nonzero otherwise.
+ */
+int main(int argc, char *argv[]) {
+  using namespace topologic;
+  using Q = double;
+
+  std::vector<std::string> args(argv, argv + argc);
+  std::string binary = "./topologic", corpus = "regress/corpus.txt",
+              baselineFile = "regress/baseline.json", output, filter = ".*";
+  std::size_t runs = 3;
+  double timeTolerance = 0.25, memoryTolerance = 0.1;
+  bool update = false;
+
+  efgy::cli::option obinary("-{0,2}binary:(.+)",
+                            [&binary](std::smatch & m)->bool {
+    binary = m[1];
+    return true;
+  },
+                            "The topologic binary to check.");
+
+  efgy::cli::option ocorpus("-{0,2}corpus:(.+)",
+                            [&corpus](std::smatch & m)->bool {
+    corpus = m[1];
+    return true;
+  },
+                            "Read extra cases from the given file.");
+
+  efgy::cli::option obaseline("-{0,2}baseline:(.+)",
+                              [&baselineFile](std::smatch & m)->bool {
+    baselineFile = m[1];
+    return true;
+  },
+                              "Compare with or update the given baseline.");
+
+  efgy::cli::option oupdate("-{0,2}update", [&update](std::smatch &)->bool {
+    update = true;
+    return true;
+  },
+                            "Write the results as the new baseline.");
+
+  efgy::cli::option oruns("-{0,2}runs:([0-9]+)",
+                          [&runs](std::smatch & m)->bool {
+    runs = std::stoul(m[1]);
+    return runs > 0;
+  },
+                          "Number of times to run each case.");
+
+  efgy::cli::option otime("-{0,2}time:([0-9.]+)",
+                          [&timeTolerance](std::smatch & m)->bool {
+    timeTolerance = std::stod(m[1]);
+    return true;
+  },
+                          "Allowed slowdown, as a fraction of the baseline.");
+
+  efgy::cli::option omemory("-{0,2}memory:([0-9.]+)",
+                            [&memoryTolerance](std::smatch & m)->bool {
+    memoryTolerance = std::stod(m[1]);
+    return true;
+  },
+                            "Allowed growth of peak memory use, as a "
+                            "fraction of the baseline.");
+
+  efgy::cli::option ooutput("-{0,2}output:(.+)",
+                            [&output](std::smatch & m)->bool {
+    output = m[1];
+    return true;
+  },
+                            "Write JSON results to the given file.");
+
+  efgy::cli::option ofilter("-{0,2}filter:(.+)",
+                            [&filter](std::smatch & m)->bool {
+    filter = m[1];
+    return true;
+  },
+                            "Only run cases matching the given regex.");
+
+  efgy::cli::options<>::common().apply(args);
+
+  std::vector<std::vector<std::string>> cases;
+
+  {
+    std::map<std::pair<std::string, std::string>,
+             std::map<std::size_t, std::size_t>> depths;
+
+    for (const auto &e : registry<Q, MAXDEPTH>::common().entries) {
+      std::map<std::size_t, std::size_t> &d = depths[{e.model, e.format}];
+      if ((d.find(e.depth) == d.end()) || (e.renderDepth < d[e.depth])) {
+        d[e.depth] = e.renderDepth;
+      }
+    }
+
+    for (const auto &m : depths) {
+      std::size_t n = 0;
+      for (auto it = m.second.begin(); (it != m.second.end()) && (n < 3);
+           it++, n++) {
+        std::ostringstream s("");
+        s << "m:" << it->first << "-" << m.first.first << "@" << it->second
+          << ":" << m.first.second;
+        cases.push_back({s.str()});
+      }
+    }
+  }
+
+  {
+    const input::file f(corpus);
+    const batch::manifest m(f.valid ? std::string(f.data, f.size)
+                                    : std::string(),
+                            corpus);
+    if (!m.valid) {
+      return 1;
+    }
+    for (const batch::job &j : m.jobs) {
+      if (!j.args.empty()) {
+        cases.push_back(j.args);
+      }
+    }
+  }
+
+  const std::regex match(filter);
+  std::vector<regress::result> results;
+  std::vector<std::string> broken;
+  std::size_t failed = 0;
+
+  for (const std::vector<std::string> &c : cases) {
+    for (const char *mode : {"svg", "json"}) {
+      std::vector<std::string> a = c;
+      a.push_back(mode);
+
+      regress::result r;
+      for (const std::string &s : a) {
+        r.name += (r.name.empty() ? "" : " ") + s;
+      }
+      if (!std::regex_search(r.name, match)) {
+        continue;
+      }
+
+      if (!regress::measure(binary, a, runs, r)) {
+        broken.push_back(r.name);
+        failed++;
+        continue;
+      }
+
+      std::cerr << r.name << ": " << r.seconds << " s, " << r.memory
+                << " bytes peak, " << r.bytes << " bytes of output, hash "
+                << regress::hex(r.hash) << "\n";
+      results.push_back(r);
+    }
+  }
+
+  // single precision cases are named like their double precision twins plus
+  // the option; whether they match is reported but expected to vary.
+  const std::string single = " precision:float";
+  for (const regress::result &r : results) {
+    const std::size_t at = r.name.find(single);
+    if (at == std::string::npos) {
+      continue;
+    }
+    const std::string twin =
+        r.name.substr(0, at) + r.name.substr(at + single.size());
+    for (const regress::result &t : results) {
+      if (t.name == twin) {
+        std::cerr << "float: " << r.name << ": "
+                  << (((t.hash == r.hash) && (t.bytes == r.bytes))
+                          ? "same output as"
+                          : "differs from")
+                  << " double precision\n";
+      }
+    }
+  }
+
+  if (output != "") {
+    std::ofstream file(output);
+    regress::write(file, results);
+    if (!file) {
+      std::cerr << "error: could not write " << output << "\n";
+      return 1;
+    }
+  }
+
+  if (update) {
+    if (failed > 0) {
+      std::cerr << "error: " << failed << " cases failed; not updating "
+                << baselineFile << "\n";
+      return 1;
+    }
+    std::ofstream file(baselineFile);
+    regress::write(file, results);
+    if (!file) {
+      std::cerr << "error: could not write " << baselineFile << "\n";
+      return 1;
+    }
+    std::cerr << "recorded " << results.size() << " cases in " << baselineFile
+              << "\n";
+    return 0;
+  }
+
+  std::map<std::string, regress::result> baseline;
+  if (!regress::read(baselineFile, baseline)) {
+    std::cerr << "error: no baseline in " << baselineFile
+              << "; record one with 'make regress-baseline'\n";
+    return 1;
+  }
+
+  for (const std::string &name : broken) {
+    baseline.erase(name);
+  }
+
+  for (const regress::result &r : results) {
+    const auto it = baseline.find(r.name);
+    if (it == baseline.end()) {
+      std::cerr << "new: " << r.name << "\n";
+      continue;
+    }
+
+    const regress::result &b = it->second;
+    baseline.erase(it);
+
+    if ((r.hash != b.hash) || (r.bytes != b.bytes)) {
+      std::cerr << "FAIL: " << r.name << ": output changed, " << b.bytes
+                << " bytes with hash " << regress::hex(b.hash) << " -> "
+                << r.bytes << " bytes with hash " << regress::hex(r.hash)
+                << "\n";
+      failed++;
+    }
+    if (r.seconds > b.seconds * (1. + timeTolerance) + 0.02) {
+      std::cerr << "FAIL: " << r.name << ": slower, " << b.seconds << " s -> "
+                << r.seconds << " s\n";
+      failed++;
+    }
+    if (r.memory > b.memory * (1. + memoryTolerance) + 1048576.) {
+      std::cerr << "FAIL: " << r.name << ": more memory, " << b.memory
+                << " bytes -> " << r.memory << " bytes\n";
+      failed++;
+    }
+  }
+
+  for (const auto &b : baseline) {
+    if (std::regex_search(b.first, match)) {
+      std::cerr << "FAIL: " << b.first << ": in the baseline, but not run\n";
+      failed++;
+    }
+  }
+
+  if (failed > 0) {
+    std::cerr << failed << " regressions\n";
+    return 1;
+  }
+
+  std::cerr << "no regressions in " << results.size() << " cases\n";
+  return 0;
+}
+
+/** \} */
@@ -29,13 +29,14 @@
 /**\brief Topologic/CLI main function
  *
  * This is really just a stub that calls the topologic::cli function, which
- * contains the actual logic for the Topologic/CLI frontend.
+ * contains the actual logic for the Topologic/CLI frontend and picks the
+ * floating point type to use.
  *
  * \param[in] argc The number of arguments in the argv array.
  * \param[in] argv The actual command line arguments passed to the programme.
  *
  * \returns 0 on success, nonzero otherwise.
  */
-int main(int argc, char *argv[]) { return topologic::cli<double>(argc, argv); }
+int main(int argc, char *argv[]) { return topologic::cli(argc, argv); }
 
 /** \} */
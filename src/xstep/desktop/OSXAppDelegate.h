@@ -20,6 +20,7 @@
 #import "OpenGLRenderer.h"
 
 #include <topologic/arguments.h>
+#include <topologic/builder.h>
 
 #if !defined(MAXDEPTH)
 /**\brief Maximum render depth
@@ -442,15 +443,28 @@
  *
  * Called after model parameters are changed. This will tell Topologic to use
  * its model factory to recreate a new model with the currently intended
- * parameters.
+ * parameters. The model is built in the background; the current one is drawn
+ * until the new one is swapped in by 'swapModel'.
  */
 - (void) updateModel;
 
 /**\brief Recalculate model
  *
- * Like 'updateModel', but the model is merely told to recalculate its mesh.
- * This should be called after changing model parameters.
+ * Like 'updateModel', but meant to be called after changing model
+ * parameters; superseded builds are cancelled, so this may be called for
+ * every change, e.g. while dragging a slider.
  */
 - (void) updateModelParameters;
 
+/**\brief Swap in new model
+ *
+ * Models are built in the background by 'updateModel'; this replaces the
+ * state's model with the new one once it is ready. Called by the OpenGL
+ * view before drawing a frame.
+ *
+ * \returns YES while a new model is still being built, so that the view
+ *          keeps redrawing until it can be swapped in.
+ */
+- (BOOL) swapModel;
+
 @end
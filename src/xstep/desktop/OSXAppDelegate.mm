@@ -24,6 +24,20 @@
  */
 static topologic::state<GLfloat,MAXDEPTH> topologicState;
 
+/**\brief Model registry
+ *
+ * The registry type for the global state object; used to create models and
+ * to fill the model, format and depth menus.
+ */
+typedef topologic::registry<GLfloat,MAXDEPTH> modelRegistry;
+
+/**\brief Model builder
+ *
+ * Generates new models for the global state object in the background, so
+ * that changing the model or its parameters doesn't block the UI.
+ */
+static topologic::builder<GLfloat,MAXDEPTH> modelBuilder(topologicState);
+
 /**\brief XML wrapper
  *
  * Used to parse SVG files with Topologic metadata and to manipulate the state
@@ -120,49 +134,42 @@ static topologic::xml xml;
 {
   topologicState.translateCartesianToPolar();
   topologicState.polarCoordinates = true;
+  topologicState.invalidateMatrix();
 }
 
 - (void)translatePolarToCartesian
 {
   topologicState.translatePolarToCartesian();
   topologicState.polarCoordinates = false;
+  topologicState.invalidateMatrix();
 }
 
 - (void)setUpBaseModels
 {
-  using namespace efgy::geometry;
-
   [baseModels removeAllItems];
 
-  std::set<const char*> bmods;
-  for (const char *b : with<GLfloat,functor::models,MAXDEPTH>(bmods,"*",0,0))
+  for (const std::string &b : modelRegistry::common().models())
   {
-    [baseModels addItemWithTitle:@(b)];
+    [baseModels addItemWithTitle:@(b.c_str())];
   }
 }
 
 - (void)setUpFormats
 {
-  using namespace efgy::geometry;
-
   [formats removeAllItems];
 
-  std::set<const char*> form;
-  for (const char *f : with<GLfloat,functor::formats,MAXDEPTH>(form,"*","cube",0,0))
+  for (const std::string &f : modelRegistry::common().formats("cube"))
   {
-    [formats addItemWithTitle:@(f)];
+    [formats addItemWithTitle:@(f.c_str())];
   }
 }
 
 - (void)setUpModelDepths
 {
-  using namespace efgy::geometry;
-  
   [modelDepths setSegmentCount:0];
 
-  std::set<std::size_t> dep;
+  const std::set<std::size_t> dep = modelRegistry::common().modelDimensions();
   int i = 0;
-  with<GLfloat,functor::modelDimensions,MAXDEPTH>(dep,"*",0,0);
   [modelDepths setSegmentCount:dep.size()];
   for (std::size_t d : dep)
   {
@@ -175,13 +182,10 @@ static topologic::xml xml;
 
 - (void)setUpRenderDepths
 {
-  using namespace efgy::geometry;
-
   [renderDepths setSegmentCount:0];
 
-  std::set<std::size_t> rdep;
+  const std::set<std::size_t> rdep = modelRegistry::common().renderDimensions();
   int i = 0;
-  with<GLfloat,functor::renderDimensions,MAXDEPTH>(rdep,"*",0,0);
   [renderDepths setSegmentCount:rdep.size()];
   for (std::size_t d : rdep)
   {
@@ -194,13 +198,10 @@ static topologic::xml xml;
 
 - (void)setUpCameraDepths
 {
-  using namespace efgy::geometry;
-
   [cameraDepths setSegmentCount:0];
 
-  std::set<std::size_t> rdep;
+  const std::set<std::size_t> rdep = modelRegistry::common().renderDimensions();
   int i = 0;
-  with<GLfloat,functor::renderDimensions,MAXDEPTH>(rdep,"*",0,0);
   [cameraDepths setSegmentCount:rdep.size()];
   for (std::size_t d : rdep)
   {
@@ -213,11 +214,8 @@ static topologic::xml xml;
 
 - (void)updateAvailableModelDepths
 {
-  using namespace efgy::geometry;
-
-  std::set<std::size_t> dep;
-  with<GLfloat,functor::modelDimensions,MAXDEPTH>(
-      dep, [model UTF8String], 0, 0);
+  const std::set<std::size_t> dep =
+      modelRegistry::common().modelDimensions([model UTF8String]);
 
   auto mdim = [self modelDepth];
   bool needsReset = false;
@@ -246,11 +244,9 @@ static topologic::xml xml;
 
 - (void)updateAvailableRenderDepths
 {
-  using namespace efgy::geometry;
-
-  std::set<std::size_t> dep;
-  with<GLfloat,functor::renderDimensions,MAXDEPTH>(
-      dep, [model UTF8String],(std::size_t)[self modelDepth],0);
+  const std::set<std::size_t> dep =
+      modelRegistry::common().renderDimensions([model UTF8String],
+                                               (std::size_t)[self modelDepth]);
 
   auto mdim = [self renderDepth];
   bool needsReset = false;
@@ -331,6 +327,8 @@ static topologic::xml xml;
   [self setColourSurface:[NSColor colorWithDeviceRed:0.5 green:0.5 blue:0.5 alpha:0.2]];
   
   [self updateCamera];
+
+  topologicState.progressive = true;
   
   format = @"cartesian";
   
@@ -685,11 +683,11 @@ static topologic::xml xml;
   
   if (p.valid)
   {
-    topologic::parseModel<GLfloat,MAXDEPTH,topologic::updateModel> (topologicState, p);
+    topologic::parseModel (topologicState, p);
   }
   else
   {
-    topologic::parseModel<GLfloat,MAXDEPTH,topologic::updateModel> (topologicState, v);
+    topologic::parseModel (topologicState, v);
   }
   
   if (topologicState.model)
@@ -794,22 +792,18 @@ static topologic::xml xml;
 
 - (IBAction)randomFlameColours:(id)sender
 {
-  topologicState.opengl.setColourMap(topologicState.parameter.colourMap);
+  topologicState.opengl().setColourMap(topologicState.parameter.colourMap);
   [openGL setNeedsDisplay:YES];
 }
 
 - (void) updateModel
 {
-  [self willChangeValueForKey:@"selectedModelName"];
-  
-  efgy::geometry::with<GLfloat,topologic::updateModel,MAXDEPTH>
-  (topologicState,
-   [[format lowercaseString] UTF8String],
+  modelBuilder.request
+  ([[format lowercaseString] UTF8String],
    [[model lowercaseString] UTF8String],
    (const std::size_t)modelDepth,
    (const std::size_t)renderDepth);
 
-  [self didChangeValueForKey:@"selectedModelName"];
   [openGL setNeedsDisplay:YES];
 
   [self updateAvailableModelDepths];
@@ -817,11 +811,19 @@ static topologic::xml xml;
 
 - (void) updateModelParameters
 {
-  if (topologicState.model)
+  [self updateModel];
+}
+
+- (BOOL) swapModel
+{
+  if (modelBuilder.ready())
   {
-    topologicState.model->update = true;
-    [openGL setNeedsDisplay:YES];
+    [self willChangeValueForKey:@"selectedModelName"];
+    modelBuilder.swap();
+    [self didChangeValueForKey:@"selectedModelName"];
   }
+
+  return topologicState.building;
 }
 
 - (BOOL)applicationShouldTerminateAfterLastWindowClosed:(NSApplication *)theApplication
@@ -22,15 +22,27 @@
 #import <Cocoa/Cocoa.h>
 #import <GLKit/GLKit.h>
 
+#include <topologic/pacing.h>
+
 /**\brief OpenGL render view
  *
  * This is the OpenGL view used in the OSX frontend. It initialises an OpenGL
  * context so that it can be used with libefgy/Topologic and redraws the scene
  * when it becomes necessary. It also listens to certain mouse events that allow
  * simple manipulations of the scene.
+ *
+ * Redraws are paced by a display link: requests for a redraw wake up the
+ * render loop, which draws at most one frame per refresh of the display and
+ * goes back to sleep once there is nothing left to update.
  */
 @interface OpenGLRenderer : NSOpenGLView
 {
+  /**\brief Render loop
+   *
+   * Draws frames in step with the display; created along with the OpenGL
+   * context.
+   */
+  topologic::pacing::loop *renderLoop;
 }
 
 /**\brief Prepare OpenGL context
@@ -42,10 +54,31 @@
 /**\brief Redraw
  *
  * Called by the runtime to tell us that we need to redraw parts of the OpenGL
- * context. Whenever this function is called we simply redraw the whole scene.
+ * context. Whenever this function is called we simply redraw the whole scene,
+ * and wake up the render loop if that wasn't the last frame that's needed.
  */
 - (void) drawRect:(NSRect)dirtyRect;
 
+/**\brief Request redraw
+ *
+ * Requests to redraw the view are passed on to the render loop, so that the
+ * scene is drawn on the next refresh of the display - once, no matter how
+ * many requests came in since the previous frame.
+ *
+ * \param[in] flag Whether the view needs to be redrawn.
+ */
+- (void) setNeedsDisplay:(BOOL)flag;
+
+/**\brief Draw frame
+ *
+ * Draws the whole scene; called by the render loop and by drawRect:.
+ *
+ * \returns 'YES' if another frame is needed, because the model is still being
+ *          updated or a new one is being generated; 'NO' if the scene is
+ *          complete.
+ */
+- (BOOL) renderFrame;
+
 /**\brief Opaque view?
  *
  * Called by the runtime to query if the view is 'opaque'. Our view is, so we
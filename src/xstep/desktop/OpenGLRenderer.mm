@@ -41,6 +41,12 @@
   return self = [super initWithFrame:frame pixelFormat:pf];
 }
 
+- (void) dealloc
+{
+  delete renderLoop;
+  [super dealloc];
+}
+
 - (void)prepareOpenGL
 {
   [super prepareOpenGL];
@@ -52,15 +58,41 @@
 
   GLint swapInt = 1;
   [[self openGLContext] setValues:&swapInt forParameter:NSOpenGLCPSwapInterval];
+
+  if (!renderLoop)
+  {
+    renderLoop = new topologic::pacing::loop([self](const double &) -> bool {
+      return [self renderFrame];
+    });
+  }
+
+  renderLoop->attach((CGLContextObj)[[self openGLContext] CGLContextObj],
+                     (CGLPixelFormatObj)[[self pixelFormat] CGLPixelFormatObj]);
 }
 
 - (void) drawRect:(NSRect)dirtyRect
+{
+  if ([self renderFrame] && renderLoop) {
+    renderLoop->wake();
+  }
+}
+
+- (void) setNeedsDisplay:(BOOL)flag
+{
+  if (flag && renderLoop) {
+    renderLoop->wake();
+  } else {
+    [super setNeedsDisplay:flag];
+  }
+}
+
+- (BOOL) renderFrame
 {
   [[self openGLContext] makeCurrentContext];
   [(OSXAppDelegate*)[NSApp delegate] state]->width  = [self bounds].size.width;
   [(OSXAppDelegate*)[NSApp delegate] state]->height = [self bounds].size.height;
 
-  BOOL update = NO;
+  BOOL update = [(OSXAppDelegate*)[NSApp delegate] swapModel];
 
   if ([(OSXAppDelegate*)[NSApp delegate] state]->model)
   {
@@ -78,21 +110,11 @@
   // don't want here, since we want to use the properly set one.
   if ([(OSXAppDelegate*)[NSApp delegate] updateFractalFlameColours]) {
     [(OSXAppDelegate*)[NSApp delegate] setUpdateFractalFlameColours:false];
-    [(OSXAppDelegate*)[NSApp delegate] state]->opengl.setColourMap([(OSXAppDelegate*)[NSApp delegate] state]->parameter.colourMap);
+    [(OSXAppDelegate*)[NSApp delegate] state]->opengl().setColourMap([(OSXAppDelegate*)[NSApp delegate] state]->parameter.colourMap);
     update = YES;
   }
 
-  if (update) {
-    NSInvocation *inv = [NSInvocation
-                         invocationWithMethodSignature:[self methodSignatureForSelector:@selector(setNeedsDisplay:)]];
-    [inv setSelector:@selector(setNeedsDisplay:)];
-    [inv setTarget:self];
-    [inv setArgument:&update atIndex:2];
-
-    [inv performSelector:@selector(invoke)
-              withObject:self
-              afterDelay:0.01];
-  }
+  return update;
 }
 
 - (BOOL) isOpaque
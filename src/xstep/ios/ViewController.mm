@@ -58,6 +58,8 @@
   
   [(iOSAppDelegate*)[[UIApplication sharedApplication] delegate] state]->width  = rect.size.width  * [[UIScreen mainScreen] scale];
   [(iOSAppDelegate*)[[UIApplication sharedApplication] delegate] state]->height = rect.size.height * [[UIScreen mainScreen] scale];
+
+  [(iOSAppDelegate*)[[UIApplication sharedApplication] delegate] swapModel];
   
   if ([(iOSAppDelegate*)[[UIApplication sharedApplication] delegate] state]->model)
   {
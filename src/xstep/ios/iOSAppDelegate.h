@@ -27,6 +27,7 @@
 #define glDeleteVertexArrays(i, j) glDeleteVertexArraysOES(i, j)
 
 #include <topologic/arguments.h>
+#include <topologic/builder.h>
 
 #if !defined(MAXDEPTH)
 /**\brief Maximum render depth
@@ -70,6 +71,9 @@
 /**\copydoc OSXAppDelegate::updateModelParameters */
 - (void) updateModelParameters;
 
+/**\copydoc OSXAppDelegate::swapModel */
+- (BOOL) swapModel;
+
 /**\brief Reconfigure with user defaults
  *
  * Uses the stored user defaults to set the current application settings.
@@ -24,6 +24,13 @@
  */
 static topologic::state<GLfloat,MAXDEPTH> topologicState;
 
+/**\brief Model builder
+ *
+ * Generates new models for the global state object in the background, so
+ * that changing a setting doesn't block the UI.
+ */
+static topologic::builder<GLfloat,MAXDEPTH> modelBuilder(topologicState);
+
 @implementation iOSAppDelegate
 
 @synthesize state;
@@ -40,6 +47,8 @@ static topologic::state<GLfloat,MAXDEPTH> topologicState;
 
     [self registerDefaultsFromSettingsBundle];
 
+    topologicState.progressive = true;
+
     [self reconfigure];
 
     return YES;
@@ -160,9 +169,8 @@ static topologic::state<GLfloat,MAXDEPTH> topologicState;
         }
     }
 
-    efgy::geometry::with<GLfloat,topologic::updateModel,MAXDEPTH>
-        (topologicState,
-         [format UTF8String],
+    modelBuilder.request
+        ([format UTF8String],
          [model UTF8String],
          (const unsigned int)[[NSUserDefaults standardUserDefaults] integerForKey:@"depth"],
          (const unsigned int)[[NSUserDefaults standardUserDefaults] integerForKey:@"renderDepth"]);
@@ -170,10 +178,14 @@ static topologic::state<GLfloat,MAXDEPTH> topologicState;
 
 - (void) updateModelParameters
 {
-    if (topologicState.model)
-    {
-        topologicState.model->update = true;
-    }
+    [self updateModel];
+}
+
+- (BOOL) swapModel
+{
+    modelBuilder.swap();
+
+    return topologicState.building;
 }
 
 - (void)settingDidChange:(NSNotification*)notification
@@ -237,7 +249,7 @@ static topologic::state<GLfloat,MAXDEPTH> topologicState;
         topologicState.fractalFlameColouring = [[NSUserDefaults standardUserDefaults] boolForKey:@"fractalFlameColouring"];
         if (topologicState.fractalFlameColouring)
         {
-            topologicState.opengl.setColourMap(topologicState.parameter.colourMap);
+            topologicState.opengl().setColourMap(topologicState.parameter.colourMap);
         }
         [self updateModelParameters];
     }
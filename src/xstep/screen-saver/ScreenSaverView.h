@@ -11,6 +11,7 @@
 #import <GLKit/GLKit.h>
 
 #include <topologic/arguments.h>
+#include <topologic/pacing.h>
 
 #define MAXDEPTH 7
 
@@ -19,6 +20,10 @@
   NSOpenGLView *glView;
   
   topologic::state<GLfloat, MAXDEPTH> *state;
+
+  topologic::pacing::loop *renderLoop;
+
+  double sinceFrame;
 }
 
 @end
@@ -56,10 +56,21 @@
     state->parameter.seed = std::rand();
     //state->fractalFlameColouring = true;
 
-    efgy::geometry::with<GLfloat,topologic::updateModel,MAXDEPTH>(
+    topologic::registry<GLfloat,MAXDEPTH>::common().create(
         *state, "cartesian", "clifford-torus", 2, 4);
 
-    [self setAnimationTimeInterval:1/30.0];
+    // frames are drawn by the render loop, in step with the display, so
+    // there's no need for the screen saver engine to call us very often.
+    [self setAnimationTimeInterval:1];
+    sinceFrame = 0;
+
+    __unsafe_unretained Topologic_Screen_SaverView *view = self;
+    renderLoop = new topologic::pacing::loop(
+        [view](const double &elapsed) -> bool {
+          return [view renderFrame:elapsed];
+        });
+    renderLoop->attach((CGLContextObj)[[glView openGLContext] CGLContextObj],
+                       (CGLPixelFormatObj)[[glView pixelFormat] CGLPixelFormatObj]);
   }
   
   NSLog(@"initWithFrame done");
@@ -86,6 +97,9 @@
 
   [glView removeFromSuperview];
 
+  delete renderLoop;
+  renderLoop = 0;
+
   delete state;
   state = 0;
 }
@@ -111,12 +125,17 @@
   NSLog(@"startAnimation...");
 
   [super startAnimation];
+
+  sinceFrame = 0;
+  renderLoop->wake();
 }
 
 - (void)stopAnimation
 {
   NSLog(@"stopAnimation...");
 
+  renderLoop->stop();
+
   [super stopAnimation];
 }
 
@@ -141,18 +160,35 @@
   [self doDraw];
 }
 
-- (void)animateOneFrame
+- (BOOL)renderFrame:(double)elapsed
 {
+  // the model changes slowly, so there's no point in drawing more than the
+  // 30 frames a second we used to; skip refreshes until that much time has
+  // passed, to keep faster displays from drawing 60 or 120 frames a second.
+  sinceFrame += elapsed;
+  if (sinceFrame < 1.0 / 30.0)
+  {
+    return [self isAnimating];
+  }
+
+  // rotate at the same speed, no matter how many refreshes were skipped;
+  // and don't jump ahead after a pause, e.g. because a frame took a while.
+  const GLfloat ticks = GLfloat(std::min(sinceFrame, 0.1) * 30.0);
+  sinceFrame = 0;
+
   state->setActive(4);
-  state->interpretDrag(-2, 0, 0);
+  state->interpretDrag(-2 * ticks, 0, 0);
   state->setActive(3);
-  state->interpretDrag(0, 1, 0);
-
-  // this isn't working for some reason...
-  [self setNeedsDisplay:YES];
+  state->interpretDrag(0, ticks, 0);
 
   [self doDraw];
 
+  return [self isAnimating];
+}
+
+- (void)animateOneFrame
+{
+  // nothing to do here: frames are drawn by the render loop.
   return;
 }
 